@@ -0,0 +1,90 @@
+#include "allocationTracker.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+
+namespace pubsupp {
+
+	namespace {
+		std::atomic<uint64_t> processAllocations = 0;
+		thread_local uint64_t threadAllocations = 0;
+	} // namespace
+
+
+#ifdef PUBSUPP_TRACK_ALLOCATIONS
+	bool allocationTrackingEnabled() { return true; }
+#else
+	bool allocationTrackingEnabled() { return false; }
+#endif
+
+
+	uint64_t allocationCount() { return processAllocations.load(std::memory_order_relaxed); }
+
+
+	uint64_t threadAllocationCount() { return threadAllocations; }
+
+
+	namespace detail {
+		inline void countAllocation() {
+			processAllocations.fetch_add(1, std::memory_order_relaxed);
+			threadAllocations++;
+		}
+	} // namespace detail
+
+} // namespace pubsupp
+
+
+
+#ifdef PUBSUPP_TRACK_ALLOCATIONS
+// the nothrow forms of new and delete end up in these as well
+void* operator new(std::size_t size) {
+	pubsupp::detail::countAllocation();
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	pubsupp::detail::countAllocation();
+	size_t align = static_cast<size_t>(alignment);
+	if (void* p = std::aligned_alloc(align, size == 0 ? align : (size + align - 1) / align * align)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+
+void* operator new[](std::size_t size, std::align_val_t alignment) { return ::operator new(size, alignment); }
+
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+
+
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
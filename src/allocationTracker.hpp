@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Heap allocation counters, fed by replacements of the global operator new.
+	 *
+	 * The replacements are only compiled in with PUBSUPP_TRACK_ALLOCATIONS (CMake option of the same name),
+	 * otherwise tracking is off and every counter stays 0.
+	 */
+	bool allocationTrackingEnabled();
+
+	// allocations of the whole process so far
+	uint64_t allocationCount();
+	// allocations made by the calling thread so far
+	uint64_t threadAllocationCount();
+
+} // namespace pubsupp
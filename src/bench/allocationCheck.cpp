@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+
+#include "allocationTracker.hpp"
+#include "mockBroker.hpp"
+#include "mqttClient.hpp"
+
+
+
+/*
+ * Checks that the steady-state hot paths of MqttClient do not touch the heap:
+ *
+ *   allocationCheck [iterations]
+ *
+ * Runs a mock broker in-process (on a thread of its own) and, after a warm-up, counts the heap
+ * allocations of the client thread for
+ *   - a QoS 0 publish
+ *   - a QoS 1 publish, until its PUBACK was handled
+ *   - an inbound PUBLISH, from the socket to its handler
+ * Only built with PUBSUPP_TRACK_ALLOCATIONS. The exit code is 1 if any of them allocated.
+ */
+using namespace pubsupp;
+
+
+
+namespace {
+	constexpr size_t WARM_UP = 1000;
+
+
+	// allocations per operation on the calling thread, after `WARM_UP` unmeasured runs
+	double allocationsPer(size_t iterations, const std::function<void()>& operation) {
+		for (size_t i = 0; i < WARM_UP; ++i) {
+			operation();
+		}
+
+		uint64_t before = threadAllocationCount();
+		for (size_t i = 0; i < iterations; ++i) {
+			operation();
+		}
+		return static_cast<double>(threadAllocationCount() - before) / static_cast<double>(iterations);
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	if (!allocationTrackingEnabled()) {
+		std::cerr << "allocationCheck needs a build with PUBSUPP_TRACK_ALLOCATIONS=ON" << std::endl;
+		return 1;
+	}
+	size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+	if (iterations == 0) {
+		std::cerr << "usage: allocationCheck [iterations]" << std::endl;
+		return 1;
+	}
+
+	MockBrokerConfig brokerConfig;
+	brokerConfig.port = 0;
+	MockBroker broker(brokerConfig);
+	broker.start();
+
+	std::string host = "127.0.0.1";
+	std::string clientId = "pubsupp-allocation-check";
+	MqttClient client(host, broker.port(), clientId);
+	client.connect();
+
+	uint64_t received = 0;
+	client.subscribe("pubsupp/allocations/in", QoS::AT_MOST_ONCE, [&received](const PublishMessage&) { ++received; });
+
+	const std::string payload(64, 'x');
+	const std::string qos0Topic = "pubsupp/allocations/qos0";
+	const std::string qos1Topic = "pubsupp/allocations/qos1";
+	const std::string inboundTopic = "pubsupp/allocations/in";
+
+	struct Result {
+		const char* name;
+		double perOperation;
+	};
+	Result results[] = {
+		{"QoS 0 publish", allocationsPer(iterations, [&]() { client.publish(qos0Topic, QoS::AT_MOST_ONCE, payload); })},
+		{"QoS 1 publish + PUBACK", allocationsPer(iterations, [&]() { client.publish(qos1Topic, QoS::AT_LEAST_ONCE, payload); })},
+		// the message comes back from the broker, only receiving and dispatching it is counted
+		{"inbound PUBLISH dispatch", 0},
+	};
+
+	uint64_t inboundAllocations = 0;
+	for (size_t i = 0; i < WARM_UP + iterations; ++i) {
+		client.publish(inboundTopic, QoS::AT_MOST_ONCE, payload);
+
+		uint64_t before = threadAllocationCount();
+		for (uint64_t expected = received + 1; received < expected;) {
+			client.poll(-1);
+		}
+		if (i >= WARM_UP) {
+			inboundAllocations += threadAllocationCount() - before;
+		}
+	}
+	results[2].perOperation = static_cast<double>(inboundAllocations) / static_cast<double>(iterations);
+
+	client.disconnect();
+	broker.stop();
+
+	bool clean = true;
+	std::cout << std::fixed << std::setprecision(3);
+	for (const Result& result : results) {
+		std::cout << std::left << std::setw(28) << result.name << result.perOperation << " allocations/op" << std::endl;
+		clean = clean && result.perOperation == 0;
+	}
+	if (!clean) {
+		std::cerr << "steady-state allocations found" << std::endl;
+		return 1;
+	}
+	return 0;
+}
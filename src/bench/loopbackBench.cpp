@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+#include "loopbackTransport.hpp"
+#include "mqttClientImpl.hpp"
+
+
+
+/*
+ * Client CPU cost per message, without a socket: the client runs over a LoopbackTransport whose peer
+ * answers inline, so all the time measured is spent in our encode, packet id, ack matching and dispatch code
+ * (plus the copies into and out of the rings).
+ *
+ *   loopbackBench [messages] [payloadBytes]
+ *
+ * Publishing is measured with the blocking publish() calls, QoS 1/2 include handling their acks.
+ * Inbound messages are queued by the peer in batches, only the client's poll() draining them is timed.
+ */
+using namespace pubsupp;
+using Clock = std::chrono::steady_clock;
+
+
+
+namespace {
+	constexpr size_t INBOUND_BATCH = 1024;
+
+
+	void report(const char* name, size_t messages, Clock::duration elapsed) {
+		double seconds = std::chrono::duration<double>(elapsed).count();
+		std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+				  << seconds * 1e9 / static_cast<double>(messages) << " ns/msg" << std::setw(10) << static_cast<double>(messages) / seconds / 1e6
+				  << " M msgs/s" << std::endl;
+	}
+
+
+	void publishing(BasicMqttClient<LoopbackTransport>& client, const char* name, QoS qos, size_t messages, const std::string& payload) {
+		const std::string topic = "bench/loopback/out";
+		for (size_t i = 0; i < messages / 10; ++i) { // warm up
+			client.publish(topic, qos, payload);
+		}
+
+		auto start = Clock::now();
+		for (size_t i = 0; i < messages; ++i) {
+			client.publish(topic, qos, payload);
+		}
+		report(name, messages, Clock::now() - start);
+	}
+
+
+	void receiving(BasicMqttClient<LoopbackTransport>& client, LoopbackPeer& peer, const char* name, QoS qos, size_t messages,
+				   const std::string& payload, const uint64_t& received) {
+		std::vector<uint8_t> frame;
+		Clock::duration elapsed{0};
+
+		for (size_t sent = 0; sent < messages; sent += INBOUND_BATCH) {
+			size_t batch = std::min(INBOUND_BATCH, messages - sent);
+			for (size_t i = 0; i < batch; ++i) {
+				PublishMessage::encode(frame, "bench/loopback/in", qos, payload, qos == QoS::AT_MOST_ONCE ? 0 : static_cast<uint16_t>(1 + i));
+				peer.send(frame);
+			}
+
+			uint64_t expected = received + batch;
+			auto start = Clock::now();
+			while (received < expected) {
+				client.poll(0);
+			}
+			elapsed += Clock::now() - start;
+		}
+		report(name, messages, elapsed);
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	size_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+	size_t payloadBytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+	if (messages == 0) {
+		std::cerr << "usage: loopbackBench [messages] [payloadBytes]" << std::endl;
+		return 1;
+	}
+
+	auto peer = std::make_shared<LoopbackPeer>();
+	std::string host = "loopback";
+	std::string clientId = "pubsupp-loopback-bench";
+	BasicMqttClient<LoopbackTransport> client(host, 0, clientId, std::in_place, peer);
+	client.connect();
+
+	uint64_t received = 0;
+	client.subscribe("bench/loopback/in", QoS::EXACTLY_ONCE, [&received](const PublishMessage&) { ++received; });
+
+	const std::string payload(payloadBytes, 'x');
+	std::cout << messages << " messages, " << payloadBytes << " byte payload" << std::endl;
+	publishing(client, "publish QoS 0", QoS::AT_MOST_ONCE, messages, payload);
+	publishing(client, "publish QoS 1 + PUBACK", QoS::AT_LEAST_ONCE, messages, payload);
+	publishing(client, "publish QoS 2 + PUBCOMP", QoS::EXACTLY_ONCE, messages, payload);
+	receiving(client, *peer, "receive QoS 0", QoS::AT_MOST_ONCE, messages, payload, received);
+	receiving(client, *peer, "receive QoS 1 + PUBACK", QoS::AT_LEAST_ONCE, messages, payload, received);
+
+	client.disconnect();
+	std::cout << "peer received " << peer->framesReceived() << " frames, " << peer->publishesReceived() << " publishes" << std::endl;
+	return 0;
+}
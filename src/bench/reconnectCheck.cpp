@@ -0,0 +1,99 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+#include "logger.hpp"
+#include "mockBroker.hpp"
+#include "mqttClient.hpp"
+
+
+
+/*
+ * Checks that a client with an offline buffer rides out a broker outage:
+ *
+ *   reconnectCheck
+ *
+ * The in-process mock broker is killed between publishes, so the client writes into a reset connection,
+ * which must fail the send instead of raising SIGPIPE (the process would die with exit code 141).
+ * A message enqueued during the outage has to be buffered, and once a broker listens on the same port
+ * again the client has to reconnect on its own and deliver it to a subscriber of the new broker.
+ * The exit code is 1 if the message does not arrive within 10 seconds.
+ */
+using namespace pubsupp;
+
+
+
+namespace {
+	constexpr auto DEADLINE = std::chrono::seconds(10);
+
+
+	std::unique_ptr<MockBroker> startBroker(uint16_t port) {
+		MockBrokerConfig config;
+		config.port = port;
+		auto broker = std::make_unique<MockBroker>(config);
+		broker->start();
+		return broker;
+	}
+} // namespace
+
+
+
+int main() {
+	Logger::global().setLevel(LogLevel::ERROR); // the outage is expected, its warnings are noise here
+
+	auto broker = startBroker(0);
+	const uint16_t port = broker->port();
+
+	std::string host = "127.0.0.1";
+	std::string publisherId = "pubsupp-reconnect-check-publisher";
+	MqttClient publisher(host, port, publisherId);
+	publisher.enableOfflineBuffer(64 * 1024 * 1024);
+	publisher.connect();
+
+	// the broker dies between two publishes: the first write after its FIN draws a reset, the next one
+	// hits the reset connection and must fail with EPIPE instead of raising SIGPIPE
+	const std::string payload(256, 'x');
+	publisher.publish("pubsupp/reconnect/before", QoS::AT_MOST_ONCE, payload);
+	broker.reset();
+	size_t failedSends = 0;
+	for (int i = 0; i < 3; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		try {
+			publisher.publish("pubsupp/reconnect/during", QoS::AT_MOST_ONCE, payload);
+		} catch (const std::exception&) {
+			++failedSends;
+		}
+	}
+
+	// the I/O loop notices the loss, a message enqueued now can only arrive through the offline buffer
+	publisher.start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	publisher.enqueuePublish("pubsupp/reconnect/marker", QoS::AT_LEAST_ONCE, "sent during the outage");
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	broker = startBroker(port);
+	std::string subscriberId = "pubsupp-reconnect-check-subscriber";
+	MqttClient subscriber(host, port, subscriberId);
+	subscriber.connect();
+	bool delivered = false;
+	subscriber.subscribe("pubsupp/reconnect/marker", QoS::AT_LEAST_ONCE, [&delivered](const PublishMessage&) { delivered = true; });
+
+	auto deadline = std::chrono::steady_clock::now() + DEADLINE;
+	while (!delivered && std::chrono::steady_clock::now() < deadline) {
+		subscriber.poll(100);
+	}
+
+	uint64_t reconnects = publisher.metrics()[Counter::RECONNECTS];
+	publisher.stop();
+	subscriber.disconnect();
+	broker->stop();
+
+	std::cout << "failed sends: " << failedSends << " after the broker died" << std::endl;
+	std::cout << "reconnects:   " << reconnects << std::endl;
+	std::cout << "buffered message " << (delivered ? "delivered" : "lost") << " after the outage" << std::endl;
+	return delivered && reconnects > 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+
+#include "latencyHistogram.hpp"
+#include "logger.hpp"
+#include "mockBroker.hpp"
+#include "mqttClient.hpp"
+
+
+
+/*
+ * Round trip latency to a broker on the same host, over TCP loopback and over a Unix domain socket:
+ *
+ *   socketLatencyBench [roundTrips] [payloadBytes] [socketPath]
+ *
+ * Runs the mock broker in-process (on a thread of its own, no added latency) twice, on 127.0.0.1 and
+ * on unix://<socketPath>, and times with the same client code on both
+ *   - connect: TCP/UDS connect until the CONNACK arrived
+ *   - QoS 1 publish until its PUBACK
+ *   - QoS 0 publish until the broker delivered it back to the subscribed client
+ */
+using namespace pubsupp;
+
+
+
+namespace {
+	void report(const char* transport, const char* name, const LatencyHistogram& histogram) {
+		std::cout << std::left << std::setw(6) << transport << std::setw(24) << name << std::right << std::fixed << std::setprecision(1) << "p50 "
+				  << std::setw(7) << histogram.percentile(50) / 1000.0 << "  p99 " << std::setw(7) << histogram.percentile(99) / 1000.0 << "  mean "
+				  << std::setw(7) << histogram.mean() / 1000.0 << " us" << std::endl;
+	}
+
+
+	LatencyHistogram timed(size_t roundTrips, const std::function<void()>& roundTrip) {
+		for (size_t i = 0; i < roundTrips / 10; ++i) { // warm up
+			roundTrip();
+		}
+
+		LatencyHistogram histogram;
+		for (size_t i = 0; i < roundTrips; ++i) {
+			uint64_t start = monotonicNs();
+			roundTrip();
+			histogram.record(monotonicNs() - start);
+		}
+		return histogram;
+	}
+
+
+	void measure(const char* transport, const std::string& bindAddress, size_t roundTrips, const std::string& payload) {
+		MockBrokerConfig brokerConfig;
+		brokerConfig.bindAddress = bindAddress;
+		brokerConfig.port = 0;
+		MockBroker broker(brokerConfig);
+		broker.start();
+
+		std::string host = bindAddress;
+		std::string clientId = std::string("pubsupp-latency-") + transport;
+		MqttClient client(host, broker.port(), clientId);
+
+		// reconnects are rarer than messages, a tenth of the round trips is plenty
+		report(transport, "connect + CONNACK", timed(roundTrips / 10, [&]() {
+				   client.connect();
+				   client.disconnect();
+			   }));
+
+		client.connect();
+		report(transport, "publish QoS 1 + PUBACK", timed(roundTrips, [&]() { client.publish("bench/latency/ack", QoS::AT_LEAST_ONCE, payload); }));
+
+		uint64_t received = 0;
+		client.subscribe("bench/latency/echo", QoS::AT_MOST_ONCE, [&received](const PublishMessage&) { ++received; });
+		report(transport, "publish -> delivered", timed(roundTrips, [&]() {
+				   uint64_t expected = received + 1;
+				   client.publish("bench/latency/echo", QoS::AT_MOST_ONCE, payload);
+				   while (received < expected) {
+					   client.poll(-1);
+				   }
+			   }));
+
+		client.disconnect();
+		broker.stop();
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	Logger::global().setLevel(LogLevel::WARN); // every reconnect would log at INFO
+
+	size_t roundTrips = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+	size_t payloadBytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+	std::string socketPath = argc > 3 ? argv[3] : "/tmp/pubsupp-latency-" + std::to_string(::getpid()) + ".sock";
+	if (roundTrips < 10) {
+		std::cerr << "usage: socketLatencyBench [roundTrips] [payloadBytes] [socketPath]" << std::endl;
+		return 1;
+	}
+
+	const std::string payload(payloadBytes, 'x');
+	std::cout << roundTrips << " round trips, " << payloadBytes << " byte payload" << std::endl;
+	measure("tcp", "127.0.0.1", roundTrips, payload);
+	measure("uds", "unix://" + socketPath, roundTrips, payload);
+	return 0;
+}
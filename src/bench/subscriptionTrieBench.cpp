@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#include "filterSetMatcher.hpp"
+#include "subscriptionTrie.hpp"
+#include "topic.hpp"
+
+
+
+/*
+ * Subscription trie and compiled FilterSetMatcher vs. a linear scan over all filters
+ * (Topic::passesFilter and precompiled TopicFilters).
+ *
+ *   subscriptionTrieBench [filters] [topics] [readerThreads]
+ *
+ * Filters look like "site/<s>/device/<d>/<metric>", some with '+' or '#' levels,
+ * topics are drawn from the same space, so each one matches a handful of filters.
+ */
+using namespace pubsupp;
+using Clock = std::chrono::steady_clock;
+
+
+
+namespace {
+	const char* METRICS[] = {"temperature", "humidity", "pressure", "battery"};
+
+
+	std::vector<std::string> makeFilters(size_t count, std::mt19937& rng) {
+		std::vector<std::string> filters;
+		filters.reserve(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			std::string site = std::to_string(rng() % 50);
+			std::string device = std::to_string(i);
+			std::string metric = METRICS[rng() % 4];
+
+			switch (rng() % 10) {
+				case 0: filters.push_back("site/" + site + "/device/+/" + metric); break;
+				case 1: filters.push_back("site/" + site + "/device/" + device + "/#"); break;
+				case 2: filters.push_back("site/+/device/" + device + "/+"); break;
+				default: filters.push_back("site/" + site + "/device/" + device + "/" + metric); break;
+			}
+		}
+		return filters;
+	}
+
+
+	std::vector<std::string> makeTopics(size_t count, size_t devices, std::mt19937& rng) {
+		std::vector<std::string> topics;
+		topics.reserve(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			topics.push_back("site/" + std::to_string(rng() % 50) + "/device/" + std::to_string(rng() % devices) + "/" + METRICS[rng() % 4]);
+		}
+		return topics;
+	}
+
+
+	double nsPerTopic(Clock::duration elapsed, size_t topics) {
+		return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(topics);
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	size_t filterCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+	size_t topicCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+	unsigned readerThreads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4;
+
+	std::mt19937 rng(42);
+	std::vector<std::string> filters = makeFilters(filterCount, rng);
+	std::vector<std::string> topics = makeTopics(topicCount, filterCount, rng);
+
+	SubscriptionTrie trie;
+	for (const auto& filter : filters) {
+		trie.add(filter, nullptr);
+	}
+
+
+	// linear scan
+	size_t linearMatches = 0;
+	auto start = Clock::now();
+	for (const auto& topic : topics) {
+		for (const auto& filter : filters) {
+			if (Topic(topic).passesFilter(filter)) {
+				++linearMatches;
+			}
+		}
+	}
+	double linearNs = nsPerTopic(Clock::now() - start, topics.size());
+
+	std::vector<TopicFilter> compiled(filters.begin(), filters.end());
+	size_t compiledMatches = 0;
+	start = Clock::now();
+	for (const auto& topic : topics) {
+		for (const auto& filter : compiled) {
+			if (filter.matches(topic)) {
+				++compiledMatches;
+			}
+		}
+	}
+	double compiledNs = nsPerTopic(Clock::now() - start, topics.size());
+
+
+	// trie, repeated so the timing is not dominated by the clock
+	constexpr int ROUNDS = 100;
+	size_t trieMatches = 0;
+	start = Clock::now();
+	for (int round = 0; round < ROUNDS; ++round) {
+		for (const auto& topic : topics) {
+			trie.forEachMatch(topic, [&](const Subscription&) { ++trieMatches; });
+		}
+	}
+	double trieNs = nsPerTopic(Clock::now() - start, topics.size() * ROUNDS);
+	trieMatches /= ROUNDS;
+
+
+	FilterSetMatcher matcher(filters);
+	FilterSetMatcher::Result result;
+	size_t matcherMatches = 0;
+	start = Clock::now();
+	for (int round = 0; round < ROUNDS; ++round) {
+		for (const auto& topic : topics) {
+			matcher.match(topic, result);
+			matcherMatches += result.count();
+		}
+	}
+	double matcherNs = nsPerTopic(Clock::now() - start, topics.size() * ROUNDS);
+	matcherMatches /= ROUNDS;
+
+
+	// concurrent readers while a writer keeps adding and removing filters
+	std::atomic<bool> stop = false;
+	std::atomic<size_t> lookups = 0;
+	std::vector<std::thread> readers;
+	for (unsigned t = 0; t < readerThreads; ++t) {
+		readers.emplace_back([&, t]() {
+			size_t local = 0;
+			size_t i = t;
+			while (!stop.load(std::memory_order_relaxed)) {
+				trie.forEachMatch(topics[i++ % topics.size()], [](const Subscription&) {});
+				++local;
+			}
+			lookups += local;
+		});
+	}
+
+	size_t writes = 0;
+	auto concurrentStart = Clock::now();
+	while (Clock::now() - concurrentStart < std::chrono::milliseconds(500)) {
+		SubscriptionId id = trie.add("site/x/device/" + std::to_string(writes) + "/#", nullptr);
+		trie.remove(id);
+		writes += 2;
+	}
+	stop = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - concurrentStart).count();
+
+
+	std::cout << "filters: " << filterCount << ", topics: " << topicCount << std::endl;
+	std::cout << "linear scan: " << linearNs << " ns/topic, " << linearMatches << " matches" << std::endl;
+	std::cout << "TopicFilter: " << compiledNs << " ns/topic, " << compiledMatches << " matches" << std::endl;
+	std::cout << "trie:        " << trieNs << " ns/topic, " << trieMatches << " matches" << std::endl;
+	std::cout << "matcher:     " << matcherNs << " ns/topic, " << matcherMatches << " matches" << std::endl;
+	std::cout << "speedup:     " << linearNs / trieNs << "x" << std::endl;
+	std::cout << "concurrent:  " << readerThreads << " readers, " << static_cast<double>(lookups) / seconds / 1e6 << " M lookups/s with "
+			  << static_cast<double>(writes) / seconds << " writes/s" << std::endl;
+
+	if (linearMatches != trieMatches || compiledMatches != trieMatches || matcherMatches != trieMatches) {
+		std::cerr << "match count mismatch" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+
+namespace pubsupp::bench {
+
+	/*
+	 * Synthetic topic tree shaped like our device fleet:
+	 *
+	 *   <tenant>/<region>/site/<site>/<building>/floor/<floor>/device/<device id>/<sensor>/<metric>
+	 *
+	 * cut off at a random depth (3 to 11 levels), with 16 hex digit device ids drawn from a large
+	 * population, a hot subset of devices receiving most of the traffic, and some '$SYS' topics mixed in.
+	 * Filters mix exact topics, '+' at various levels and '#' subtrees.
+	 */
+	struct TopicCorpus {
+		std::vector<std::string> filters;
+		std::vector<std::string> topics;
+	};
+
+
+	class TopicCorpusGenerator {
+	  public:
+		explicit TopicCorpusGenerator(uint32_t seed = 42, size_t devices = 100000) : rng(seed), devices(devices) {}
+
+		TopicCorpus generate(size_t filterCount, size_t topicCount) {
+			TopicCorpus corpus;
+			corpus.filters.reserve(filterCount);
+			corpus.topics.reserve(topicCount);
+
+			for (size_t i = 0; i < filterCount; ++i) {
+				corpus.filters.push_back(this->filter());
+			}
+			for (size_t i = 0; i < topicCount; ++i) {
+				corpus.topics.push_back(this->topic());
+			}
+			return corpus;
+		}
+
+	  private:
+		static constexpr const char* SENSORS[] = {"env", "power", "door", "hvac", "light"};
+		static constexpr const char* METRICS[] = {"temperature", "humidity", "co2", "voltage", "current", "state", "setpoint", "lux"};
+
+		size_t pick(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(this->rng); }
+
+		// 80 % of the messages come from 1 % of the devices
+		size_t device() {
+			size_t hot = std::max<size_t>(1, this->devices / 100);
+			return this->pick(5) < 4 ? this->pick(hot) : this->pick(this->devices);
+		}
+
+		std::vector<std::string> levels(size_t deviceIndex) {
+			char id[17];
+			std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(deviceIndex * 0x9E3779B97F4A7C15ull));
+
+			// tenant, region, site, building and floor are derived from the device, like a real fleet
+			return {"tenant" + std::to_string(deviceIndex % 8),
+					"region" + std::to_string(deviceIndex % 5),
+					"site",
+					"s" + std::to_string(deviceIndex % 300),
+					"b" + std::to_string(deviceIndex % 4),
+					"floor",
+					std::to_string(deviceIndex % 12),
+					"device",
+					id,
+					SENSORS[deviceIndex % 5],
+					METRICS[this->pick(8)]};
+		}
+
+		static std::string join(const std::vector<std::string>& levels, size_t depth) {
+			std::string s;
+			for (size_t i = 0; i < depth; ++i) {
+				if (i > 0) s += '/';
+				s += levels[i];
+			}
+			return s;
+		}
+
+		std::string topic() {
+			if (this->pick(200) == 0) {
+				return "$SYS/broker/clients/" + std::to_string(this->pick(1000));
+			}
+			std::vector<std::string> l = this->levels(this->device());
+			size_t depth = this->pick(10) < 7 ? l.size() : 3 + this->pick(l.size() - 3); // most topics are full length
+			return join(l, depth);
+		}
+
+		std::string filter() {
+			std::vector<std::string> l = this->levels(this->device());
+
+			size_t kind = this->pick(100);
+			if (kind < 15) { // whole device
+				return join(l, 9) + "/#";
+			}
+			if (kind < 25) { // one metric on every device of a site
+				l[4] = "+";
+				l[6] = "+";
+				l[8] = "+";
+				return join(l, 11);
+			}
+			if (kind < 27) { // a sensor type per tenant
+				l[1] = "+";
+				l[3] = "+";
+				l[4] = "+";
+				l[6] = "+";
+				l[8] = "+";
+				return join(l, 10) + "/#";
+			}
+			if (kind < 28) { // tenant wide
+				return join(l, this->pick(3) + 1) + "/#";
+			}
+			if (kind < 33) { // leading wildcard
+				l[0] = "+";
+			}
+			return join(l, 11);
+		}
+
+		std::mt19937_64 rng;
+		size_t devices;
+	};
+
+} // namespace pubsupp::bench
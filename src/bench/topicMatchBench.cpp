@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+
+#include "allocationTracker.hpp"
+#include "filterSetMatcher.hpp"
+#include "subscriptionTrie.hpp"
+#include "topic.hpp"
+#include "topicCorpus.hpp"
+
+
+
+/*
+ * Replays a generated topic corpus (see topicCorpus.hpp) through every topic matcher:
+ *
+ *   topicMatchBench [topics] [filters] [linearTopics]
+ *
+ * A "match" is one topic tested against the whole filter set. For each matcher this reports
+ * throughput, p50/p99 latency per match and heap allocations per match. The linear scans only
+ * replay the first `linearTopics` topics, they are orders of magnitude slower.
+ * All matchers must agree on the number of matches, otherwise the exit code is 1.
+ */
+using namespace pubsupp;
+using Clock = std::chrono::steady_clock;
+
+
+
+#ifdef PUBSUPP_TRACK_ALLOCATIONS
+// the library already replaces operator new
+namespace {
+	uint64_t allocations() { return allocationCount(); }
+} // namespace
+#else
+namespace {
+	std::atomic<uint64_t> allocationCounter = 0;
+
+	uint64_t allocations() { return allocationCounter.load(); }
+} // namespace
+
+
+void* operator new(size_t size) {
+	allocationCounter.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#endif
+
+
+
+namespace {
+	struct Report {
+		std::string name;
+		size_t topics = 0;
+		size_t matches = 0;
+		double seconds = 0;
+		uint64_t p50 = 0;
+		uint64_t p99 = 0;
+		double allocationsPerMatch = 0;
+	};
+
+
+	// fn(topic) returns the number of filters matching the topic
+	Report run(const std::string& name, const std::vector<std::string>& topics, size_t count, const std::function<size_t(const std::string&)>& fn) {
+		Report report;
+		report.name = name;
+		report.topics = std::min(count, topics.size());
+
+		std::vector<uint32_t> latencies(report.topics);
+		for (size_t i = 0; i < std::min<size_t>(report.topics, 1000); ++i) { // warm up caches and scratch buffers
+			fn(topics[i]);
+		}
+
+		uint64_t allocationsBefore = allocations();
+		auto start = Clock::now();
+		for (size_t i = 0; i < report.topics; ++i) {
+			auto begin = Clock::now();
+			report.matches += fn(topics[i]);
+			latencies[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+		}
+		report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		report.allocationsPerMatch = static_cast<double>(allocations() - allocationsBefore) / static_cast<double>(report.topics);
+
+		std::sort(latencies.begin(), latencies.end());
+		report.p50 = latencies[latencies.size() / 2];
+		report.p99 = latencies[latencies.size() * 99 / 100];
+		return report;
+	}
+
+
+	void print(const Report& report) {
+		std::cout << std::left << std::setw(22) << report.name << std::right
+				  << std::setw(10) << report.topics
+				  << std::setw(14) << std::fixed << std::setprecision(0) << report.topics / report.seconds
+				  << std::setw(10) << report.p50
+				  << std::setw(12) << report.p99
+				  << std::setw(12) << std::setprecision(2) << report.allocationsPerMatch
+				  << std::setw(12) << report.matches << std::endl;
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	size_t topicCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	size_t filterCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000;
+	size_t linearTopics = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 2000;
+
+	bench::TopicCorpus corpus = bench::TopicCorpusGenerator().generate(filterCount, topicCount);
+	const auto& filters = corpus.filters;
+	const auto& topics = corpus.topics;
+
+	std::vector<TopicFilter> compiled(filters.begin(), filters.end());
+	SubscriptionTrie trie;
+	for (const auto& filter : filters) {
+		trie.add(filter, nullptr);
+	}
+	FilterSetMatcher matcher(filters);
+	FilterSetMatcher::Result result;
+
+	std::vector<Report> reports;
+	reports.push_back(run("Topic::passesFilter", topics, linearTopics, [&](const std::string& topic) {
+		Topic t(topic);
+		size_t n = 0;
+		for (const auto& filter : filters) {
+			n += t.passesFilter(filter);
+		}
+		return n;
+	}));
+	reports.push_back(run("TopicFilter (linear)", topics, linearTopics, [&](const std::string& topic) {
+		size_t n = 0;
+		for (const auto& filter : compiled) {
+			n += filter.matches(topic);
+		}
+		return n;
+	}));
+	reports.push_back(run("SubscriptionTrie", topics, topics.size(), [&](const std::string& topic) {
+		size_t n = 0;
+		trie.forEachMatch(topic, [&](const Subscription&) { ++n; });
+		return n;
+	}));
+	reports.push_back(run("FilterSetMatcher", topics, topics.size(), [&](const std::string& topic) {
+		matcher.match(topic, result);
+		return result.count();
+	}));
+	reports.push_back(run("SubscriptionTrie (lin)", topics, linearTopics, [&](const std::string& topic) {
+		size_t n = 0;
+		trie.forEachMatch(topic, [&](const Subscription&) { ++n; });
+		return n;
+	}));
+
+	std::cout << "filters: " << filters.size() << ", topics: " << topics.size() << std::endl;
+	std::cout << std::left << std::setw(22) << "matcher" << std::right << std::setw(10) << "topics" << std::setw(14) << "matches/s"
+			  << std::setw(10) << "p50 ns" << std::setw(12) << "p99 ns" << std::setw(12) << "allocs" << std::setw(12) << "matched" << std::endl;
+	for (const auto& report : reports) {
+		print(report);
+	}
+
+	// same topics, same answers
+	bool agree = reports[0].matches == reports[1].matches && reports[1].matches == reports[4].matches
+				 && reports[2].matches == reports[3].matches;
+	if (!agree) {
+		std::cerr << "matchers disagree" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include "captureReplayer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+
+#include "messages/mqttMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		using Clock = std::chrono::steady_clock;
+
+		// false once the peer is gone
+		bool sendAll(int fd, const uint8_t* data, size_t length) {
+			size_t sent = 0;
+			while (sent < length) {
+				ssize_t n = ::send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n <= 0) {
+					return false;
+				}
+				sent += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+
+		bool receiveExactly(int fd, uint8_t* buffer, size_t length) {
+			size_t received = 0;
+			while (received < length) {
+				ssize_t n = ::recv(fd, buffer + received, length - received, 0);
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n <= 0) {
+					return false;
+				}
+				received += static_cast<size_t>(n);
+			}
+			return true;
+		}
+
+
+		// the client's first frame, which has to be its CONNECT
+		bool receiveConnect(int fd) {
+			uint8_t header;
+			if (!receiveExactly(fd, &header, 1) || static_cast<MessageType>(header >> 4) != MessageType::CONNECT) {
+				return false;
+			}
+
+			uint32_t remainingLength = 0;
+			uint32_t multiplier = 1;
+			uint8_t byte;
+			do {
+				if (!receiveExactly(fd, &byte, 1) || multiplier > 128 * 128 * 128) {
+					return false;
+				}
+				remainingLength += (byte & 127) * multiplier;
+				multiplier *= 128;
+			} while ((byte & 128) != 0);
+
+			std::vector<uint8_t> rest(remainingLength);
+			return receiveExactly(fd, rest.data(), rest.size());
+		}
+	} // namespace
+
+
+
+	CaptureReplayer::CaptureReplayer(const std::string& capturePath, ReplayConfig config) : config(std::move(config)) {
+		CaptureReader reader(capturePath);
+		CaptureRecord record;
+		while (reader.next(record)) {
+			if (record.direction != CaptureDirection::INBOUND || record.frame.empty()) {
+				continue;
+			}
+			auto type = static_cast<MessageType>(record.frame[0] >> 4);
+			if (type == MessageType::PUBLISH || type == MessageType::PUBREL) {
+				this->publishes += type == MessageType::PUBLISH;
+				this->frames.push_back(std::move(record));
+			}
+		}
+
+		this->listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (this->listenFd < 0) {
+			throw std::runtime_error("Failed to create replay socket");
+		}
+		int reuse = 1;
+		::setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(this->config.port);
+		if (::inet_pton(AF_INET, this->config.bindAddress.c_str(), &address.sin_addr) != 1 ||
+			::bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(this->listenFd, 1) < 0) {
+			::close(this->listenFd);
+			throw std::runtime_error("Failed to listen on " + this->config.bindAddress + ":" + std::to_string(this->config.port));
+		}
+
+		socklen_t length = sizeof(address);
+		::getsockname(this->listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+		this->boundPort = ntohs(address.sin_port);
+	}
+
+
+	CaptureReplayer::~CaptureReplayer() { ::close(this->listenFd); }
+
+
+	ReplayStats CaptureReplayer::serveOne() {
+		int fd = ::accept(this->listenFd, nullptr, nullptr);
+		if (fd < 0) {
+			throw std::runtime_error("Failed to accept replay client: " + std::string(std::strerror(errno)));
+		}
+		int noDelay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		ReplayStats stats;
+		if (!receiveConnect(fd)) {
+			::close(fd);
+			throw std::runtime_error("Replay client did not start with CONNECT");
+		}
+		std::vector<uint8_t> connack = createConnackMessage(false, 0)->encode();
+		sendAll(fd, connack.data(), connack.size());
+
+		// acks and whatever else the client sends, read so it never blocks on a full socket
+		std::thread drain([fd]() {
+			uint8_t buffer[16 * 1024];
+			while (true) {
+				ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+				if (n == 0 || (n < 0 && errno != EINTR)) {
+					return;
+				}
+			}
+		});
+
+		// as fast as possible: coalesce frames into large writes, the client is the one being measured
+		std::vector<uint8_t> batch;
+		bool open = true;
+		auto start = Clock::now();
+
+		for (size_t i = 0; open && i < this->frames.size(); ++i) {
+			const CaptureRecord& record = this->frames[i];
+
+			if (this->config.speed > 0) {
+				auto offset = std::chrono::nanoseconds(static_cast<int64_t>((record.timeNs - this->frames.front().timeNs) / this->config.speed));
+				std::this_thread::sleep_until(start + offset);
+				open = sendAll(fd, record.frame.data(), record.frame.size());
+			} else {
+				batch.insert(batch.end(), record.frame.begin(), record.frame.end());
+				if (batch.size() >= 64 * 1024 || i + 1 == this->frames.size()) {
+					open = sendAll(fd, batch.data(), batch.size());
+					batch.clear();
+				}
+			}
+
+			stats.frames++;
+			stats.publishes += static_cast<MessageType>(record.frame[0] >> 4) == MessageType::PUBLISH;
+			stats.bytes += record.frame.size();
+		}
+		stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		// the client decides when it has seen enough
+		drain.join();
+		::close(fd);
+		return stats;
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+#include "wireCapture.hpp"
+
+
+
+namespace pubsupp {
+
+	struct ReplayConfig {
+		std::string bindAddress = "127.0.0.1";
+		uint16_t port = 0; // 0 picks a free port, see CaptureReplayer::port()
+		double speed = 0; // 0 = as fast as possible, 1 = original timing, 2 = twice as fast, ...
+	};
+
+
+	struct ReplayStats {
+		uint64_t frames = 0;
+		uint64_t publishes = 0;
+		uint64_t bytes = 0;
+		double seconds = 0; // first to last frame sent
+	};
+
+
+
+	/*
+	 * Plays the inbound side of a capture back to a client, standing in for the broker.
+	 *
+	 * A connecting client gets a CONNACK for its CONNECT, then every captured inbound PUBLISH and PUBREL
+	 * in order, either at the captured pace (scaled by `speed`) or as fast as the socket takes them.
+	 * Other inbound frames (CONNACK, SUBACK, acks for the original client's publishes) answered requests
+	 * the replaying client does not make, so they are left out. Whatever the client sends is read and dropped.
+	 *
+	 * The client thus runs its real read, decode and dispatch path on production traffic,
+	 * which makes this the tool for reproducing traffic shapes and benchmarking the inbound side offline.
+	 * The frames are loaded up front, so reading the capture does not slow down the replay.
+	 */
+	class CaptureReplayer {
+	  public:
+		CaptureReplayer(const std::string& capturePath, ReplayConfig config = {}); // listens right away
+		~CaptureReplayer();
+
+		CaptureReplayer(const CaptureReplayer&) = delete;
+		CaptureReplayer& operator=(const CaptureReplayer&) = delete;
+
+		uint16_t port() const { return this->boundPort; }
+		uint64_t publishCount() const { return this->publishes; }
+
+		// accept one client and replay the capture to it, returns once the client disconnected
+		ReplayStats serveOne();
+
+	  private:
+		ReplayConfig config;
+		std::vector<CaptureRecord> frames;
+		uint64_t publishes = 0;
+		int listenFd = -1;
+		uint16_t boundPort = 0;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,199 @@
+#include "connectionStorm.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+
+
+#include "logger.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		enum class Stage {
+			TCP, // waiting for the socket to become writable
+			CONNACK, // CONNECT sent
+		};
+
+
+		struct InFlight {
+			size_t index;
+			Stage stage;
+			uint64_t startNs;
+		};
+
+
+#ifdef _WIN32
+		using PollFd = WSAPOLLFD;
+		int pollSockets(PollFd* fds, size_t count, int timeoutMs) {
+			if (count == 0) { // WSAPoll rejects an empty set
+				std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+				return 0;
+			}
+			return ::WSAPoll(fds, static_cast<ULONG>(count), timeoutMs);
+		}
+#else
+		using PollFd = struct pollfd;
+		int pollSockets(PollFd* fds, size_t count, int timeoutMs) { return ::poll(fds, count, timeoutMs); }
+#endif
+	} // namespace
+
+
+
+	ConnectionStorm::ConnectionStorm(ConnectionStormConfig config) : config(config) {
+		if (this->config.concurrency == 0) {
+			throw std::runtime_error("Connection storm needs a concurrency of at least 1");
+		}
+		if (this->config.rate <= 0) {
+			throw std::runtime_error("Connect rate must be positive");
+		}
+		this->config.burst = std::max<size_t>(this->config.burst, 1);
+	}
+
+
+	ConnectionStormReport ConnectionStorm::connect(const std::vector<MqttClient*>& clients) {
+		ConnectionStormReport report;
+		report.sessions.resize(clients.size());
+
+		const uint64_t timeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(this->config.timeout).count();
+		const double burst = static_cast<double>(this->config.burst);
+		std::vector<InFlight> inFlight;
+		std::vector<PollFd> fds;
+		size_t next = 0;
+		double tokens = burst;
+		uint64_t startNs = monotonicNs();
+		uint64_t refilledNs = startNs;
+
+		auto fail = [&](const InFlight& session, const std::exception& e) {
+			report.sessions[session.index].error = e.what();
+			report.failed++;
+			PUBSUPP_LOG_DEBUG("Session " << session.index << " failed to connect: " << e.what());
+			try {
+				clients[session.index]->disconnect();
+			} catch (const std::exception&) {
+				// already gone
+			}
+		};
+
+		auto tcpDone = [&](const InFlight& session) {
+			uint64_t elapsed = monotonicNs() - session.startNs;
+			report.sessions[session.index].tcpNs = elapsed;
+			report.tcp.record(elapsed);
+		};
+
+		while (next < clients.size() || !inFlight.empty()) {
+			uint64_t now = monotonicNs();
+			tokens = std::min(burst, tokens + static_cast<double>(now - refilledNs) * this->config.rate / 1e9);
+			refilledNs = now;
+
+			while (next < clients.size() && inFlight.size() < this->config.concurrency && tokens >= 1) {
+				tokens -= 1;
+				InFlight session{next++, Stage::TCP, monotonicNs()};
+				try {
+					if (clients[session.index]->beginConnect()) {
+						tcpDone(session);
+						session.stage = Stage::CONNACK;
+					}
+					inFlight.push_back(session);
+				} catch (const std::exception& e) {
+					fail(session, e);
+				}
+			}
+
+			// sleep until a socket is ready, the next token is due or the oldest session times out
+			int waitMs = 100;
+			if (next < clients.size() && inFlight.size() < this->config.concurrency) {
+				waitMs = std::min(waitMs, static_cast<int>(std::ceil((1 - tokens) * 1000 / this->config.rate)));
+			}
+			fds.resize(inFlight.size());
+			for (size_t i = 0; i < inFlight.size(); ++i) {
+				uint64_t deadline = inFlight[i].startNs + timeoutNs;
+				waitMs = std::min(waitMs, deadline > now ? static_cast<int>((deadline - now) / 1000000 + 1) : 0);
+
+				fds[i] = {};
+				fds[i].fd = clients[inFlight[i].index]->socketHandle();
+				fds[i].events = inFlight[i].stage == Stage::TCP ? POLLOUT : POLLIN;
+			}
+
+			if (pollSockets(fds.data(), fds.size(), std::max(waitMs, 0)) < 0) {
+#ifndef _WIN32
+				if (errno == EINTR) {
+					continue;
+				}
+#endif
+				throw std::runtime_error("Failed to poll connecting sockets");
+			}
+
+			now = monotonicNs();
+			size_t kept = 0;
+			for (size_t i = 0; i < inFlight.size(); ++i) {
+				InFlight& session = inFlight[i];
+				MqttClient& client = *clients[session.index];
+				bool finished = false;
+
+				try {
+					if (fds[i].revents != 0 && session.stage == Stage::TCP) {
+						client.continueConnect();
+						tcpDone(session);
+						session.stage = Stage::CONNACK;
+
+					} else if (fds[i].revents != 0) {
+						client.poll(0);
+						if (client.connectCompleted()) {
+							uint64_t elapsed = monotonicNs() - session.startNs;
+							report.sessions[session.index].handshakeNs = elapsed;
+							report.handshake.record(elapsed);
+							report.connected++;
+							finished = true;
+						}
+					}
+
+					if (!finished && now - session.startNs >= timeoutNs) {
+						throw std::runtime_error("No CONNACK within " + std::to_string(this->config.timeout.count()) + " ms");
+					}
+				} catch (const std::exception& e) {
+					fail(session, e);
+					finished = true;
+				}
+
+				if (!finished) {
+					inFlight[kept++] = session;
+				}
+			}
+			inFlight.resize(kept);
+		}
+
+		report.seconds = static_cast<double>(monotonicNs() - startNs) / 1e9;
+		return report;
+	}
+
+
+	void ConnectionStorm::printReport(const ConnectionStormReport& report, std::ostream& out) {
+		out << std::fixed << std::setprecision(1);
+		out << "sessions:   " << report.connected << " connected, " << report.failed << " failed in " << report.seconds << " s, "
+			<< static_cast<double>(report.connected) / report.seconds << " sessions/s" << std::endl;
+
+		auto stage = [&out](const char* name, const LatencyHistogram& histogram) {
+			if (histogram.count() == 0) {
+				return;
+			}
+			out << name << "p50 " << histogram.percentile(50) / 1000.0 << ", p99 " << histogram.percentile(99) / 1000.0
+				<< ", p99.9 " << histogram.percentile(99.9) / 1000.0 << ", max " << histogram.max() / 1000.0 << " us" << std::endl;
+		};
+		stage("  socket connect:     ", report.tcp);
+		stage("  connect -> CONNACK: ", report.handshake);
+
+		for (const ConnectionStormReport::Session& session : report.sessions) {
+			if (!session.error.empty()) {
+				out << "  first failure:      " << session.error << std::endl;
+				break;
+			}
+		}
+	}
+
+} // namespace pubsupp
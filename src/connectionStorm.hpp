@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+#include "latencyHistogram.hpp"
+#include "mqttClient.hpp"
+
+
+
+namespace pubsupp {
+
+	struct ConnectionStormConfig {
+		size_t concurrency = 256; // handshakes in flight at once
+		double rate = 1000; // handshakes started per second, on average
+		size_t burst = 64; // handshakes that may start back to back after an idle moment (token bucket size)
+		std::chrono::milliseconds timeout{10000}; // per session, TCP handshake until CONNACK
+	};
+
+
+	struct ConnectionStormReport {
+		// per session, in the order the clients were passed in
+		struct Session {
+			uint64_t tcpNs = 0; // start until the TCP handshake finished
+			uint64_t handshakeNs = 0; // start until the CONNACK, 0 if it failed
+			std::string error; // empty if connected
+		};
+
+		double seconds = 0;
+		size_t connected = 0;
+		size_t failed = 0;
+		std::vector<Session> sessions;
+		LatencyHistogram tcp;
+		LatencyHistogram handshake;
+	};
+
+
+
+	/*
+	 * Brings up many client sessions at once without serializing them or flooding the broker.
+	 *
+	 * All handshakes run non-blocking on the calling thread (see MqttClient::beginConnect), one poll()
+	 * over the sockets of every session in flight. New sessions are started from a token bucket filled at
+	 * `rate` per second, and never more than `concurrency` are in flight, so bring-up time is bounded by
+	 * clients / rate and the broker sees a steady stream of CONNECTs instead of one spike.
+	 *
+	 * Failed or timed out sessions are reported and left disconnected, the others are connected and can be
+	 * used (or start()ed on their own I/O threads) once connect() returns.
+	 */
+	class ConnectionStorm {
+	  public:
+		explicit ConnectionStorm(ConnectionStormConfig config = {});
+
+		// each client connects to its own host and port
+		ConnectionStormReport connect(const std::vector<MqttClient*>& clients);
+		static void printReport(const ConnectionStormReport& report, std::ostream& out);
+
+	  private:
+		ConnectionStormConfig config;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,73 @@
+#include "duplicateFilter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+
+
+namespace pubsupp {
+
+	namespace {
+		// splitmix64 finalizer
+		uint64_t mix(uint64_t x) {
+			x ^= x >> 30;
+			x *= 0xBF58476D1CE4E5B9ull;
+			x ^= x >> 27;
+			x *= 0x94D049BB133111EBull;
+			return x ^ (x >> 31);
+		}
+	} // namespace
+
+
+
+	DuplicateFilter::DuplicateFilter(std::chrono::milliseconds window, size_t capacity, DuplicateKey key)
+		: slots(std::bit_ceil(std::max<size_t>(capacity, PROBES))), window(window), keyMode(key) {}
+
+
+	bool DuplicateFilter::isDuplicate(const PublishMessage& publish, Clock::time_point now) {
+		return this->isDuplicate(publish.getPacketId(), publish.isDup(), publish.getTopic(), publish.getPayload(), now);
+	}
+
+
+	bool DuplicateFilter::isDuplicate(uint16_t packetId, bool dup, std::string_view topic, std::string_view payload, Clock::time_point now) {
+		bool content = this->keyMode == DuplicateKey::CONTENT;
+		uint64_t key = this->makeKey(content ? 0 : packetId, topic, payload);
+		int64_t nowTicks = now.time_since_epoch().count();
+		size_t mask = this->slots.size() - 1;
+
+		// first deliveries are only recorded in packet id mode, a repeated publish reusing the id is new data
+		bool check = content || dup;
+
+		Slot* victim = nullptr;
+		for (size_t i = 0; i < PROBES; ++i) {
+			Slot& slot = this->slots[(key + i) & mask];
+			bool live = slot.expires > nowTicks;
+
+			if (live && slot.key == key) {
+				if (check) {
+					++this->duplicates;
+					return true;
+				}
+				victim = &slot; // refresh
+				break;
+			}
+			// prefer a free or expired slot, otherwise the one expiring first
+			if (!victim || (victim->expires > nowTicks && (!live || slot.expires < victim->expires))) {
+				victim = &slot;
+			}
+		}
+
+		victim->key = key;
+		victim->expires = (now + this->window).time_since_epoch().count();
+		return false;
+	}
+
+
+	uint64_t DuplicateFilter::makeKey(uint16_t packetId, std::string_view topic, std::string_view payload) const {
+		uint64_t h = std::hash<std::string_view>{}(topic);
+		h = mix(h ^ std::hash<std::string_view>{}(payload) * 0x9E3779B97F4A7C15ull);
+		return mix(h ^ packetId);
+	}
+
+} // namespace pubsupp
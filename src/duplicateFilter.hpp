@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+#include "messages/publishMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	enum class DuplicateKey {
+		// packet id + topic + payload, only messages with the DUP flag are checked (QoS1 redelivery, 3.3.1.1)
+		PACKET_ID_AND_CONTENT,
+		// topic + payload, every message is checked: also catches the copies a broker sends for
+		// overlapping subscriptions, but drops a repeated value published within the window as well
+		CONTENT
+	};
+
+
+	/*
+	 * Remembers recently delivered messages for a time window and reports redeliveries.
+	 *
+	 * Messages are reduced to a 64 bit key and stored in a fixed-size open-addressing table along with their
+	 * expiry, so memory stays bounded however many messages arrive. A key is looked for among the
+	 * PROBES slots after its home slot; expired slots are reused, and if all of them are live the one
+	 * expiring first is overwritten. An overloaded table therefore forgets messages early (letting a
+	 * duplicate through) but never reports a message it has not seen, apart from 64 bit hash collisions.
+	 */
+	class DuplicateFilter {
+	  public:
+		using Clock = std::chrono::steady_clock;
+
+		DuplicateFilter(std::chrono::milliseconds window, size_t capacity = 65536, DuplicateKey key = DuplicateKey::PACKET_ID_AND_CONTENT);
+
+		// records the message, true if it was seen within the window
+		bool isDuplicate(const PublishMessage& publish, Clock::time_point now = Clock::now());
+		bool isDuplicate(uint16_t packetId, bool dup, std::string_view topic, std::string_view payload, Clock::time_point now = Clock::now());
+
+		uint64_t dropped() const { return this->duplicates; }
+		size_t capacity() const { return this->slots.size(); }
+
+	  private:
+		static constexpr size_t PROBES = 8;
+
+		struct Slot {
+			uint64_t key = 0;
+			int64_t expires = 0; // Clock ticks, 0 = empty
+		};
+
+		uint64_t makeKey(uint16_t packetId, std::string_view topic, std::string_view payload) const;
+
+		std::vector<Slot> slots; // power of two
+		Clock::duration window;
+		DuplicateKey keyMode;
+		uint64_t duplicates = 0;
+	};
+
+} // namespace pubsupp
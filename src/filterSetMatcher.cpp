@@ -0,0 +1,185 @@
+#include "filterSetMatcher.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+#include "topic.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		std::vector<std::string_view> splitLevels(std::string_view s) {
+			std::vector<std::string_view> levels;
+			size_t start = 0;
+			while (true) {
+				size_t pos = s.find('/', start);
+				if (pos == std::string_view::npos) {
+					levels.push_back(s.substr(start));
+					return levels;
+				}
+				levels.push_back(s.substr(start, pos - start));
+				start = pos + 1;
+			}
+		}
+	} // namespace
+
+
+
+	bool FilterSetMatcher::Result::any() const {
+		return std::any_of(this->bits.begin(), this->bits.end(), [](uint64_t w) { return w != 0; });
+	}
+
+
+	size_t FilterSetMatcher::Result::count() const {
+		size_t n = 0;
+		for (uint64_t w : this->bits) {
+			n += std::popcount(w);
+		}
+		return n;
+	}
+
+
+
+	FilterSetMatcher::FilterSetMatcher(std::vector<std::string> filters) : filters(std::move(filters)) {
+		this->words = (this->filters.size() + 63) / 64;
+
+		std::vector<std::vector<std::string_view>> parsed;
+		parsed.reserve(this->filters.size());
+		size_t maxDepth = 0;
+		for (const auto& filter : this->filters) {
+			if (!TopicFilter::isValid(filter)) {
+				throw std::runtime_error("Invalid topic filter: " + filter);
+			}
+			parsed.push_back(splitLevels(filter));
+			maxDepth = std::max(maxDepth, parsed.back().size());
+		}
+
+		this->levels.resize(maxDepth);
+		for (auto& level : this->levels) {
+			level.any.assign(this->words, 0);
+		}
+		this->exactDepth.assign(maxDepth + 1, Bits(this->words, 0));
+		this->multiLevelUpTo.assign(maxDepth + 1, Bits(this->words, 0));
+		this->rootWildcard.assign(this->words, 0);
+
+		for (size_t index = 0; index < parsed.size(); ++index) {
+			const auto& filterLevels = parsed[index];
+			bool multiLevel = filterLevels.back() == "#";
+			size_t depth = multiLevel ? filterLevels.size() - 1 : filterLevels.size(); // levels before '#'
+
+			if (filterLevels[0] == "+" || filterLevels[0] == "#") {
+				this->set(this->rootWildcard, index);
+			}
+
+			for (size_t i = 0; i < maxDepth; ++i) {
+				if (multiLevel && i >= depth) {
+					this->set(this->levels[i].any, index);
+				} else if (i < depth) {
+					if (filterLevels[i] == "+") {
+						this->set(this->levels[i].any, index);
+					} else {
+						// indices are added in increasing order, so the lists stay sorted
+						this->levels[i].literals[std::string(filterLevels[i])].indices.push_back(static_cast<uint32_t>(index));
+					}
+				}
+			}
+
+			if (multiLevel) {
+				this->set(this->multiLevelUpTo[depth], index);
+			} else {
+				this->set(this->exactDepth[depth], index);
+			}
+		}
+
+		for (auto& level : this->levels) {
+			for (auto& [literal, column] : level.literals) {
+				if (column.indices.size() > this->words) {
+					column.bits.assign(this->words, 0);
+					for (uint32_t index : column.indices) {
+						this->set(column.bits, index);
+					}
+					column.indices = {};
+				}
+			}
+		}
+
+		for (size_t n = 1; n <= maxDepth; ++n) {
+			for (size_t w = 0; w < this->words; ++w) {
+				this->multiLevelUpTo[n][w] |= this->multiLevelUpTo[n - 1][w];
+			}
+		}
+	}
+
+
+	void FilterSetMatcher::match(std::string_view topic, Result& result) const {
+		result.bits.assign(this->words, 0);
+		result.scratch.resize(this->words);
+		if (this->filters.empty()) {
+			return;
+		}
+
+		// candidates: filters whose level count fits the topic
+		size_t depth = std::count(topic.begin(), topic.end(), '/') + 1;
+		size_t maxDepth = this->levels.size();
+		const Bits& multiLevel = this->multiLevelUpTo[std::min(depth, maxDepth)];
+		bool systemTopic = !topic.empty() && topic[0] == '$';
+
+		uint64_t remaining = 0;
+		for (size_t w = 0; w < this->words; ++w) {
+			uint64_t candidates = multiLevel[w];
+			if (depth <= maxDepth) {
+				candidates |= this->exactDepth[depth][w];
+			}
+			if (systemTopic) {
+				candidates &= ~this->rootWildcard[w];
+			}
+			result.bits[w] = candidates;
+			remaining |= candidates;
+		}
+
+		size_t start = 0;
+		for (size_t i = 0; i < std::min(depth, maxDepth) && remaining != 0; ++i) {
+			size_t end = topic.find('/', start);
+			if (end == std::string_view::npos) {
+				end = topic.size();
+			}
+			const Level& level = this->levels[i];
+
+			auto literal = level.literals.find(topic.substr(start, end - start));
+			const Column* column = literal != level.literals.end() ? &literal->second : nullptr;
+
+			remaining = 0;
+			if (column && !column->bits.empty()) {
+				for (size_t w = 0; w < this->words; ++w) {
+					result.scratch[w] = result.bits[w] & (level.any[w] | column->bits[w]);
+				}
+			} else {
+				for (size_t w = 0; w < this->words; ++w) {
+					result.scratch[w] = result.bits[w] & level.any[w];
+				}
+				if (column) {
+					for (uint32_t index : column->indices) {
+						result.scratch[index / 64] |= result.bits[index / 64] & (uint64_t(1) << (index % 64));
+					}
+				}
+			}
+			for (size_t w = 0; w < this->words; ++w) {
+				remaining |= result.scratch[w];
+			}
+			result.bits.swap(result.scratch);
+
+			start = end + 1;
+		}
+	}
+
+
+	FilterSetMatcher::Result FilterSetMatcher::match(std::string_view topic) const {
+		Result result;
+		this->match(topic, result);
+		return result;
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Matches a topic against a large, fixed set of topic filters in a single pass over its levels.
+	 *
+	 * The filters are compiled into one table per level: a bitset of the filters accepting any value
+	 * at that level ('+' or below a '#') and, per literal, the sorted list of filters expecting it.
+	 * Matching starts from the filters whose level count fits the topic and narrows the candidates
+	 * level by level, stopping as soon as none are left. A level costs one hash lookup plus a pass
+	 * over a bitset of filterCount / 64 words, independent of how many literals the filters use.
+	 *
+	 * Literal columns are sparse unless a literal is shared by more filters than the bitset has words
+	 * (a common prefix like "site"): high-cardinality levels (device ids) would otherwise need one
+	 * full bitset per distinct value, while long lists for common literals cost more than the bitset.
+	 *
+	 * The matcher is immutable after construction and can be shared between threads,
+	 * each thread passing its own Result.
+	 */
+	class FilterSetMatcher {
+	  public:
+		// bitset of matching filter indices, reused across calls to avoid allocating
+		class Result {
+		  public:
+			bool test(size_t index) const { return (this->bits[index / 64] >> (index % 64)) & 1; }
+			bool any() const;
+			size_t count() const;
+
+			template <typename Fn>
+			void forEach(Fn&& fn) const {
+				for (size_t word = 0; word < this->bits.size(); ++word) {
+					for (uint64_t w = this->bits[word]; w != 0; w &= w - 1) {
+						fn(word * 64 + std::countr_zero(w));
+					}
+				}
+			}
+
+		  private:
+			friend class FilterSetMatcher;
+			std::vector<uint64_t> bits;
+			std::vector<uint64_t> scratch;
+		};
+
+
+		// throws if any filter is invalid
+		explicit FilterSetMatcher(std::vector<std::string> filters);
+
+		void match(std::string_view topic, Result& result) const;
+		Result match(std::string_view topic) const;
+
+		size_t size() const { return this->filters.size(); }
+		const std::string& filter(size_t index) const { return this->filters[index]; }
+
+	  private:
+		using Bits = std::vector<uint64_t>;
+
+		struct StringHash {
+			using is_transparent = void;
+			size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+		};
+
+		// filters expecting one literal at a level, either as sorted indices or as bitset
+		struct Column {
+			std::vector<uint32_t> indices;
+			Bits bits;
+		};
+
+		struct Level {
+			Bits any; // '+' at this level, or '#' at or above it
+			std::unordered_map<std::string, Column, StringHash, std::equal_to<>> literals;
+		};
+
+		void set(Bits& bits, size_t index) const { bits[index / 64] |= uint64_t(1) << (index % 64); }
+
+		std::vector<std::string> filters;
+		size_t words = 0;
+		std::vector<Level> levels;
+		std::vector<Bits> exactDepth; // filters without '#' by level count
+		std::vector<Bits> multiLevelUpTo; // filters whose '#' is at level n or earlier (match topics with >= n levels)
+		Bits rootWildcard; // filters starting with a wildcard, not matched by '$' topics (4.7.2)
+	};
+
+} // namespace pubsupp
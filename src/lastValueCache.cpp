@@ -0,0 +1,360 @@
+#include "lastValueCache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+
+#include "topic.hpp"
+
+
+
+namespace pubsupp {
+
+	size_t PayloadArena::sizeClass(size_t size) {
+		size_t block = std::bit_ceil(std::max(size, MIN_BLOCK));
+		return std::countr_zero(block) - std::countr_zero(MIN_BLOCK);
+	}
+
+
+	size_t PayloadArena::blockSize(size_t size) {
+		return size > MAX_BLOCK ? size : std::bit_ceil(std::max(size, MIN_BLOCK));
+	}
+
+
+	// first chunk starting above `address`
+	std::vector<PayloadArena::Chunk>::iterator PayloadArena::chunkAfter(uintptr_t address) {
+		return std::upper_bound(this->chunks.begin(), this->chunks.end(), address, [](uintptr_t a, const Chunk& chunk) { return a < chunk.address; });
+	}
+
+
+	std::vector<PayloadArena::Chunk>::iterator PayloadArena::chunkOf(const uint8_t* data) {
+		return this->chunkAfter(reinterpret_cast<uintptr_t>(data)) - 1;
+	}
+
+
+	size_t PayloadArena::reserveNeeded(size_t size) const {
+		size_t capacity = blockSize(size);
+		if (capacity > MAX_BLOCK) {
+			return capacity;
+		}
+		size_t index = sizeClass(size);
+		return this->freeLists[index].empty() && !this->carving[index] ? CHUNK_SIZE : 0;
+	}
+
+
+	PayloadArena::Block PayloadArena::allocate(size_t size) {
+		size_t capacity = blockSize(size);
+		this->inUse += capacity;
+
+		if (capacity > MAX_BLOCK) { // large payload, owns its memory
+			this->reserved += capacity;
+			return {new uint8_t[capacity], static_cast<uint32_t>(capacity)};
+		}
+
+		size_t index = sizeClass(size);
+		auto& freeList = this->freeLists[index];
+		uint8_t* data;
+		std::vector<Chunk>::iterator chunk;
+		if (!freeList.empty()) {
+			data = freeList.back();
+			freeList.pop_back();
+			chunk = this->chunkOf(data);
+		} else {
+			if (!this->carving[index]) {
+				Chunk fresh;
+				fresh.memory.reset(new uint8_t[CHUNK_SIZE]);
+				fresh.address = reinterpret_cast<uintptr_t>(fresh.memory.get());
+				this->carving[index] = fresh.memory.get();
+				this->chunks.insert(this->chunkAfter(fresh.address), std::move(fresh));
+				this->reserved += CHUNK_SIZE;
+			}
+			chunk = this->chunkOf(this->carving[index]);
+			data = chunk->memory.get() + chunk->carved;
+			chunk->carved += capacity;
+			if (chunk->carved == CHUNK_SIZE) {
+				this->carving[index] = nullptr;
+			}
+		}
+		++chunk->live;
+		return {data, static_cast<uint32_t>(capacity)};
+	}
+
+
+	void PayloadArena::release(Block block) {
+		if (!block.data) {
+			return;
+		}
+		this->inUse -= block.capacity;
+
+		if (block.capacity > MAX_BLOCK) {
+			this->reserved -= block.capacity;
+			delete[] block.data;
+			return;
+		}
+
+		size_t index = sizeClass(block.capacity);
+		auto chunk = this->chunkOf(block.data);
+		if (--chunk->live > 0) {
+			this->freeLists[index].push_back(block.data);
+			return;
+		}
+
+		// last block of the chunk: hand the chunk back, its other blocks leave the free list with it
+		uintptr_t begin = chunk->address;
+		std::erase_if(this->freeLists[index], [begin](const uint8_t* data) {
+			uintptr_t address = reinterpret_cast<uintptr_t>(data);
+			return address >= begin && address < begin + CHUNK_SIZE;
+		});
+		if (this->carving[index] == chunk->memory.get()) {
+			this->carving[index] = nullptr;
+		}
+		this->chunks.erase(chunk);
+		this->reserved -= CHUNK_SIZE;
+	}
+
+
+
+	LastValueCache::LastValueCache(size_t memoryLimit, bool retainedOnly) : memoryLimit(memoryLimit), retainedOnly(retainedOnly) {}
+
+
+	LastValueCache::~LastValueCache() {
+		this->clear();
+	}
+
+
+	void LastValueCache::update(const PublishMessage& publish) {
+		if (this->retainedOnly && !publish.isRetain()) {
+			return;
+		}
+		this->update(publish.getTopic(), publish.getPayload(), publish.getQoS(), publish.isRetain());
+	}
+
+
+	void LastValueCache::update(std::string_view topic, std::string_view payload, QoS qos, bool retained) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		uint32_t index = this->find(topic);
+		// an empty retained message clears the retained value (3.3.1.3)
+		if (retained && payload.empty()) {
+			if (index != NONE) {
+				this->remove(index);
+			}
+			return;
+		}
+
+		// same size class as before: overwrite the payload in place, the topic and the memory use stay
+		size_t size = topic.size() + payload.size();
+		if (index != NONE && PayloadArena::blockSize(size) == this->entries[index].block.capacity) {
+			Entry& entry = this->entries[index];
+			if (!payload.empty()) {
+				std::memcpy(entry.block.data + entry.topicLength, payload.data(), payload.size());
+			}
+			entry.length = static_cast<uint32_t>(payload.size());
+			entry.qos = qos;
+			entry.retained = retained;
+			this->unlink(index);
+			this->pushFront(index);
+			return;
+		}
+		if (index != NONE) {
+			this->remove(index);
+		}
+
+		if (PayloadArena::blockSize(size) + ENTRY_BYTES > this->memoryLimit) {
+			return;
+		}
+		auto fits = [this, size]() { return this->usedBytes() + this->arena.reserveNeeded(size) + ENTRY_BYTES <= this->memoryLimit; };
+		while (!fits() && this->tail != NONE) {
+			this->remove(this->tail);
+			++this->evicted;
+		}
+		if (!fits()) { // a fresh chunk alone is above the limit
+			return;
+		}
+
+		if (this->freeEntries.empty()) {
+			index = static_cast<uint32_t>(this->entries.size());
+			this->entries.emplace_back();
+		} else {
+			index = this->freeEntries.back();
+			this->freeEntries.pop_back();
+		}
+
+		Entry& entry = this->entries[index];
+		entry.block = this->arena.allocate(size);
+		if (size != 0) {
+			std::memcpy(entry.block.data, topic.data(), topic.size());
+			std::memcpy(entry.block.data + topic.size(), payload.data(), payload.size());
+		}
+		entry.topicLength = static_cast<uint32_t>(topic.size());
+		entry.length = static_cast<uint32_t>(payload.size());
+		entry.qos = qos;
+		entry.retained = retained;
+
+		this->entryOf.emplace(topicOf(entry), index);
+		this->pushFront(index);
+		++this->count;
+	}
+
+
+	bool LastValueCache::erase(std::string_view topic) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		uint32_t index = this->find(topic);
+		if (index == NONE) {
+			return false;
+		}
+		this->remove(index);
+		return true;
+	}
+
+
+	void LastValueCache::clear() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		while (this->head != NONE) {
+			this->remove(this->head);
+		}
+	}
+
+
+	std::optional<LastValueCache::Value> LastValueCache::get(std::string_view topic) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		uint32_t index = this->find(topic);
+		if (index == NONE) {
+			return std::nullopt;
+		}
+
+		this->unlink(index);
+		this->pushFront(index);
+		return this->toValue(this->entries[index]);
+	}
+
+
+	bool LastValueCache::get(std::string_view topic, std::string& payload) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		uint32_t index = this->find(topic);
+		if (index == NONE) {
+			return false;
+		}
+
+		this->unlink(index);
+		this->pushFront(index);
+		const Entry& entry = this->entries[index];
+		payload.assign(reinterpret_cast<const char*>(entry.block.data + entry.topicLength), entry.length);
+		return true;
+	}
+
+
+	std::vector<LastValueCache::Value> LastValueCache::snapshot(std::string_view filter) const {
+		TopicFilter compiled{std::string(filter)};
+		std::vector<Value> values;
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (uint32_t index = this->head; index != NONE; index = this->entries[index].next) {
+			const Entry& entry = this->entries[index];
+			if (compiled.matches(topicOf(entry))) {
+				values.push_back(this->toValue(entry));
+			}
+		}
+		return values;
+	}
+
+
+	std::vector<LastValueCache::Value> LastValueCache::snapshotPrefix(std::string_view prefix) const {
+		std::vector<Value> values;
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (uint32_t index = this->head; index != NONE; index = this->entries[index].next) {
+			const Entry& entry = this->entries[index];
+			if (topicOf(entry).starts_with(prefix)) {
+				values.push_back(this->toValue(entry));
+			}
+		}
+		return values;
+	}
+
+
+	size_t LastValueCache::size() const {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->count;
+	}
+
+
+	size_t LastValueCache::memoryBytes() const {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		size_t indexBytes = this->entryOf.size() * (ENTRY_BYTES - sizeof(Entry)) + this->entryOf.bucket_count() * sizeof(void*);
+		return this->arena.bytesReserved() + this->entries.capacity() * sizeof(Entry) + indexBytes;
+	}
+
+
+	uint64_t LastValueCache::evictions() const {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->evicted;
+	}
+
+
+	uint32_t LastValueCache::find(std::string_view topic) const {
+		auto it = this->entryOf.find(topic);
+		return it != this->entryOf.end() ? it->second : NONE;
+	}
+
+
+	void LastValueCache::unlink(uint32_t index) {
+		Entry& entry = this->entries[index];
+		if (entry.prev != NONE) {
+			this->entries[entry.prev].next = entry.next;
+		} else {
+			this->head = entry.next;
+		}
+		if (entry.next != NONE) {
+			this->entries[entry.next].prev = entry.prev;
+		} else {
+			this->tail = entry.prev;
+		}
+		entry.prev = NONE;
+		entry.next = NONE;
+	}
+
+
+	void LastValueCache::pushFront(uint32_t index) {
+		Entry& entry = this->entries[index];
+		entry.prev = NONE;
+		entry.next = this->head;
+		if (this->head != NONE) {
+			this->entries[this->head].prev = index;
+		}
+		this->head = index;
+		if (this->tail == NONE) {
+			this->tail = index;
+		}
+	}
+
+
+	void LastValueCache::remove(uint32_t index) {
+		this->unlink(index);
+
+		Entry& entry = this->entries[index];
+		this->entryOf.erase(topicOf(entry)); // before the block holding the key goes
+		this->arena.release(entry.block);
+		entry = Entry();
+
+		this->freeEntries.push_back(index);
+		--this->count;
+	}
+
+
+	size_t LastValueCache::usedBytes() const {
+		return this->arena.bytesReserved() + this->count * ENTRY_BYTES;
+	}
+
+
+	LastValueCache::Value LastValueCache::toValue(const Entry& entry) const {
+		Value value;
+		value.topic = std::string(topicOf(entry));
+		value.payload.assign(reinterpret_cast<const char*>(entry.block.data + entry.topicLength), entry.length);
+		value.qos = entry.qos;
+		value.retained = entry.retained;
+		return value;
+	}
+
+} // namespace pubsupp
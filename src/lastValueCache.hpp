@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+#include "messages/mqttMessage.hpp"
+#include "messages/publishMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Slab allocator for cached payloads: blocks come in power-of-two size classes carved
+	 * out of 64 KiB chunks, each chunk serving one class. Freed blocks go back to the free
+	 * list of their class, and a chunk whose last block is freed is returned to the system.
+	 * Payloads above the largest class get a block of their own, released when freed.
+	 */
+	class PayloadArena {
+	  public:
+		struct Block {
+			uint8_t* data = nullptr;
+			uint32_t capacity = 0;
+		};
+
+		Block allocate(size_t size);
+		void release(Block block);
+		// how much allocate(size) would add to bytesReserved(), 0 if a block of its class is free
+		size_t reserveNeeded(size_t size) const;
+
+		// bytes of all blocks handed out, rounded up to their size class
+		size_t bytesInUse() const { return this->inUse; }
+		// chunks and large blocks taken from the system
+		size_t bytesReserved() const { return this->reserved; }
+
+		static size_t blockSize(size_t size);
+
+	  private:
+		static constexpr size_t MIN_BLOCK = 32;
+		static constexpr size_t MAX_BLOCK = 16 * 1024;
+		static constexpr size_t CHUNK_SIZE = 64 * 1024;
+		static constexpr size_t CLASSES = 10; // 32 B ... 16 KiB
+
+		struct Chunk {
+			uintptr_t address = 0;
+			std::unique_ptr<uint8_t[]> memory;
+			size_t carved = 0; // bytes from the start handed out at least once
+			size_t live = 0; // blocks handed out right now
+		};
+
+		static size_t sizeClass(size_t size);
+		std::vector<Chunk>::iterator chunkAfter(uintptr_t address);
+		std::vector<Chunk>::iterator chunkOf(const uint8_t* data);
+
+		std::vector<Chunk> chunks; // sorted by address
+		uint8_t* carving[CLASSES] = {}; // per class, the chunk with room left to carve from
+		std::vector<uint8_t*> freeLists[CLASSES];
+		size_t inUse = 0;
+		size_t reserved = 0;
+	};
+
+
+
+	/*
+	 * Latest message per topic, so a late reader does not have to wait for the next publish.
+	 *
+	 * Each topic name is stored in the PayloadArena right in front of its payload, and the index keys on
+	 * views of those names, so a topic costs memory only while it is cached, however many pass through.
+	 * The memory limit covers the memory the arena reserved plus the entries and their index nodes: the
+	 * least recently updated or read topics are evicted until the next message fits, so a limit below one
+	 * arena chunk (64 KiB) only leaves room for messages above 16 KiB.
+	 *
+	 * Retained messages follow the broker semantics (3.3.1.3): a retained message with an empty payload
+	 * removes the topic from the cache. With `retainedOnly` only retained messages are cached at all.
+	 *
+	 * All methods lock, so the cache can be read from any thread while the client fills it.
+	 */
+	class LastValueCache {
+	  public:
+		struct Value {
+			std::string topic;
+			std::string payload;
+			QoS qos = QoS::AT_MOST_ONCE;
+			bool retained = false;
+		};
+
+		explicit LastValueCache(size_t memoryLimit, bool retainedOnly = false);
+		~LastValueCache();
+
+		LastValueCache(const LastValueCache&) = delete;
+		LastValueCache& operator=(const LastValueCache&) = delete;
+
+		void update(const PublishMessage& publish);
+		void update(std::string_view topic, std::string_view payload, QoS qos, bool retained);
+		bool erase(std::string_view topic);
+		void clear();
+
+		std::optional<Value> get(std::string_view topic);
+		// copies into `payload`, reusing its buffer
+		bool get(std::string_view topic, std::string& payload);
+
+		// all cached values whose topic matches the filter (wildcards allowed) or starts with the prefix
+		std::vector<Value> snapshot(std::string_view filter) const;
+		std::vector<Value> snapshotPrefix(std::string_view prefix) const;
+
+		size_t size() const;
+		size_t memoryBytes() const;
+		uint64_t evictions() const;
+
+	  private:
+		static constexpr uint32_t NONE = UINT32_MAX;
+
+		struct Entry {
+			PayloadArena::Block block; // topic, then payload
+			uint32_t topicLength = 0;
+			uint32_t length = 0; // of the payload
+			QoS qos = QoS::AT_MOST_ONCE;
+			bool retained = false;
+
+			// LRU links (entry indices), head is the most recently used
+			uint32_t prev = NONE;
+			uint32_t next = NONE;
+		};
+		// an entry plus its index node, roughly what the standard library allocates for it
+		static constexpr size_t ENTRY_BYTES = sizeof(Entry) + sizeof(std::pair<const std::string_view, uint32_t>) + 2 * sizeof(void*);
+
+		static std::string_view topicOf(const Entry& entry) { return {reinterpret_cast<const char*>(entry.block.data), entry.topicLength}; }
+		uint32_t find(std::string_view topic) const;
+		void unlink(uint32_t index);
+		void pushFront(uint32_t index);
+		void remove(uint32_t index);
+		size_t usedBytes() const;
+		Value toValue(const Entry& entry) const;
+
+		mutable std::mutex mutex;
+		size_t memoryLimit;
+		bool retainedOnly;
+
+		PayloadArena arena;
+		std::vector<Entry> entries;
+		std::vector<uint32_t> freeEntries;
+		std::unordered_map<std::string_view, uint32_t> entryOf; // views into the entries' blocks
+		uint32_t head = NONE;
+		uint32_t tail = NONE;
+		size_t count = 0;
+		uint64_t evicted = 0;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,157 @@
+#include "latencyHistogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Bucket layout: values below 2^SUB_BUCKET_BITS map onto themselves. Above that, `shift` low bits are
+	 * dropped so the value keeps SUB_BUCKET_BITS significant bits `sub` in [HALF, 2 * HALF), and it lands in
+	 * bucket shift * HALF + sub. The ranges of consecutive shifts line up without gaps.
+	 */
+	size_t LatencyHistogram::bucketOf(uint64_t value) {
+		constexpr uint64_t maxValue = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+		value = std::min(value, maxValue);
+
+		unsigned width = std::bit_width(value);
+		unsigned shift = width > SUB_BUCKET_BITS ? width - SUB_BUCKET_BITS : 0;
+		return shift * HALF_SUB_BUCKETS + (value >> shift);
+	}
+
+
+	uint64_t LatencyHistogram::lowestOf(size_t bucket) {
+		size_t shift = bucket < 2 * HALF_SUB_BUCKETS ? 0 : bucket / HALF_SUB_BUCKETS - 1;
+		return static_cast<uint64_t>(bucket - shift * HALF_SUB_BUCKETS) << shift;
+	}
+
+
+	uint64_t LatencyHistogram::highestOf(size_t bucket) {
+		size_t shift = bucket < 2 * HALF_SUB_BUCKETS ? 0 : bucket / HALF_SUB_BUCKETS - 1;
+		return (static_cast<uint64_t>(bucket - shift * HALF_SUB_BUCKETS + 1) << shift) - 1;
+	}
+
+
+	void LatencyHistogram::record(uint64_t value, uint64_t count) {
+		this->counts[bucketOf(value)] += count;
+		this->total += count;
+		this->sum += value * count;
+	}
+
+
+	void LatencyHistogram::merge(const LatencyHistogram& other) {
+		for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+			this->counts[i] += other.counts[i];
+		}
+		this->total += other.total;
+		this->sum += other.sum;
+	}
+
+
+	void LatencyHistogram::reset() {
+		std::fill(this->counts.begin(), this->counts.end(), 0);
+		this->total = 0;
+		this->sum = 0;
+	}
+
+
+	uint64_t LatencyHistogram::min() const {
+		for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+			if (this->counts[i] != 0) {
+				return lowestOf(i);
+			}
+		}
+		return 0;
+	}
+
+
+	uint64_t LatencyHistogram::max() const {
+		for (size_t i = BUCKET_COUNT; i > 0; --i) {
+			if (this->counts[i - 1] != 0) {
+				return highestOf(i - 1);
+			}
+		}
+		return 0;
+	}
+
+
+	uint64_t LatencyHistogram::percentile(double p) const {
+		if (this->total == 0) {
+			return 0;
+		}
+
+		// rank of the value we are after, at least the first one
+		double clamped = std::clamp(p, 0.0, 100.0);
+		uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * this->total)));
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+			seen += this->counts[i];
+			if (seen >= rank) {
+				return highestOf(i);
+			}
+		}
+		return this->max();
+	}
+
+
+
+
+
+	LatencyRecorder::~LatencyRecorder() {
+		for (auto& stripe : this->stripes) {
+			delete stripe.load(std::memory_order_relaxed);
+		}
+	}
+
+
+	LatencyRecorder::Stripe& LatencyRecorder::stripe() {
+		// threads are spread round robin over the stripes, the same slot in every recorder
+		static std::atomic<size_t> nextThread = 0;
+		thread_local size_t index = nextThread.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+
+		Stripe* stripe = this->stripes[index].load(std::memory_order_acquire);
+		if (stripe) {
+			return *stripe;
+		}
+
+		// first use of this slot: whoever loses the race frees its copy
+		Stripe* created = new Stripe();
+		if (this->stripes[index].compare_exchange_strong(stripe, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			return *created;
+		}
+		delete created;
+		return *stripe;
+	}
+
+
+	void LatencyRecorder::record(uint64_t value) {
+		Stripe& stripe = this->stripe();
+		stripe.counts[LatencyHistogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+		stripe.sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+
+	LatencyHistogram LatencyRecorder::snapshot() const {
+		LatencyHistogram histogram;
+
+		for (const auto& slot : this->stripes) {
+			const Stripe* stripe = slot.load(std::memory_order_acquire);
+			if (!stripe) {
+				continue;
+			}
+
+			for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+				uint64_t count = stripe->counts[i].load(std::memory_order_relaxed);
+				histogram.counts[i] += count;
+				histogram.total += count;
+			}
+			histogram.sum += stripe->sum.load(std::memory_order_relaxed);
+		}
+		return histogram;
+	}
+
+} // namespace pubsupp
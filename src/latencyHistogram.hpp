@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+
+namespace pubsupp {
+
+	// monotonic timestamp in nanoseconds, the clock all latency stamps are taken with
+	inline uint64_t monotonicNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+
+	/*
+	 * HDR style histogram of latencies in nanoseconds.
+	 *
+	 * Values below 2^SUB_BUCKET_BITS get a bucket each, above that every power of two is split into
+	 * 2^(SUB_BUCKET_BITS - 1) linear sub-buckets, so any recorded value is off by less than 1/64 (~1.6%)
+	 * from its bucket's bounds, from nanoseconds up to about an hour (larger values are clamped).
+	 *
+	 * Plain value type, not thread-safe: LatencyRecorder records concurrently and hands these out as snapshots.
+	 * Histograms of different clients or threads can be merged into one.
+	 */
+	class LatencyHistogram {
+	  public:
+		static constexpr unsigned SUB_BUCKET_BITS = 7;
+		static constexpr unsigned MAX_VALUE_BITS = 42; // 2^42 ns ~ 73 minutes
+		static constexpr size_t HALF_SUB_BUCKETS = size_t(1) << (SUB_BUCKET_BITS - 1);
+		static constexpr size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS;
+
+		static size_t bucketOf(uint64_t value);
+		static uint64_t lowestOf(size_t bucket);
+		static uint64_t highestOf(size_t bucket);
+
+		LatencyHistogram() : counts(BUCKET_COUNT, 0) {}
+
+		void record(uint64_t value, uint64_t count = 1);
+		void merge(const LatencyHistogram& other);
+		void reset();
+
+		uint64_t count() const { return this->total; }
+		uint64_t min() const;
+		uint64_t max() const;
+		double mean() const { return this->total == 0 ? 0.0 : static_cast<double>(this->sum) / this->total; }
+		// value at percentile p (0..100), the upper bound of the bucket it falls into
+		uint64_t percentile(double p) const;
+
+		uint64_t countAt(size_t bucket) const { return this->counts[bucket]; }
+
+	  private:
+		friend class LatencyRecorder;
+
+		std::vector<uint64_t> counts;
+		uint64_t total = 0;
+		uint64_t sum = 0;
+	};
+
+
+
+	/*
+	 * Records latencies from any number of threads without locks.
+	 *
+	 * Every thread writes to one of STRIPES cache-line aligned copies of the histogram (picked once
+	 * per thread), so the increments stay uncontended unless more threads record than there are stripes.
+	 * Stripes are allocated on first use, an idle recorder costs a few pointers.
+	 * snapshot() merges the stripes and may be called at any time from any thread.
+	 */
+	class LatencyRecorder {
+	  public:
+		static constexpr size_t STRIPES = 16;
+
+		LatencyRecorder() = default;
+		~LatencyRecorder();
+
+		LatencyRecorder(const LatencyRecorder&) = delete;
+		LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+		void record(uint64_t value);
+		// time from `startNs` (a monotonicNs() stamp) until now
+		void recordSince(uint64_t startNs) {
+			uint64_t now = monotonicNs();
+			this->record(now > startNs ? now - startNs : 0);
+		}
+
+		LatencyHistogram snapshot() const;
+
+	  private:
+		struct alignas(64) Stripe {
+			std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> counts{};
+			std::atomic<uint64_t> sum = 0;
+		};
+
+		Stripe& stripe();
+
+		std::array<std::atomic<Stripe*>, STRIPES> stripes{};
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,238 @@
+#include "loadGenerator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+#include "logger.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		using Clock = std::chrono::steady_clock;
+
+		struct LoadClient {
+			std::string id;
+			std::unique_ptr<MqttClient> client;
+			std::vector<std::string> topics;
+
+			// written by the client's I/O thread only, read after it stopped
+			std::atomic<uint64_t> received = 0;
+			std::vector<uint32_t> latenciesUs;
+		};
+
+
+		int64_t nowNs() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+		}
+	} // namespace
+
+
+
+	double LoadReport::percentile(double p) const {
+		if (this->latenciesUs.empty()) {
+			return 0;
+		}
+		size_t index = std::min(this->latenciesUs.size() - 1, static_cast<size_t>(p / 100.0 * static_cast<double>(this->latenciesUs.size())));
+		return this->latenciesUs[index];
+	}
+
+
+
+	LoadGenerator::LoadGenerator(LoadConfig config) : config(std::move(config)) {
+		if (this->config.clients == 0 || this->config.threads == 0 || this->config.topics == 0) {
+			throw std::runtime_error("Load generator needs at least one client, thread and topic");
+		}
+		if (this->config.qosWeights[0] + this->config.qosWeights[1] + this->config.qosWeights[2] == 0) {
+			throw std::runtime_error("QoS mix must not be all zero");
+		}
+		if (this->config.rate <= 0) {
+			throw std::runtime_error("Publish rate must be positive");
+		}
+		this->config.payloadMin = std::max<size_t>(this->config.payloadMin, sizeof(int64_t)); // room for the timestamp
+		this->config.payloadMax = std::max(this->config.payloadMax, this->config.payloadMin);
+		this->config.threads = std::min(this->config.threads, this->config.clients);
+	}
+
+
+	LoadReport LoadGenerator::run() {
+		std::string host = this->config.host;
+		// two runs against one broker would otherwise take over each other's sessions and receive each other's messages
+		std::random_device random;
+		const std::string prefix = this->config.topicPrefix + "-" + std::to_string(::getpid()) + "-" + std::to_string(random());
+		PUBSUPP_LOG_INFO("Load run " << prefix);
+
+		std::vector<std::unique_ptr<LoadClient>> clients;
+		for (size_t i = 0; i < this->config.clients; ++i) {
+			auto loadClient = std::make_unique<LoadClient>();
+			loadClient->id = prefix + "-" + std::to_string(i);
+			for (size_t t = 0; t < this->config.topics; ++t) {
+				loadClient->topics.push_back(prefix + "/" + std::to_string(i) + "/" + std::to_string(t));
+			}
+			loadClient->client = std::make_unique<MqttClient>(host, this->config.port, loadClient->id);
+			loadClient->client->enableLatencyTracking();
+			clients.push_back(std::move(loadClient));
+		}
+
+		std::vector<MqttClient*> sessions;
+		for (auto& c : clients) {
+			sessions.push_back(c->client.get());
+		}
+		ConnectionStormReport connects = ConnectionStorm(this->config.connect).connect(sessions);
+		for (const ConnectionStormReport::Session& session : connects.sessions) {
+			if (!session.error.empty()) {
+				throw std::runtime_error(std::to_string(connects.failed) + " of " + std::to_string(clients.size()) + " clients failed to connect: " + session.error);
+			}
+		}
+
+		for (size_t i = 0; i < clients.size(); ++i) {
+			LoadClient* stats = clients[i].get();
+			MqttClient* client = stats->client.get();
+			client->subscribe(prefix + "/" + std::to_string(i) + "/#", QoS::AT_MOST_ONCE, [stats](const PublishMessage& publish) {
+				const std::string& payload = publish.getPayload();
+				if (payload.size() < sizeof(int64_t)) {
+					return;
+				}
+				int64_t sentNs;
+				std::memcpy(&sentNs, payload.data(), sizeof(sentNs));
+				stats->latenciesUs.push_back(static_cast<uint32_t>(std::max<int64_t>(0, nowNs() - sentNs) / 1000));
+				stats->received.fetch_add(1, std::memory_order_relaxed);
+			});
+			client->start();
+		}
+
+		std::atomic<uint64_t> enqueued = 0;
+		auto start = Clock::now();
+		auto end = start + this->config.duration;
+
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < this->config.threads; ++t) {
+			threads.emplace_back([&, t]() {
+				std::vector<LoadClient*> own;
+				for (size_t i = t; i < clients.size(); i += this->config.threads) {
+					own.push_back(clients[i].get());
+				}
+
+				std::mt19937_64 rng(t + 1);
+				std::uniform_int_distribution<size_t> payloadSize(this->config.payloadMin, this->config.payloadMax);
+				std::uniform_int_distribution<size_t> topic(0, this->config.topics - 1);
+				std::discrete_distribution<int> qos(this->config.qosWeights.begin(), this->config.qosWeights.end());
+				std::string payload(this->config.payloadMax, 'x');
+
+				auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(this->config.threads) / this->config.rate));
+				auto next = Clock::now();
+				uint64_t sent = 0;
+
+				for (size_t n = 0; Clock::now() < end; ++n) {
+					auto now = Clock::now();
+					if (now < next) {
+						std::this_thread::sleep_until(next);
+					} else if (now - next > std::chrono::seconds(1)) {
+						next = now;
+					}
+					next += interval;
+
+					LoadClient& target = *own[n % own.size()];
+					size_t size = payloadSize(rng);
+					int64_t stamp = nowNs();
+					std::memcpy(payload.data(), &stamp, sizeof(stamp));
+
+					target.client->enqueuePublish(target.topics[topic(rng)], static_cast<QoS>(qos(rng)), payload.substr(0, size));
+					++sent;
+				}
+				enqueued += sent;
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		// let the clients write what is still queued and the broker deliver everything written
+		auto drained = [&clients]() {
+			uint64_t queued = 0;
+			uint64_t written = 0;
+			uint64_t received = 0;
+			for (const auto& c : clients) {
+				queued += c->client->queuedPublishes();
+				written += c->client->metrics().packetsOut[static_cast<size_t>(MessageType::PUBLISH)];
+				received += c->received.load(std::memory_order_relaxed);
+			}
+			return queued == 0 && received >= written;
+		};
+		auto drainStart = Clock::now();
+		while (!drained() && Clock::now() - drainStart < this->config.drainTimeout) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		LoadReport report;
+		report.enqueued = enqueued;
+		report.drainSeconds = std::chrono::duration<double>(Clock::now() - drainStart).count();
+		report.connects = std::move(connects);
+		report.seconds = seconds;
+		for (auto& c : clients) {
+			c->client->stop();
+			report.unsent += c->client->queuedPublishes();
+			report.received += c->received;
+			report.stages.merge(c->client->latencies());
+			report.metrics.merge(c->client->metrics());
+			report.latenciesUs.insert(report.latenciesUs.end(), c->latenciesUs.begin(), c->latenciesUs.end());
+		}
+		std::sort(report.latenciesUs.begin(), report.latenciesUs.end());
+		report.published = report.metrics.packetsOut[static_cast<size_t>(MessageType::PUBLISH)];
+		report.publishedBytes = report.metrics.bytesOut[static_cast<size_t>(MessageType::PUBLISH)];
+
+		for (auto& c : clients) {
+			try {
+				c->client->disconnect();
+			} catch (const std::exception& e) {
+				PUBSUPP_LOG_WARN("Disconnect of " << c->id << " failed: " << e.what());
+			}
+		}
+		return report;
+	}
+
+
+	void LoadGenerator::printReport(const LoadReport& report, std::ostream& out) {
+		ConnectionStorm::printReport(report.connects, out);
+		out << "duration:   " << report.seconds << " s" << std::endl;
+		out << "published:  " << report.published << " msgs, " << report.published / report.seconds << " msgs/s, "
+			<< report.publishedBytes / report.seconds / 1024.0 << " KiB/s" << std::endl;
+		out << "received:   " << report.received << " msgs, " << report.received / report.seconds << " msgs/s" << std::endl;
+		if (report.unsent > 0) {
+			out << "unsent:     " << report.unsent << " of " << report.enqueued << " enqueued msgs were never written" << std::endl;
+		}
+		if (report.received < report.published) {
+			out << "missing:    " << report.published - report.received << " written msgs lost or still in flight after a " << report.drainSeconds
+				<< " s drain" << std::endl;
+		}
+		out << "latency us: p50 " << report.percentile(50) << ", p90 " << report.percentile(90) << ", p99 " << report.percentile(99)
+			<< ", p99.9 " << report.percentile(99.9) << ", max " << (report.latenciesUs.empty() ? 0 : report.latenciesUs.back()) << std::endl;
+
+		auto stage = [&out](const char* name, const LatencyHistogram& histogram) {
+			if (histogram.count() == 0) {
+				return;
+			}
+			out << name << "p50 " << histogram.percentile(50) / 1000.0 << ", p99 " << histogram.percentile(99) / 1000.0
+				<< ", p99.9 " << histogram.percentile(99.9) / 1000.0 << ", max " << histogram.max() / 1000.0 << " us" << std::endl;
+		};
+		stage("  enqueue -> write:   ", report.stages.enqueueToWrite);
+		stage("  write -> ack:       ", report.stages.writeToAck);
+		stage("  decode -> handler:  ", report.stages.decodeToHandler);
+		stage("  handler:            ", report.stages.handlerRun);
+
+		out << "syscalls:   " << report.metrics[Counter::SEND_CALLS] << " send, " << report.metrics[Counter::RECV_CALLS] << " recv, "
+			<< report.metrics[Counter::PARTIAL_WRITES] << " partial writes, " << report.metrics[Counter::DECODE_ERRORS] << " decode errors" << std::endl;
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+#include "connectionStorm.hpp"
+#include "mqttClient.hpp"
+
+
+
+namespace pubsupp {
+
+	struct LoadConfig {
+		std::string host = "127.0.0.1";
+		int port = 1883;
+		size_t clients = 1;
+		size_t threads = 1; // publishing threads, clients are spread over them
+		double rate = 1000; // publishes per second, all clients together
+		size_t payloadMin = 64; // payload size is uniform in [payloadMin, payloadMax]
+		size_t payloadMax = 64;
+		std::array<unsigned, 3> qosWeights = {1, 0, 0}; // relative share of QoS 0, 1 and 2
+		size_t topics = 1; // distinct topics per client
+		std::chrono::seconds duration{10};
+		std::string topicPrefix = "pubsupp-load"; // of client ids and topics, with a per-run suffix so concurrent runs stay apart
+		ConnectionStormConfig connect; // pacing of the initial connects
+		std::chrono::milliseconds drainTimeout{5000}; // wait for queued and in-flight messages after publishing stopped
+	};
+
+
+	struct LoadReport {
+		double seconds = 0;
+		uint64_t enqueued = 0;
+		uint64_t published = 0; // PUBLISH packets written by the clients
+		uint64_t publishedBytes = 0; // their size on the wire
+		uint64_t unsent = 0; // still queued in the clients when the drain timed out
+		uint64_t received = 0;
+		double drainSeconds = 0; // after publishing stopped, until everything came back or the drain timed out
+		std::vector<uint32_t> latenciesUs; // publish to receive, sorted
+		ClientLatencies stages; // client side timings, merged over all clients
+		MetricsSnapshot metrics; // merged over all clients
+		ConnectionStormReport connects;
+
+		double percentile(double p) const;
+	};
+
+
+
+	/*
+	 * Drives `clients` connections against a broker at a fixed total publish rate.
+	 *
+	 * Every client subscribes to its own topics (<prefix>/<client>/#) and publishes to one of `topics`
+	 * topics below it, so each message comes back to its sender: the first 8 payload bytes carry the
+	 * send time, the handler turns it into an end-to-end latency sample.
+	 *
+	 * The clients are connected by a ConnectionStorm first, paced by `connect`, then each runs its own I/O thread;
+	 * the publishing threads only enqueue (see MqttClient::enqueuePublish).
+	 * A thread that falls more than a second behind its schedule skips ahead instead of bursting.
+	 * Afterwards the run waits up to `drainTimeout` for the queues to empty and the written messages
+	 * to come back; messages counted as published are the ones written, not the ones enqueued.
+	 */
+	class LoadGenerator {
+	  public:
+		explicit LoadGenerator(LoadConfig config);
+
+		LoadReport run();
+		static void printReport(const LoadReport& report, std::ostream& out);
+
+	  private:
+		LoadConfig config;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,178 @@
+#include "logger.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+
+
+namespace pubsupp {
+
+	namespace {
+		const char* levelName(LogLevel level) {
+			switch (level) {
+				case LogLevel::TRACE: return "TRACE";
+				case LogLevel::DEBUG: return "DEBUG";
+				case LogLevel::INFO: return "INFO ";
+				case LogLevel::WARN: return "WARN ";
+				case LogLevel::ERROR: return "ERROR";
+				default: return "?    ";
+			}
+		}
+
+
+		// "2026-01-31T12:34:56.789012Z "
+		void appendTimestamp(std::string& out, int64_t timeNs) {
+			time_t seconds = static_cast<time_t>(timeNs / 1000000000);
+			std::tm utc{};
+			gmtime_r(&seconds, &utc);
+
+			char buffer[40];
+			size_t length = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+			length += std::snprintf(buffer + length, sizeof(buffer) - length, ".%06dZ ", static_cast<int>(timeNs % 1000000000 / 1000));
+			out.append(buffer, length);
+		}
+
+
+		void writeAll(int fd, const std::string& data) {
+			size_t written = 0;
+			while (written < data.size()) {
+				ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+				if (n <= 0) {
+					return; // nowhere left to report it
+				}
+				written += static_cast<size_t>(n);
+			}
+		}
+	} // namespace
+
+
+
+	Logger& Logger::global() {
+		static Logger logger(STDERR_FILENO);
+		return logger;
+	}
+
+
+	Logger::Logger(int fd) : fd(fd), ring(std::make_unique<Record[]>(CAPACITY)) {
+		for (size_t i = 0; i < CAPACITY; ++i) {
+			this->ring[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		this->writer = std::thread([this]() { this->writerLoop(); });
+	}
+
+
+	Logger::~Logger() {
+		this->stopping.store(true);
+		this->wakeups.fetch_add(1);
+		this->wakeups.notify_one();
+		this->writer.join();
+	}
+
+
+	void Logger::log(LogLevel level, std::string_view message) {
+		size_t pos = this->enqueuePos.load(std::memory_order_relaxed);
+		Record* record;
+
+		while (true) {
+			record = &this->ring[pos & (CAPACITY - 1)];
+			size_t sequence = record->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+			if (diff == 0) {
+				if (this->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				this->droppedLines.fetch_add(1, std::memory_order_relaxed); // full
+				return;
+			} else {
+				pos = this->enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		record->level = level;
+		record->length = static_cast<uint32_t>(std::min(message.size(), MESSAGE_SIZE));
+		record->timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		std::memcpy(record->text, message.data(), record->length);
+		// seq_cst pairs with the writer going to sleep, see writerLoop()
+		record->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+		if (this->writerSleeping.load(std::memory_order_seq_cst) && this->writerSleeping.exchange(false)) {
+			this->wakeups.fetch_add(1);
+			this->wakeups.notify_one();
+		}
+	}
+
+
+	void Logger::flush() {
+		uint64_t target = this->enqueuePos.load();
+		this->wakeups.fetch_add(1);
+		this->wakeups.notify_one();
+
+		for (uint64_t written = this->writtenLines.load(); written < target; written = this->writtenLines.load()) {
+			this->writtenLines.wait(written);
+		}
+	}
+
+
+	bool Logger::tryPop(Record*& record) {
+		record = &this->ring[this->dequeuePos & (CAPACITY - 1)];
+		return record->sequence.load(std::memory_order_seq_cst) == this->dequeuePos + 1;
+	}
+
+
+	void Logger::writerLoop() {
+		std::string batch;
+		batch.reserve(64 * 1024);
+
+		while (true) {
+			uint32_t seenWakeups = this->wakeups.load();
+			size_t lines = 0;
+
+			Record* record;
+			while (this->tryPop(record)) {
+				appendTimestamp(batch, record->timeNs);
+				batch.append(levelName(record->level));
+				batch.push_back(' ');
+				batch.append(record->text, record->length);
+				batch.push_back('\n');
+
+				record->sequence.store(this->dequeuePos + CAPACITY, std::memory_order_release);
+				this->dequeuePos++;
+				lines++;
+
+				if (batch.size() >= 60 * 1024) {
+					break;
+				}
+			}
+
+			if (lines > 0) {
+				writeAll(this->fd, batch);
+				batch.clear();
+				this->writtenLines.fetch_add(lines);
+				this->writtenLines.notify_all();
+				continue;
+			}
+
+			if (this->stopping.load()) {
+				return;
+			}
+
+			// nothing to do: announce the nap, then look once more, so a line pushed in between is not missed
+			this->writerSleeping.store(true, std::memory_order_seq_cst);
+			if (this->tryPop(record)) {
+				this->writerSleeping.store(false);
+				continue;
+			}
+			this->wakeups.wait(seenWakeups);
+			this->writerSleeping.store(false);
+		}
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+
+
+
+// levels below this one are compiled out entirely (0 = TRACE ... 5 = OFF), see LogLevel
+#ifndef PUBSUPP_LOG_LEVEL
+	#define PUBSUPP_LOG_LEVEL 2
+#endif
+
+
+
+namespace pubsupp {
+
+	enum class LogLevel : uint8_t {
+		TRACE = 0,
+		DEBUG = 1,
+		INFO = 2,
+		WARN = 3,
+		ERROR = 4,
+		OFF = 5
+	};
+
+
+	// compiled in at all, see PUBSUPP_LOG_LEVEL (compared as LogLevel: with TRACE, comparing ints would be always true and trip -Wtype-limits)
+	constexpr bool logLevelEnabled(LogLevel level) { return level >= static_cast<LogLevel>(PUBSUPP_LOG_LEVEL); }
+
+
+
+	/*
+	 * Asynchronous logger: callers copy their line into a bounded lock-free ring, a background thread
+	 * formats and writes whatever piled up with one write() per batch.
+	 *
+	 * Logging never blocks and never allocates: lines longer than MESSAGE_SIZE are cut off, and lines
+	 * arriving while the ring is full are dropped (and counted) instead of waiting for the writer.
+	 * The ring is Vyukov's bounded queue: producers claim a slot with a CAS on the enqueue position,
+	 * a per-slot sequence number tells the writer when the slot is filled.
+	 *
+	 * Use the PUBSUPP_LOG_* macros: below PUBSUPP_LOG_LEVEL they compile to nothing, below the runtime
+	 * level (setLevel()) the message is not even formatted.
+	 */
+	class Logger {
+	  public:
+		static constexpr size_t MESSAGE_SIZE = 240;
+		static constexpr size_t CAPACITY = 4096; // lines, power of two
+
+		// writes to stderr, started on first use
+		static Logger& global();
+
+		explicit Logger(int fd);
+		~Logger(); // writes everything still queued
+
+		Logger(const Logger&) = delete;
+		Logger& operator=(const Logger&) = delete;
+
+		void setLevel(LogLevel level) { this->minLevel.store(level, std::memory_order_relaxed); }
+		LogLevel level() const { return this->minLevel.load(std::memory_order_relaxed); }
+		bool enabled(LogLevel level) const { return level >= this->level(); }
+
+		void log(LogLevel level, std::string_view message);
+		// block until every line logged so far is written
+		void flush();
+		uint64_t dropped() const { return this->droppedLines.load(std::memory_order_relaxed); }
+
+	  private:
+		struct Record {
+			std::atomic<size_t> sequence;
+			LogLevel level;
+			uint32_t length;
+			int64_t timeNs; // system clock, for the timestamp
+			char text[MESSAGE_SIZE];
+		};
+
+		bool tryPop(Record*& record);
+		void writerLoop();
+
+		int fd;
+		std::atomic<LogLevel> minLevel = LogLevel::INFO;
+		std::unique_ptr<Record[]> ring;
+		alignas(64) std::atomic<size_t> enqueuePos = 0;
+		alignas(64) size_t dequeuePos = 0; // writer thread only
+		std::atomic<uint64_t> writtenLines = 0; // popped and written, what flush() waits on
+		std::atomic<uint64_t> droppedLines = 0;
+		std::atomic<bool> writerSleeping = false;
+		std::atomic<uint32_t> wakeups = 0;
+		std::atomic<bool> stopping = false;
+		std::thread writer;
+	};
+
+
+
+	// ostream over a fixed buffer for a single log line, handed to the logger when destroyed
+	class LogLine {
+	  public:
+		explicit LogLine(LogLevel level) : level(level), stream(&this->buffer) {}
+		~LogLine() { Logger::global().log(this->level, this->buffer.view()); }
+
+		LogLine(const LogLine&) = delete;
+		LogLine& operator=(const LogLine&) = delete;
+
+		std::ostream& out() { return this->stream; }
+
+	  private:
+		class FixedBuffer : public std::streambuf {
+		  public:
+			FixedBuffer() { this->setp(this->text, this->text + Logger::MESSAGE_SIZE); }
+			std::string_view view() const { return std::string_view(this->pbase(), static_cast<size_t>(this->pptr() - this->pbase())); }
+
+		  protected:
+			int_type overflow(int_type c) override { return traits_type::not_eof(c); } // full: cut off
+
+		  private:
+			char text[Logger::MESSAGE_SIZE];
+		};
+
+		LogLevel level;
+		FixedBuffer buffer;
+		std::ostream stream;
+	};
+
+} // namespace pubsupp
+
+
+
+#define PUBSUPP_LOG(level, expression)                                                                   \
+	do {                                                                                                 \
+		if constexpr (::pubsupp::logLevelEnabled(::pubsupp::LogLevel::level)) {                         \
+			if (::pubsupp::Logger::global().enabled(::pubsupp::LogLevel::level)) {                       \
+				::pubsupp::LogLine pubsuppLogLine(::pubsupp::LogLevel::level);                           \
+				pubsuppLogLine.out() << expression;                                                      \
+			}                                                                                            \
+		}                                                                                                \
+	} while (false)
+
+#define PUBSUPP_LOG_TRACE(expression) PUBSUPP_LOG(TRACE, expression)
+#define PUBSUPP_LOG_DEBUG(expression) PUBSUPP_LOG(DEBUG, expression)
+#define PUBSUPP_LOG_INFO(expression) PUBSUPP_LOG(INFO, expression)
+#define PUBSUPP_LOG_WARN(expression) PUBSUPP_LOG(WARN, expression)
+#define PUBSUPP_LOG_ERROR(expression) PUBSUPP_LOG(ERROR, expression)
@@ -0,0 +1,238 @@
+#include "loopbackTransport.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+#include <poll.h>
+
+
+#include "messages/mqttMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	ByteRing::ByteRing(size_t capacity) : buffer(std::bit_ceil(std::max<size_t>(capacity, 16))) {}
+
+
+	void ByteRing::write(const uint8_t* data, size_t length) {
+		if (this->size() + length > this->buffer.size()) {
+			this->grow(this->size() + length);
+		}
+
+		size_t mask = this->buffer.size() - 1;
+		size_t start = this->tail & mask;
+		size_t first = std::min(length, this->buffer.size() - start);
+		std::copy_n(data, first, this->buffer.data() + start);
+		std::copy_n(data + first, length - first, this->buffer.data());
+		this->tail += length;
+	}
+
+
+	void ByteRing::read(uint8_t* out, size_t length) {
+		if (length > this->size()) {
+			throw std::runtime_error("Loopback ring underflow");
+		}
+
+		size_t mask = this->buffer.size() - 1;
+		size_t start = this->head & mask;
+		size_t first = std::min(length, this->buffer.size() - start);
+		std::copy_n(this->buffer.data() + start, first, out);
+		std::copy_n(this->buffer.data(), length - first, out + first);
+		this->head += length;
+	}
+
+
+	size_t ByteRing::frameLength() const {
+		size_t available = this->size();
+		uint32_t remainingLength = 0;
+		uint32_t multiplier = 1;
+
+		for (size_t i = 1; i <= 4; ++i) {
+			if (i >= available) {
+				return 0;
+			}
+			uint8_t byte = this->at(i);
+			remainingLength += (byte & 127) * multiplier;
+			multiplier *= 128;
+
+			if ((byte & 128) == 0) {
+				size_t length = 1 + i + remainingLength;
+				return length <= available ? length : 0;
+			}
+		}
+		throw std::runtime_error("Malformed MQTT message: remaining length exceeds 4 bytes");
+	}
+
+
+	// unwraps into a larger buffer, which keeps the contents in order starting at 0
+	void ByteRing::grow(size_t needed) {
+		std::vector<uint8_t> larger(std::bit_ceil(needed));
+		size_t size = this->size();
+		this->read(larger.data(), size);
+		this->buffer.swap(larger);
+		this->head = 0;
+		this->tail = size;
+	}
+
+
+
+
+
+	void LoopbackPeer::connect() {
+		this->toPeer.clear();
+		this->toClient.clear();
+		this->isConnected = true;
+	}
+
+
+	void LoopbackPeer::disconnect() { this->isConnected = false; }
+
+
+	void LoopbackPeer::receive(const uint8_t* data, size_t length) {
+		this->toPeer.write(data, length);
+
+		for (size_t frameLength; (frameLength = this->toPeer.frameLength()) != 0;) {
+			this->frame.resize(frameLength);
+			this->toPeer.read(this->frame.data(), frameLength);
+			this->frames++;
+
+			this->respond(this->frame);
+			if (this->frameHandler) {
+				this->frameHandler(*this, this->frame);
+			}
+		}
+	}
+
+
+	void LoopbackPeer::respond(const std::vector<uint8_t>& frame) {
+		MessageType type = static_cast<MessageType>(frame[0] >> 4);
+		size_t offset = 1;
+		uint32_t remainingLength = MqttMessage::decodeRemainingLength(frame, offset);
+
+		switch (type) {
+			case MessageType::CONNECT: {
+				std::array<uint8_t, 4> connack = {static_cast<uint8_t>(MessageType::CONNACK) << 4, 2,
+												  static_cast<uint8_t>(this->script.sessionPresent ? 1 : 0), this->script.connackReturnCode};
+				this->send(connack.data(), connack.size());
+				break;
+			}
+
+			case MessageType::SUBSCRIBE: {
+				if (!this->script.acknowledgeSubscribe || remainingLength < 2) {
+					break;
+				}
+				// one filter per packet, its requested QoS is the last byte
+				std::array<uint8_t, 5> suback = {static_cast<uint8_t>(MessageType::SUBACK) << 4, 3, frame[offset], frame[offset + 1],
+												 static_cast<uint8_t>(frame.back() & 0x03)};
+				this->send(suback.data(), suback.size());
+				break;
+			}
+
+			case MessageType::PUBLISH: {
+				this->publishes++;
+				QoS qos = static_cast<QoS>((frame[0] & 0x06) >> 1);
+
+				if (this->script.acknowledgePublish && qos != QoS::AT_MOST_ONCE) {
+					size_t packetIdOffset = offset + 2 + ((frame[offset] << 8) | frame[offset + 1]);
+					if (packetIdOffset + 2 > frame.size()) {
+						throw std::runtime_error("PUBLISH message incomplete: missing packet ID");
+					}
+					uint16_t packetId = static_cast<uint16_t>((frame[packetIdOffset] << 8) | frame[packetIdOffset + 1]);
+					auto ack = encodeAck(qos == QoS::AT_LEAST_ONCE ? MessageType::PUBACK : MessageType::PUBREC, packetId);
+					this->send(ack.data(), ack.size());
+				}
+
+				if (this->script.echoPublish) {
+					this->publish.decodeInPlace(frame);
+					PublishMessage::encode(this->echo, this->publish.getTopic(), QoS::AT_MOST_ONCE, this->publish.getPayload(), 0);
+					this->send(this->echo);
+				}
+				break;
+			}
+
+			case MessageType::PUBREL: {
+				if (this->script.acknowledgePublish) {
+					auto pubcomp = encodeAck(MessageType::PUBCOMP, decodeAckPacketId(MessageType::PUBREL, frame));
+					this->send(pubcomp.data(), pubcomp.size());
+				}
+				break;
+			}
+
+			case MessageType::PINGREQ: {
+				std::array<uint8_t, 2> pingresp = {static_cast<uint8_t>(MessageType::PINGRESP) << 4, 0};
+				this->send(pingresp.data(), pingresp.size());
+				break;
+			}
+
+			default: break; // acks for echoed messages, DISCONNECT, ...
+		}
+	}
+
+
+
+
+
+	void LoopbackTransport::tryConnect(std::string& /* address */, int /* port */) { this->remote->connect(); }
+
+
+	void LoopbackTransport::disconnect() { this->remote->disconnect(); }
+
+
+	void LoopbackTransport::trySend(const uint8_t* data, size_t length) {
+		if (!this->remote->connected()) {
+			throw std::runtime_error("Loopback transport not connected");
+		}
+		if (this->metrics) {
+			for (size_t offset = 0, packetLength; offset < length; offset += packetLength) {
+				packetLength = MqttMessage::packetLength(data + offset, length - offset);
+				packetLength = packetLength != 0 ? packetLength : length - offset;
+				this->metrics->packetOut(data[offset], packetLength);
+			}
+		}
+		this->remote->receive(data, length);
+	}
+
+
+	void LoopbackTransport::tryReceiveMqttMessage(std::vector<uint8_t>& frame) {
+		ByteRing& ring = this->remote->toClient;
+		size_t length = this->remote->connected() ? ring.frameLength() : 0;
+		if (length == 0) {
+			throw std::runtime_error(this->remote->connected() ? "No complete MQTT message queued by the loopback peer" : "Connection closed by peer");
+		}
+
+		frame.resize(length);
+		ring.read(frame.data(), length);
+		if (this->metrics) {
+			this->metrics->packetIn(frame[0], frame.size());
+		}
+	}
+
+
+	// the peer answers inline, so anything it will ever send is already queued
+	bool LoopbackTransport::waitReadable(int timeoutMs, int wakeFd) {
+		if (this->remote->toClient.frameLength() != 0 || !this->remote->connected()) {
+			return true; // a closed peer reads as an error, like a socket would
+		}
+		if (timeoutMs == 0) {
+			return false;
+		}
+
+		// a wakeup already pending ends the wait, otherwise only the timeout would
+		if (wakeFd >= 0) {
+			struct pollfd pfd = {};
+			pfd.fd = wakeFd;
+			pfd.events = POLLIN;
+			if (::poll(&pfd, 1, timeoutMs < 0 ? 0 : timeoutMs) > 0) {
+				return false;
+			}
+		}
+		if (timeoutMs < 0) {
+			throw std::runtime_error("Loopback peer has nothing queued, waiting would block forever");
+		}
+		return false;
+	}
+
+} // namespace pubsupp
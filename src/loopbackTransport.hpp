@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+#include "messages/publishMessage.hpp"
+#include "metrics.hpp"
+
+
+
+namespace pubsupp {
+
+	// growable byte ring, one direction of a loopback connection
+	class ByteRing {
+	  public:
+		explicit ByteRing(size_t capacity = 64 * 1024); // rounded up to a power of two
+
+		void write(const uint8_t* data, size_t length);
+		void read(uint8_t* out, size_t length);
+		void clear() { this->head = this->tail = 0; }
+
+		size_t size() const { return this->tail - this->head; }
+		bool empty() const { return this->head == this->tail; }
+		// length of the MQTT packet at the front, 0 while it is incomplete
+		size_t frameLength() const;
+
+	  private:
+		uint8_t at(size_t offset) const { return this->buffer[(this->head + offset) & (this->buffer.size() - 1)]; }
+		void grow(size_t needed);
+
+		std::vector<uint8_t> buffer;
+		size_t head = 0; // both only ever increase, masked on access
+		size_t tail = 0;
+	};
+
+
+
+	// how the loopback peer answers, everything else it receives is only counted
+	struct LoopbackScript {
+		uint8_t connackReturnCode = 0;
+		bool sessionPresent = false;
+		bool acknowledgeSubscribe = true; // SUBACK granting the requested QoS
+		bool acknowledgePublish = true; // PUBACK for QoS 1, PUBREC for QoS 2 (and PUBCOMP for its PUBREL)
+		bool echoPublish = false; // send every PUBLISH back as QoS 0, as if subscribed to everything
+	};
+
+
+
+	/*
+	 * The broker end of a LoopbackTransport: an in-process peer that parses what the client sends
+	 * and answers from a LoopbackScript right away, on the client's thread, so a client running over
+	 * it never waits and never enters the kernel.
+	 *
+	 * send() queues more frames for the client (e.g. a batch of PUBLISH packets to measure dispatch),
+	 * the frame handler sees every packet the client sent, after the scripted answer was queued.
+	 * Like the client's transport, the peer must only be used from the client's I/O thread.
+	 */
+	class LoopbackPeer {
+	  public:
+		using FrameHandler = std::function<void(LoopbackPeer& peer, const std::vector<uint8_t>& frame)>;
+
+		explicit LoopbackPeer(LoopbackScript script = {}) : script(script) {}
+
+		LoopbackScript script;
+
+		void setFrameHandler(FrameHandler handler) { this->frameHandler = std::move(handler); }
+		void send(const uint8_t* frame, size_t length) { this->toClient.write(frame, length); }
+		void send(const std::vector<uint8_t>& frame) { this->send(frame.data(), frame.size()); }
+
+		bool connected() const { return this->isConnected; }
+		uint64_t framesReceived() const { return this->frames; }
+		uint64_t publishesReceived() const { return this->publishes; }
+
+	  private:
+		friend class LoopbackTransport;
+
+		void connect();
+		void disconnect();
+		// bytes written by the client, answered as soon as a packet is complete
+		void receive(const uint8_t* data, size_t length);
+		void respond(const std::vector<uint8_t>& frame);
+
+		ByteRing toPeer;
+		ByteRing toClient;
+		FrameHandler frameHandler;
+		std::vector<uint8_t> frame;
+		std::vector<uint8_t> echo;
+		PublishMessage publish;
+		bool isConnected = false;
+		uint64_t frames = 0;
+		uint64_t publishes = 0;
+	};
+
+
+
+	/*
+	 * MqttTransport over two in-memory rings instead of a socket, for measuring the client's own CPU cost
+	 * (encode, packet ids, ack matching, dispatch) without syscalls or another process in the way:
+	 *
+	 *   auto peer = std::make_shared<LoopbackPeer>();
+	 *   BasicMqttClient<LoopbackTransport> client(host, port, clientId, std::in_place, peer);
+	 *
+	 * The address passed to connect is ignored. Waiting without a timeout while the peer has nothing
+	 * queued and no wakeup is pending throws instead of blocking forever, e.g. a blocking publish()
+	 * whose ack the script withholds. The client is meant to be driven from the calling thread
+	 * (publish(), poll()); an idle start()ed I/O loop would end with that error too.
+	 */
+	class LoopbackTransport {
+	  public:
+		LoopbackTransport() : LoopbackTransport(std::make_shared<LoopbackPeer>()) {}
+		explicit LoopbackTransport(std::shared_ptr<LoopbackPeer> peer) : remote(std::move(peer)) {}
+
+		void tryConnect(std::string& address, int port);
+		void disconnect();
+		void trySend(const uint8_t* data, size_t length);
+		void tryReceiveMqttMessage(std::vector<uint8_t>& frame);
+		bool waitReadable(int timeoutMs, int wakeFd = -1);
+		void setMetrics(Metrics* metrics) { this->metrics = metrics; }
+
+		LoopbackPeer& peer() { return *this->remote; }
+
+	  private:
+		std::shared_ptr<LoopbackPeer> remote;
+		Metrics* metrics = nullptr;
+	};
+
+} // namespace pubsupp
@@ -1,48 +1,388 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
 #include <exception>
+#include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <unistd.h>
+
+#include "captureReplayer.hpp"
+#include "loadGenerator.hpp"
+#include "logger.hpp"
 #include "messages/mqttMessage.hpp"
+#include "metrics.hpp"
+#include "mockBroker.hpp"
 #include "mqttClient.hpp"
+#include "tcpClient.hpp"
 
 
 
-int main() {
-	std::cout << "Connecting to MQTT broker..." << std::endl;
+namespace {
+	void printUsage() {
+		std::cerr << "usage: pubsupp [options]            subscribe and print incoming messages until Enter is pressed\n"
+				  << "       pubsupp publish [options]    publish one message and exit, in a single round trip after connecting\n"
+				  << "       pubsupp load [options]       run the load generator\n"
+				  << "       pubsupp broker [options]     run the embedded mock broker until interrupted\n"
+				  << "       pubsupp replay FILE [--speed X]  feed the inbound messages of a capture through a client\n"
+				  << "\n"
+				  << "options:\n"
+				  << "  --host HOST          broker address (127.0.0.1), unix://PATH for a Unix domain socket\n"
+				  << "  --port PORT          broker port (1883)\n"
+				  << "  --log-level LEVEL    trace, debug, info, warn, error or off (info), levels below the build's\n"
+				  << "                       PUBSUPP_LOG_LEVEL are compiled out\n"
+				  << "  --topic FILTER       subscription of the default mode (#)\n"
+				  << "  --client-id ID       client id of the default and publish mode (pubsupp-<pid>-<random>)\n"
+				  << "  --metrics-port PORT  serve Prometheus metrics of the default mode on 127.0.0.1:PORT\n"
+				  << "  --capture FILE       record every frame of the default mode to FILE, for replay\n"
+				  << "\n"
+				  << "publish options:\n"
+				  << "  --topic TOPIC        topic to publish to (required)\n"
+				  << "  --message TEXT       payload (empty)\n"
+				  << "  --qos N              0, 1 or 2 (0)\n"
+				  << "\n"
+				  << "load options:\n"
+				  << "  --clients N          connections (1)\n"
+				  << "  --threads N          publishing threads (1)\n"
+				  << "  --rate R             publishes per second, all clients together (1000)\n"
+				  << "  --payload MIN[-MAX]  payload size in bytes, uniform between MIN and MAX (64)\n"
+				  << "  --qos W0,W1,W2       relative share of QoS 0, 1 and 2 (1,0,0)\n"
+				  << "  --topics N           distinct topics per client (1)\n"
+				  << "  --duration S         seconds to publish for (10)\n"
+				  << "  --drain-timeout MS   how long to wait for queued and in-flight messages afterwards (5000)\n"
+				  << "  --connect-rate R     new connections per second while the clients come up (1000)\n"
+				  << "  --connect-concurrency N  connection handshakes in flight at once (256)\n"
+				  << "  --mock-broker        run against an embedded mock broker on a free port instead of --host/--port\n"
+				  << "\n"
+				  << "broker options (also used by load --mock-broker):\n"
+				  << "  --latency-us US      delay added to every frame the broker sends (0)\n"
+				  << "\n"
+				  << "replay options:\n"
+				  << "  --speed X            1 keeps the captured timing, 2 is twice as fast, 0 as fast as possible (0)\n";
+	}
 
-	try {
-		std::string brokerAddress = "127.0.0.1";
-		int brokerPort = 1883; // Default MQTT port
-		std::string clientId = "test-client-123";
 
-		pubsupp::MqttClient client(brokerAddress, brokerPort, clientId);
+	// unique per run: a broker disconnects the older of two sessions with the same client id (3.1.4)
+	std::string defaultClientId() {
+		std::random_device random;
+		return "pubsupp-" + std::to_string(::getpid()) + "-" + std::to_string(random());
+	}
 
-		client.connect(brokerAddress, brokerPort);
 
-		std::string topic = "#";
-		pubsupp::QoS qos = pubsupp::QoS::AT_MOST_ONCE;
-		uint16_t keepalive = 0;
+	pubsupp::LogLevel parseLogLevel(const std::string& value) {
+		static const std::pair<const char*, pubsupp::LogLevel> levels[] = {{"trace", pubsupp::LogLevel::TRACE}, {"debug", pubsupp::LogLevel::DEBUG},
+																			{"info", pubsupp::LogLevel::INFO},	 {"warn", pubsupp::LogLevel::WARN},
+																			{"error", pubsupp::LogLevel::ERROR}, {"off", pubsupp::LogLevel::OFF}};
+		for (const auto& [name, level] : levels) {
+			if (value == name) {
+				return level;
+			}
+		}
+		throw std::runtime_error("Unknown log level: " + value);
+	}
+
+
+	size_t parseCount(const std::string& option, const std::string& value) {
+		try {
+			size_t pos = 0;
+			unsigned long long n = std::stoull(value, &pos);
+			if (pos != value.size()) {
+				throw std::invalid_argument(value);
+			}
+			return static_cast<size_t>(n);
+		} catch (const std::exception&) {
+			throw std::runtime_error("Invalid value for " + option + ": " + value);
+		}
+	}
+
+
+	void parseLoadOption(pubsupp::LoadConfig& config, const std::string& option, const std::string& value) {
+		if (option == "--clients") {
+			config.clients = parseCount(option, value);
+		} else if (option == "--threads") {
+			config.threads = parseCount(option, value);
+		} else if (option == "--rate") {
+			config.rate = std::stod(value);
+		} else if (option == "--payload") {
+			size_t dash = value.find('-');
+			config.payloadMin = parseCount(option, value.substr(0, dash));
+			config.payloadMax = dash == std::string::npos ? config.payloadMin : parseCount(option, value.substr(dash + 1));
+		} else if (option == "--qos") {
+			size_t first = value.find(',');
+			size_t second = first == std::string::npos ? std::string::npos : value.find(',', first + 1);
+			if (second == std::string::npos) {
+				throw std::runtime_error("--qos expects three weights, e.g. 70,30,0");
+			}
+			config.qosWeights = {static_cast<unsigned>(parseCount(option, value.substr(0, first))),
+								 static_cast<unsigned>(parseCount(option, value.substr(first + 1, second - first - 1))),
+								 static_cast<unsigned>(parseCount(option, value.substr(second + 1)))};
+		} else if (option == "--connect-rate") {
+			config.connect.rate = std::stod(value);
+		} else if (option == "--connect-concurrency") {
+			config.connect.concurrency = parseCount(option, value);
+		} else if (option == "--topics") {
+			config.topics = parseCount(option, value);
+		} else if (option == "--duration") {
+			config.duration = std::chrono::seconds(parseCount(option, value));
+		} else if (option == "--drain-timeout") {
+			config.drainTimeout = std::chrono::milliseconds(parseCount(option, value));
+		} else {
+			throw std::runtime_error("Unknown option: " + option);
+		}
+	}
+
 
-		std::cout << "Subscribing to topic: " << topic << std::endl;
-		client.subscribe(topic, qos, keepalive);
+	int runBroker(const pubsupp::MockBrokerConfig& config) {
+		// block the signals before the broker thread starts, so only sigwait() sees them
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
-		std::cout << "Successfully subscribed to topic!" << std::endl;
+		pubsupp::MockBroker broker(config);
+		broker.start();
+		std::string endpoint = pubsupp::unixSocketPath(config.bindAddress).empty() ? config.bindAddress + ":" + std::to_string(broker.port()) : config.bindAddress;
+		std::cout << "Mock broker listening on " << endpoint << ", Ctrl+C to stop..." << std::endl;
+
+		int signal = 0;
+		sigwait(&signals, &signal);
+
+		broker.stop();
+		std::cout << "Routed " << broker.messagesRouted() << " messages" << std::endl;
+		return 0;
+	}
+
+
+	int replayCapture(const std::string& path, double speed) {
+		pubsupp::CaptureReplayer replayer(path, {"127.0.0.1", 0, speed});
+		pubsupp::ReplayStats stats;
+		std::exception_ptr serverError;
+		std::thread server([&]() {
+			try {
+				stats = replayer.serveOne();
+			} catch (...) {
+				serverError = std::current_exception();
+			}
+		});
+
+		std::string host = "127.0.0.1";
+		std::string clientId = "pubsupp-replay";
+		pubsupp::MqttClient client(host, replayer.port(), clientId);
+		client.enableLatencyTracking();
+
+		std::atomic<uint64_t> received = 0;
+		std::atomic<uint64_t> payloadBytes = 0;
+		client.setMessageHandler([&](const pubsupp::PublishMessage& publish) {
+			payloadBytes.fetch_add(publish.getPayload().size(), std::memory_order_relaxed);
+			received.fetch_add(1, std::memory_order_relaxed);
+		});
+
+		auto start = std::chrono::steady_clock::now();
+		client.connect();
+		client.start();
+
+		// until everything arrived, or nothing did for a second (e.g. QoS 2 duplicates in the capture)
+		uint64_t last = 0;
+		auto lastProgress = start;
+		while (received < replayer.publishCount() && std::chrono::steady_clock::now() - lastProgress < std::chrono::seconds(1)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			if (received != last) {
+				last = received;
+				lastProgress = std::chrono::steady_clock::now();
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		client.stop();
+		client.disconnect();
+		server.join();
+		if (serverError) {
+			std::rethrow_exception(serverError);
+		}
+
+		pubsupp::LatencyHistogram dispatch = client.latencies().decodeToHandler;
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "replayed:   " << stats.frames << " frames, " << stats.publishes << " publishes, " << stats.bytes / 1024.0 / 1024.0 << " MiB" << std::endl;
+		std::cout << "handled:    " << received << " msgs in " << seconds << " s, " << received / seconds << " msgs/s, "
+				  << payloadBytes / seconds / 1024.0 / 1024.0 << " MiB/s payload" << std::endl;
+		std::cout << "dispatch:   p50 " << dispatch.percentile(50) / 1000.0 << " us, p99 " << dispatch.percentile(99) / 1000.0 << " us" << std::endl;
+		return 0;
+	}
 
-		std::string payload = "Hello MQTT";
-		std::string publishTopic = "test";
-		std::cout << "Publishing " << payload.length() << " bytes to topic: " << publishTopic << std::endl;
-		client.publish(publishTopic, qos, payload);
-		std::cout << "Successfully published to topic!" << std::endl;
 
-		// TODO: implement message handling -> what should happen if client receives a message?
-		std::cout << "Press Enter to disconnect..." << std::endl;
+	// CONNECT and PUBLISH leave in one write (connectPipelined), so this takes one round trip after the TCP handshake
+	int publishOnce(std::string host, int port, const std::string& clientId, const std::string& topic, pubsupp::QoS qos, const std::string& message) {
+		pubsupp::MqttClient client(host, port, clientId);
+
+		pubsupp::ConnectBatch batch;
+		batch.publishes.push_back({topic, qos, message});
+
+		auto start = std::chrono::steady_clock::now();
+		client.connectPipelined(batch);
+		double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		client.disconnect();
+
+		std::cout << "Published " << message.size() << " bytes to " << topic << " (QoS " << static_cast<int>(qos) << ") in " << std::fixed
+				  << std::setprecision(3) << elapsedMs << " ms" << std::endl;
+		return 0;
+	}
+
+
+	int subscribeAndPrint(std::string host, int port, const std::string& clientId, const std::string& topic, int metricsPort, const std::string& capturePath) {
+		pubsupp::MqttClient client(host, port, clientId);
+		if (!capturePath.empty()) {
+			client.enableWireCapture(capturePath);
+		}
+
+		pubsupp::MetricsExporter exporter([&client, &clientId]() {
+			std::ostringstream out;
+			pubsupp::writePrometheus(out, {{clientId, client.metrics()}});
+			return out.str();
+		});
+		if (metricsPort >= 0) {
+			exporter.serve("127.0.0.1", static_cast<uint16_t>(metricsPort));
+			std::cout << "Serving metrics on 127.0.0.1:" << exporter.port() << std::endl;
+		}
+
+		pubsupp::ConnectBatch batch;
+		batch.subscriptions.push_back({topic, pubsupp::QoS::AT_MOST_ONCE, [](const pubsupp::PublishMessage& publish) {
+										   std::cout << publish.getTopic() << ": " << publish.getPayload() << std::endl;
+									   }});
+		client.connectPipelined(batch);
+		client.start();
+
+		std::cout << "Subscribed to " << topic << ", press Enter to disconnect..." << std::endl;
 		std::cin.get();
 
+		client.stop();
 		client.disconnect();
-		std::cout << "Disconnected from MQTT broker." << std::endl;
+		return 0;
+	}
+} // namespace
+
+
+
+int main(int argc, char** argv) {
+	std::vector<std::string> args(argv + 1, argv + argc);
+	std::string mode = !args.empty() && (args[0] == "load" || args[0] == "broker" || args[0] == "replay" || args[0] == "publish") ? args[0] : "";
+	if (!mode.empty()) {
+		args.erase(args.begin());
+	}
+	bool load = mode == "load";
+
+	std::string replayPath;
+	if (mode == "replay" && !args.empty() && args[0].rfind("--", 0) != 0) {
+		replayPath = args[0];
+		args.erase(args.begin());
+	}
+
+	try {
+		pubsupp::LoadConfig config;
+		pubsupp::MockBrokerConfig brokerConfig;
+		bool mockBroker = false;
+		std::string topic = "#";
+		std::string clientId;
+		std::string message;
+		pubsupp::QoS qos = pubsupp::QoS::AT_MOST_ONCE;
+		int metricsPort = -1;
+		std::string capturePath;
+		double replaySpeed = 0;
+
+		for (size_t i = 0; i < args.size(); ++i) {
+			if (args[i] == "--help" || args[i] == "-h") {
+				printUsage();
+				return 0;
+			}
+			if (args[i] == "--mock-broker" && load) {
+				mockBroker = true;
+				continue;
+			}
+			if (i + 1 >= args.size()) {
+				throw std::runtime_error("Missing value for " + args[i]);
+			}
+
+			const std::string& option = args[i];
+			const std::string& value = args[++i];
+			if (option == "--host") {
+				config.host = value;
+			} else if (option == "--port") {
+				config.port = static_cast<int>(parseCount(option, value));
+				brokerConfig.port = static_cast<uint16_t>(config.port);
+			} else if (option == "--log-level") {
+				pubsupp::Logger::global().setLevel(parseLogLevel(value));
+			} else if (option == "--latency-us" && mode != "" && mode != "publish") {
+				brokerConfig.latency = std::chrono::microseconds(parseCount(option, value));
+			} else if (option == "--topic" && (mode == "" || mode == "publish")) {
+				topic = value;
+			} else if (option == "--message" && mode == "publish") {
+				message = value;
+			} else if (option == "--qos" && mode == "publish") {
+				size_t level = parseCount(option, value);
+				if (level > 2) {
+					throw std::runtime_error("Invalid value for --qos: " + value);
+				}
+				qos = static_cast<pubsupp::QoS>(level);
+			} else if (option == "--client-id" && (mode == "" || mode == "publish")) {
+				clientId = value;
+			} else if (option == "--metrics-port" && mode == "") {
+				metricsPort = static_cast<int>(parseCount(option, value));
+			} else if (option == "--capture" && mode == "") {
+				capturePath = value;
+			} else if (option == "--speed" && mode == "replay") {
+				replaySpeed = std::stod(value);
+			} else if (load) {
+				parseLoadOption(config, option, value);
+			} else {
+				throw std::runtime_error("Unknown option: " + option);
+			}
+		}
+
+		if (mode == "broker") {
+			brokerConfig.bindAddress = config.host;
+			return runBroker(brokerConfig);
+		}
+		if (mode == "replay") {
+			if (replayPath.empty()) {
+				throw std::runtime_error("replay needs a capture file");
+			}
+			return replayCapture(replayPath, replaySpeed);
+		}
+		if (mode == "publish") {
+			if (topic == "#") {
+				throw std::runtime_error("publish needs a --topic");
+			}
+			return publishOnce(config.host, config.port, clientId.empty() ? defaultClientId() : clientId, topic, qos, message);
+		}
+		if (!load) {
+			return subscribeAndPrint(config.host, config.port, clientId.empty() ? defaultClientId() : clientId, topic, metricsPort, capturePath);
+		}
+
+		std::unique_ptr<pubsupp::MockBroker> broker;
+		if (mockBroker) {
+			brokerConfig.port = 0;
+			if (!pubsupp::unixSocketPath(config.host).empty()) {
+				brokerConfig.bindAddress = config.host; // --host unix://<path> runs it on that socket
+			}
+			broker = std::make_unique<pubsupp::MockBroker>(brokerConfig);
+			broker->start();
+			config.host = brokerConfig.bindAddress;
+			config.port = broker->port();
+		}
+
+		pubsupp::LoadGenerator generator(config);
+		pubsupp::LoadGenerator::printReport(generator.run(), std::cout);
 
 	} catch (const std::exception& e) {
 		std::cerr << "Error: " << e.what() << std::endl;
+		printUsage();
 		return 1;
 	}
 
@@ -22,6 +22,25 @@ namespace pubsupp {
 	}
 
 
+	static std::string decodeUTF8String(const std::vector<uint8_t>& data, size_t& offset) {
+		if (offset + 2 > data.size()) {
+			throw std::runtime_error("CONNECT message incomplete: missing string length");
+		}
+
+		uint16_t length = (data[offset] << 8) | data[offset + 1];
+		offset += 2;
+
+		if (offset + length > data.size()) {
+			throw std::runtime_error("CONNECT message incomplete: missing string data");
+		}
+
+		std::string result(data.begin() + offset, data.begin() + offset + length);
+		offset += length;
+
+		return result;
+	}
+
+
 
 
 
@@ -81,4 +100,65 @@ namespace pubsupp {
 
 		return buffer;
 	}
+
+
+	std::unique_ptr<MqttMessage> ConnectMessage::decode(const std::vector<uint8_t>& data) {
+		if (data.size() < 2) { throw std::runtime_error("CONNECT message too short"); }
+
+		uint8_t fixedHeader = data[0];
+		if ((fixedHeader >> 4) != static_cast<uint8_t>(MessageType::CONNECT)) {
+			throw std::runtime_error("Invalid CONNECT message type");
+		}
+
+		// decode remaining length
+		size_t remainingLengthStart = 1;
+		size_t remainingLengthEnd = remainingLengthStart;
+		while (remainingLengthEnd < data.size() && (data[remainingLengthEnd] & 128) != 0) {
+			remainingLengthEnd++;
+			if (remainingLengthEnd - remainingLengthStart > 4) {
+				throw std::runtime_error("Malformed CONNECT: remaining length exceeds 4 bytes");
+			}
+		}
+		if (remainingLengthEnd >= data.size()) { throw std::runtime_error("CONNECT message incomplete: missing remaining length"); }
+		remainingLengthEnd++; // include the last byte
+
+		std::vector<uint8_t> encodedLength(data.begin() + remainingLengthStart, data.begin() + remainingLengthEnd);
+		uint32_t remainingLength = this->decodeRemainingLength(encodedLength);
+		if (data.size() < remainingLengthEnd + remainingLength) {
+			throw std::runtime_error("CONNECT message incomplete: missing data");
+		}
+
+		// variable header: protocol name, level, flags, keep alive
+		size_t offset = remainingLengthEnd;
+		std::string protocolName = decodeUTF8String(data, offset);
+		if (protocolName != "MQTT") {
+			throw std::runtime_error("Unsupported protocol name: " + protocolName);
+		}
+		if (offset + 4 > data.size()) {
+			throw std::runtime_error("CONNECT message incomplete: missing variable header");
+		}
+		uint8_t protocolLevel = data[offset++];
+		if (protocolLevel != 0x04) {
+			throw std::runtime_error("Unsupported protocol level: " + std::to_string(protocolLevel));
+		}
+		ConnectFlags flags;
+		flags.decode(std::vector<uint8_t>{data[offset++]});
+		uint16_t keepAlive = (data[offset] << 8) | data[offset + 1];
+		offset += 2;
+
+		// payload: client id, then the optional fields in the order their flags appear (3.1.3)
+		std::string clientId = decodeUTF8String(data, offset);
+		if (flags.will) {
+			decodeUTF8String(data, offset); // will topic
+			decodeUTF8String(data, offset); // will message
+		}
+		if (flags.username) {
+			decodeUTF8String(data, offset);
+		}
+		if (flags.password) {
+			decodeUTF8String(data, offset);
+		}
+
+		return std::make_unique<ConnectMessage>(clientId, flags.cleanSession, keepAlive);
+	}
 }
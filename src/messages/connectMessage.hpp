@@ -18,8 +18,12 @@ namespace pubsupp {
 
 			std::vector<uint8_t> encode() const override;
 
-			// not necessary for connect message:
-			std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) override { return nullptr; };
+			// server side only (mock broker), will/username/password are skipped
+			std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) override;
+
+			const std::string& getClientId() const { return this->clientId; }
+			bool isCleanSession() const { return this->cleanSession; }
+			uint16_t getKeepAlive() const { return this->keepAlive; }
 
 
 		private:
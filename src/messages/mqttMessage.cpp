@@ -1,12 +1,17 @@
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "connackMessage.hpp"
 #include "connectMessage.hpp"
 #include "mqttMessage.hpp"
 #include "pubackMessage.hpp"
+#include "pubcompMessage.hpp"
+#include "pubrecMessage.hpp"
+#include "pubrelMessage.hpp"
 #include "publishMessage.hpp"
 #include "subackMessage.hpp"
 #include "subscribeMessage.hpp"
@@ -16,21 +21,32 @@
 
 namespace pubsupp {
 	std::vector<uint8_t> MqttMessage::encodeRemainingLength(uint32_t length) const {
-		std::vector<uint8_t> buffer;
-		uint32_t remainingLength = length;
+		uint8_t encoded[4];
+		size_t size = encodeRemainingLength(length, encoded);
+		return std::vector<uint8_t>(encoded, encoded + size);
+	}
+
+
+	size_t MqttMessage::encodeRemainingLength(size_t length, uint8_t* out) {
+		if (length > MAX_REMAINING_LENGTH) {
+			throw std::runtime_error("Remaining Length " + std::to_string(length) + " exceeds the maximum of " + std::to_string(MAX_REMAINING_LENGTH));
+		}
+
+		size_t remainingLength = length;
+		size_t size = 0;
 
 		do {
-			uint8_t byte = remainingLength % 128;
+			uint8_t byte = static_cast<uint8_t>(remainingLength % 128);
 			remainingLength /= 128;
 
 			if (remainingLength > 0) {
 				byte |= 128;
 			}
 
-			buffer.push_back(byte);
+			out[size++] = byte;
 		} while (remainingLength > 0);
 
-		return buffer;
+		return size;
 	}
 
 
@@ -58,6 +74,48 @@ namespace pubsupp {
 	}
 
 
+	uint32_t MqttMessage::decodeRemainingLength(const std::vector<uint8_t>& data, size_t& offset) {
+		uint32_t remainingLength = 0;
+		uint32_t multiplier = 1;
+		uint8_t byte;
+
+		do {
+			if (offset >= data.size()) {
+				throw std::runtime_error("Malformed Remaining Length: incomplete encoding");
+			}
+			if (multiplier > 128 * 128 * 128) {
+				throw std::runtime_error("Malformed Remaining Length: exceeds maximum");
+			}
+
+			byte = data[offset++];
+			remainingLength += (byte & 127) * multiplier;
+			multiplier *= 128;
+		} while ((byte & 128) != 0);
+
+		return remainingLength;
+	}
+
+
+	size_t MqttMessage::packetLength(const uint8_t* data, size_t available) {
+		uint32_t remainingLength = 0;
+		uint32_t multiplier = 1;
+
+		for (size_t i = 1; i <= 4; ++i) {
+			if (i >= available) {
+				return 0;
+			}
+			remainingLength += (data[i] & 127) * multiplier;
+			multiplier *= 128;
+
+			if ((data[i] & 128) == 0) {
+				size_t length = 1 + i + remainingLength;
+				return length <= available ? length : 0;
+			}
+		}
+		throw std::runtime_error("Malformed Remaining Length: exceeds maximum");
+	}
+
+
 
 
 
@@ -67,6 +125,17 @@ namespace pubsupp {
 	}
 
 
+	std::unique_ptr<MqttMessage> parseConnectMessage(const std::vector<uint8_t>& data) {
+		ConnectMessage connect;
+		return connect.decode(data);
+	}
+
+
+	std::unique_ptr<MqttMessage> createConnackMessage(bool sessionPresent, uint8_t returnCode) {
+		return std::make_unique<ConnackMessage>(sessionPresent, returnCode);
+	}
+
+
 	std::unique_ptr<MqttMessage> parseConnackMessage(const std::vector<uint8_t>& data) {
 		ConnackMessage connack;
 		return connack.decode(data);
@@ -78,23 +147,110 @@ namespace pubsupp {
 	}
 
 
+	std::unique_ptr<MqttMessage> parseSubscribeMessage(const std::vector<uint8_t>& data) {
+		SubscribeMessage subscribe("", QoS::AT_MOST_ONCE, 0);
+		return subscribe.decode(data);
+	}
+
+
+	std::unique_ptr<MqttMessage> createSubackMessage(uint16_t packetId, uint8_t returnCode) {
+		return std::make_unique<SubackMessage>(packetId, returnCode);
+	}
+
+
 	std::unique_ptr<MqttMessage> createPublishMessage(const std::string& topic, QoS qos, const std::string& payload, uint16_t packetId) {
 		return std::make_unique<PublishMessage>(topic, qos, payload, packetId);
 	}
 
 
+	std::unique_ptr<MqttMessage> parsePublishMessage(const std::vector<uint8_t>& data) {
+		PublishMessage publish;
+		return publish.decode(data);
+	}
+
+
 	std::unique_ptr<MqttMessage> parseSubackMessage(const std::vector<uint8_t>& data) {
 		SubackMessage suback;
 		return suback.decode(data);
 	}
 
 
+	std::unique_ptr<MqttMessage> createPubackMessage(uint16_t packetId) {
+		return std::make_unique<PubackMessage>(packetId);
+	}
+
+
 	std::unique_ptr<MqttMessage> parsePubackMessage(const std::vector<uint8_t>& data) {
 		PubackMessage puback;
 		return puback.decode(data);
 	}
 
 
+	std::unique_ptr<MqttMessage> createPubrecMessage(uint16_t packetId) {
+		return std::make_unique<PubrecMessage>(packetId);
+	}
+
+
+	std::unique_ptr<MqttMessage> parsePubrecMessage(const std::vector<uint8_t>& data) {
+		PubrecMessage pubrec;
+		return pubrec.decode(data);
+	}
+
+
+	std::unique_ptr<MqttMessage> createPubrelMessage(uint16_t packetId) {
+		return std::make_unique<PubrelMessage>(packetId);
+	}
+
+
+	std::unique_ptr<MqttMessage> parsePubrelMessage(const std::vector<uint8_t>& data) {
+		PubrelMessage pubrel;
+		return pubrel.decode(data);
+	}
+
+
+	std::unique_ptr<MqttMessage> createPubcompMessage(uint16_t packetId) {
+		return std::make_unique<PubcompMessage>(packetId);
+	}
+
+
+	std::unique_ptr<MqttMessage> parsePubcompMessage(const std::vector<uint8_t>& data) {
+		PubcompMessage pubcomp;
+		return pubcomp.decode(data);
+	}
+
+	std::array<uint8_t, 4> encodeAck(MessageType type, uint16_t packetId) {
+		uint8_t fixedHeader = static_cast<uint8_t>(type) << 4;
+		switch (type) {
+			case MessageType::PUBACK:
+			case MessageType::PUBREC:
+			case MessageType::PUBCOMP: break;
+			case MessageType::PUBREL: fixedHeader |= 0x02; break; // reserved bits
+			default: throw std::runtime_error("Not an acknowledgement type: " + std::to_string(static_cast<int>(type)));
+		}
+
+		// remaining length is always 2: the packet id, big-endian
+		return {fixedHeader, 2, static_cast<uint8_t>(packetId >> 8), static_cast<uint8_t>(packetId & 0xFF)};
+	}
+
+
+	uint16_t decodeAckPacketId(MessageType type, const std::vector<uint8_t>& data) {
+		if (data.size() < 2 || (data[0] >> 4) != static_cast<uint8_t>(type)) {
+			throw std::runtime_error("Invalid acknowledgement: expected message type " + std::to_string(static_cast<int>(type)));
+		}
+
+		size_t offset = 1;
+		uint32_t remainingLength = MqttMessage::decodeRemainingLength(data, offset);
+		if (remainingLength != 2) {
+			throw std::runtime_error("Invalid acknowledgement remaining length: expected 2, got " + std::to_string(remainingLength));
+		}
+		if (data.size() < offset + 2) {
+			throw std::runtime_error("Acknowledgement incomplete: missing packet id");
+		}
+
+		return static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+	}
+
+
 
 	// ConnackMessageHelper implementations
 	bool ConnackMessageHelper::isSuccess(const MqttMessage& msg) {
@@ -87,6 +87,16 @@ namespace pubsupp {
 		virtual std::vector<uint8_t> encode() const = 0;
 		virtual std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) = 0;
 
+		// largest remaining length four bytes can encode (2.2.3)
+		static constexpr size_t MAX_REMAINING_LENGTH = 268435455;
+
+		// remaining length into `out` (room for 4 bytes), returns the number of bytes written; throws above MAX_REMAINING_LENGTH
+		static size_t encodeRemainingLength(size_t length, uint8_t* out);
+		// from the bytes following the fixed header byte, `offset` ends up behind the last length byte
+		static uint32_t decodeRemainingLength(const std::vector<uint8_t>& data, size_t& offset);
+		// length of the packet starting at `data`, 0 while fewer than that are `available`
+		static size_t packetLength(const uint8_t* data, size_t available);
+
 	  protected:
 		// see: https://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718023
 		std::vector<uint8_t> encodeRemainingLength(uint32_t length) const;
@@ -97,11 +107,27 @@ namespace pubsupp {
 
 	// factory functions for creating mqtt msgs
 	std::unique_ptr<MqttMessage> createConnectMessage(const std::string& clientId = "", bool cleanSession = true, uint16_t keepAlive = 60);
+	std::unique_ptr<MqttMessage> parseConnectMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createConnackMessage(bool sessionPresent, uint8_t returnCode);
 	std::unique_ptr<MqttMessage> parseConnackMessage(const std::vector<uint8_t>& data);
 	std::unique_ptr<MqttMessage> createSubscribeMessage(const std::string& topic, QoS qos, uint16_t packetId);
+	std::unique_ptr<MqttMessage> parseSubscribeMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createSubackMessage(uint16_t packetId, uint8_t returnCode);
 	std::unique_ptr<MqttMessage> parseSubackMessage(const std::vector<uint8_t>& data);
 	std::unique_ptr<MqttMessage> createPublishMessage(const std::string& topic, QoS qos, const std::string& payload, uint16_t packetId);
+	std::unique_ptr<MqttMessage> parsePublishMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createPubackMessage(uint16_t packetId);
 	std::unique_ptr<MqttMessage> parsePubackMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createPubrecMessage(uint16_t packetId);
+	std::unique_ptr<MqttMessage> parsePubrecMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createPubrelMessage(uint16_t packetId);
+	std::unique_ptr<MqttMessage> parsePubrelMessage(const std::vector<uint8_t>& data);
+	std::unique_ptr<MqttMessage> createPubcompMessage(uint16_t packetId);
+	std::unique_ptr<MqttMessage> parsePubcompMessage(const std::vector<uint8_t>& data);
+
+	// PUBACK, PUBREC, PUBREL and PUBCOMP without a message object in between, nothing is allocated
+	std::array<uint8_t, 4> encodeAck(MessageType type, uint16_t packetId);
+	uint16_t decodeAckPacketId(MessageType type, const std::vector<uint8_t>& data);
 
 
 
@@ -1,4 +1,6 @@
 #include "publishMessage.hpp"
+#include <algorithm>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <stdexcept>
@@ -7,23 +9,8 @@
 
 
 namespace pubsupp {
-	static std::vector<uint8_t> encodeUTF8String(const std::string& str) {
-		std::vector<uint8_t> result;
-		uint16_t length = static_cast<uint16_t>(str.length());
-
-		// big-endian
-		result.push_back((length >> 8) & 0xFF);
-		result.push_back(length & 0xFF);
-
-		for (char c : str) {
-			result.push_back(static_cast<uint8_t>(c));
-		}
-
-		return result;
-	}
-
-
-	static std::string decodeUTF8String(const std::vector<uint8_t>& data, size_t& offset) {
+	// UTF-8 string (1.5.3): big-endian length, then the bytes, returns them without copying
+	static std::string_view decodeUTF8String(const std::vector<uint8_t>& data, size_t& offset) {
 		if (offset + 2 > data.size()) {
 			throw std::runtime_error("PUBLISH message incomplete: missing topic length");
 		}
@@ -35,7 +22,7 @@ namespace pubsupp {
 			throw std::runtime_error("PUBLISH message incomplete: missing topic data");
 		}
 
-		std::string result(data.begin() + offset, data.begin() + offset + length);
+		std::string_view result(reinterpret_cast<const char*>(data.data() + offset), length);
 		offset += length;
 
 		return result;
@@ -61,41 +48,51 @@ namespace pubsupp {
 
 	std::vector<uint8_t> PublishMessage::encode() const {
 		std::vector<uint8_t> buffer;
+		encode(buffer, this->topic, this->qos, this->payload, this->packetId, this->dup, this->retain);
+		return buffer;
+	}
+
 
+	void PublishMessage::encode(std::vector<uint8_t>& out, std::string_view topic, QoS qos, std::string_view payload, uint16_t packetId, bool dup, bool retain) {
 		// fixed header: Message type (3) << 4 | flags
 		uint8_t fixedHeader = static_cast<uint8_t>(MessageType::PUBLISH) << 4;
-		fixedHeader |= (this->dup ? 0x08 : 0x00); // DUP flag (bit 3)
-		fixedHeader |= (static_cast<uint8_t>(this->qos) << 1); // QoS (bits 2-1)
-		fixedHeader |= (this->retain ? 0x01 : 0x00); // RETAIN flag (bit 0)
-		buffer.push_back(fixedHeader);
-
-		// variable header: Topic name (UTF-8 string)
-		std::vector<uint8_t> variableHeader = encodeUTF8String(this->topic);
-
-		// Packet ID (only if QoS > 0)
-		if (static_cast<uint8_t>(this->qos) > 0) {
-			variableHeader.push_back((this->packetId >> 8) & 0xFF);
-			variableHeader.push_back(this->packetId & 0xFF);
-		}
-
-		// remaining length
-		uint32_t remainingLength = variableHeader.size() + this->payload.size();
-		auto encodedRemainingLength = this->encodeRemainingLength(remainingLength);
-		buffer.insert(buffer.end(), encodedRemainingLength.begin(), encodedRemainingLength.end());
-
-		// append variable header
-		buffer.insert(buffer.end(), variableHeader.begin(), variableHeader.end());
+		fixedHeader |= (dup ? 0x08 : 0x00); // DUP flag (bit 3)
+		fixedHeader |= (static_cast<uint8_t>(qos) << 1); // QoS (bits 2-1)
+		fixedHeader |= (retain ? 0x01 : 0x00); // RETAIN flag (bit 0)
+
+		// variable header: topic name (UTF-8 string), packet ID only if QoS > 0
+		size_t variableHeaderLength = 2 + topic.size() + (static_cast<uint8_t>(qos) > 0 ? 2 : 0);
+		uint8_t encodedRemainingLength[4];
+		size_t lengthBytes = encodeRemainingLength(variableHeaderLength + payload.size(), encodedRemainingLength);
+
+		// sized once, then written in place
+		out.resize(1 + lengthBytes + variableHeaderLength + payload.size());
+		uint8_t* cursor = out.data();
+		*cursor++ = fixedHeader;
+		cursor = std::copy_n(encodedRemainingLength, lengthBytes, cursor);
+
+		uint16_t topicLength = static_cast<uint16_t>(topic.size());
+		*cursor++ = (topicLength >> 8) & 0xFF; // big-endian
+		*cursor++ = topicLength & 0xFF;
+		cursor = std::copy(topic.begin(), topic.end(), cursor);
 
-		// append payload
-		for (char c : this->payload) {
-			buffer.push_back(static_cast<uint8_t>(c));
+		if (static_cast<uint8_t>(qos) > 0) {
+			*cursor++ = (packetId >> 8) & 0xFF;
+			*cursor++ = packetId & 0xFF;
 		}
 
-		return buffer;
+		std::copy(payload.begin(), payload.end(), cursor);
 	}
 
 
 	std::unique_ptr<MqttMessage> PublishMessage::decode(const std::vector<uint8_t>& data) {
+		auto publishMsg = std::make_unique<PublishMessage>();
+		publishMsg->decodeInPlace(data);
+		return publishMsg;
+	}
+
+
+	void PublishMessage::decodeInPlace(const std::vector<uint8_t>& data) {
 		if (data.size() < 2) {
 			throw std::runtime_error("PUBLISH message too short");
 		}
@@ -111,31 +108,17 @@ namespace pubsupp {
 		bool retain = (fixedHeader & 0x01) != 0;
 
 		// decode remaining length
-		size_t remainingLengthStart = 1;
-		size_t remainingLengthEnd = remainingLengthStart;
-		while (remainingLengthEnd < data.size() && (data[remainingLengthEnd] & 128) != 0) {
-			remainingLengthEnd++;
-			if (remainingLengthEnd - remainingLengthStart > 4) {
-				throw std::runtime_error("Malformed PUBLISH: remaining length exceeds 4 bytes");
-			}
-		}
-		if (remainingLengthEnd >= data.size()) {
-			throw std::runtime_error("PUBLISH message incomplete: missing remaining length");
-		}
-		remainingLengthEnd++; // include the last byte
-
-		std::vector<uint8_t> encodedLength(data.begin() + remainingLengthStart, data.begin() + remainingLengthEnd);
-		uint32_t remainingLength = this->decodeRemainingLength(encodedLength);
+		size_t variableHeaderStart = 1;
+		uint32_t remainingLength = decodeRemainingLength(data, variableHeaderStart);
 
 		// verify enough data is present
-		size_t variableHeaderStart = remainingLengthEnd;
 		if (data.size() < variableHeaderStart + remainingLength) {
 			throw std::runtime_error("PUBLISH message incomplete: missing data");
 		}
 
 		// decode topic name
 		size_t offset = variableHeaderStart;
-		std::string topic = decodeUTF8String(data, offset);
+		std::string_view topic = decodeUTF8String(data, offset);
 
 		// decode packet ID (only if QoS > 0)
 		uint16_t packetId = 0;
@@ -148,18 +131,25 @@ namespace pubsupp {
 		}
 
 		// decode payload
+		size_t consumed = offset - variableHeaderStart;
+		if (consumed > remainingLength) {
+			throw std::runtime_error("Malformed PUBLISH: variable header exceeds remaining length");
+		}
 		size_t payloadStart = offset;
-		size_t payloadLength = remainingLength - (offset - variableHeaderStart);
-		std::string payload(data.begin() + payloadStart, data.begin() + payloadStart + payloadLength);
-
-		auto publishMsg = std::make_unique<PublishMessage>(topic, qos, payload, packetId, dup, retain);
-		return publishMsg;
+		size_t payloadLength = remainingLength - consumed;
+
+		this->topic.assign(topic);
+		this->payload.assign(reinterpret_cast<const char*>(data.data() + payloadStart), payloadLength);
+		this->qos = qos;
+		this->packetId = packetId;
+		this->dup = dup;
+		this->retain = retain;
 	}
 
 
-	std::string PublishMessage::getTopic() const { return topic; }
+	const std::string& PublishMessage::getTopic() const { return topic; }
 	QoS PublishMessage::getQoS() const { return qos; }
-	std::string PublishMessage::getPayload() const { return payload; }
+	const std::string& PublishMessage::getPayload() const { return payload; }
 	uint16_t PublishMessage::getPacketId() const { return packetId; }
 	bool PublishMessage::isDup() const { return dup; }
 	bool PublishMessage::isRetain() const { return retain; }
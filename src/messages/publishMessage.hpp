@@ -2,6 +2,7 @@
 
 #include "mqttMessage.hpp"
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 #include <memory>
@@ -18,9 +19,14 @@ namespace pubsupp {
         std::vector<uint8_t> encode() const override;
         std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) override;
 
-        std::string getTopic() const;
+        // encode into `out`, replacing its contents: a buffer reused across calls stops allocating once it is large enough
+        static void encode(std::vector<uint8_t>& out, std::string_view topic, QoS qos, std::string_view payload, uint16_t packetId, bool dup = false, bool retain = false);
+        // decode into this message, topic and payload keep their capacity for the next one
+        void decodeInPlace(const std::vector<uint8_t>& data);
+
+        const std::string& getTopic() const;
         QoS getQoS() const;
-        std::string getPayload() const;
+        const std::string& getPayload() const;
         uint16_t getPacketId() const;
         bool isDup() const;
         bool isRetain() const;
@@ -1,6 +1,7 @@
 #include "subscribeMessage.hpp"
 #include <vector>
 #include <cstdint>
+#include <stdexcept>
 
 
 
@@ -54,4 +55,53 @@ namespace pubsupp {
 
 		return buffer;
 	}
+
+
+	std::unique_ptr<MqttMessage> SubscribeMessage::decode(const std::vector<uint8_t>& data) {
+		if (data.size() < 2) { throw std::runtime_error("SUBSCRIBE message too short"); }
+
+		uint8_t fixedHeader = data[0];
+		if ((fixedHeader >> 4) != static_cast<uint8_t>(MessageType::SUBSCRIBE)) {
+			throw std::runtime_error("Invalid SUBSCRIBE message type");
+		}
+
+		// decode remaining length
+		size_t remainingLengthStart = 1;
+		size_t remainingLengthEnd = remainingLengthStart;
+		while (remainingLengthEnd < data.size() && (data[remainingLengthEnd] & 128) != 0) {
+			remainingLengthEnd++;
+			if (remainingLengthEnd - remainingLengthStart > 4) {
+				throw std::runtime_error("Malformed SUBSCRIBE: remaining length exceeds 4 bytes");
+			}
+		}
+		if (remainingLengthEnd >= data.size()) { throw std::runtime_error("SUBSCRIBE message incomplete: missing remaining length"); }
+		remainingLengthEnd++; // include the last byte
+
+		std::vector<uint8_t> encodedLength(data.begin() + remainingLengthStart, data.begin() + remainingLengthEnd);
+		uint32_t remainingLength = this->decodeRemainingLength(encodedLength);
+
+		// packet id (2) + filter length (2) + at least one filter byte + requested QoS (1)
+		size_t offset = remainingLengthEnd;
+		if (remainingLength < 6 || data.size() < offset + remainingLength) {
+			throw std::runtime_error("SUBSCRIBE message incomplete: missing data");
+		}
+
+		uint16_t packetId = (data[offset] << 8) | data[offset + 1];
+		offset += 2;
+
+		uint16_t topicLength = (data[offset] << 8) | data[offset + 1];
+		offset += 2;
+		if (offset + topicLength + 1 > data.size()) {
+			throw std::runtime_error("SUBSCRIBE message incomplete: missing topic filter");
+		}
+		std::string topic(data.begin() + offset, data.begin() + offset + topicLength);
+		offset += topicLength;
+
+		uint8_t qos = data[offset] & 0x03;
+		if (qos > 2) {
+			throw std::runtime_error("Invalid SUBSCRIBE QoS: " + std::to_string(qos));
+		}
+
+		return std::make_unique<SubscribeMessage>(topic, static_cast<QoS>(qos), packetId);
+	}
 }
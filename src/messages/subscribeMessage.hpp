@@ -17,8 +17,12 @@ namespace pubsupp {
 
 			std::vector<uint8_t> encode() const override;
 
-			// not necessary for subscribe message:
-			std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) override { return nullptr; };
+			// server side only (mock broker): reads the first topic filter, like encode() writes exactly one
+			std::unique_ptr<MqttMessage> decode(const std::vector<uint8_t>& data) override;
+
+			const std::string& getTopic() const { return this->topic; }
+			QoS getQoS() const { return this->qos; }
+			uint16_t getPacketId() const { return this->packetId; }
 
 
 		private:
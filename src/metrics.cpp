@@ -0,0 +1,288 @@
+#include "metrics.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+#include "allocationTracker.hpp"
+#include "logger.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		std::atomic<uint64_t> nextMetricsId = 1;
+
+		const char* typeName(size_t type) {
+			static constexpr const char* names[MetricsSnapshot::TYPES] = {"reserved", "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+																		  "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "reserved15"};
+			return names[type];
+		}
+
+
+		// label values have to escape backslash, quote and newline
+		std::string escapeLabel(const std::string& value) {
+			std::string escaped;
+			for (char c : value) {
+				if (c == '\\' || c == '"') {
+					escaped += '\\';
+					escaped += c;
+				} else if (c == '\n') {
+					escaped += "\\n";
+				} else {
+					escaped += c;
+				}
+			}
+			return escaped;
+		}
+	} // namespace
+
+
+	void MetricsSnapshot::merge(const MetricsSnapshot& other) {
+		for (size_t i = 0; i < TYPES; ++i) {
+			this->packetsIn[i] += other.packetsIn[i];
+			this->bytesIn[i] += other.bytesIn[i];
+			this->packetsOut[i] += other.packetsOut[i];
+			this->bytesOut[i] += other.bytesOut[i];
+		}
+		for (size_t i = 0; i < this->counters.size(); ++i) {
+			this->counters[i] += other.counters[i];
+		}
+		this->inflight += other.inflight;
+	}
+
+
+	void writePrometheus(std::ostream& out, const std::vector<std::pair<std::string, MetricsSnapshot>>& snapshots) {
+		// one metric family per per-type array, only types that were seen get a sample
+		auto perType = [&](const char* name, const char* help, std::array<uint64_t, MetricsSnapshot::TYPES> MetricsSnapshot::*values) {
+			out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+			for (const auto& [client, snapshot] : snapshots) {
+				for (size_t type = 0; type < MetricsSnapshot::TYPES; ++type) {
+					if ((snapshot.*values)[type] != 0) {
+						out << name << "{client=\"" << escapeLabel(client) << "\",type=\"" << typeName(type) << "\"} " << (snapshot.*values)[type] << "\n";
+					}
+				}
+			}
+		};
+		perType("pubsupp_packets_received_total", "MQTT packets received, by packet type.", &MetricsSnapshot::packetsIn);
+		perType("pubsupp_bytes_received_total", "Bytes of MQTT packets received, by packet type.", &MetricsSnapshot::bytesIn);
+		perType("pubsupp_packets_sent_total", "MQTT packets sent, by packet type.", &MetricsSnapshot::packetsOut);
+		perType("pubsupp_bytes_sent_total", "Bytes of MQTT packets sent, by packet type.", &MetricsSnapshot::bytesOut);
+
+		auto counter = [&](const char* name, const char* help, Counter which) {
+			out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+			for (const auto& [client, snapshot] : snapshots) {
+				out << name << "{client=\"" << escapeLabel(client) << "\"} " << snapshot[which] << "\n";
+			}
+		};
+		counter("pubsupp_send_calls_total", "send() system calls.", Counter::SEND_CALLS);
+		counter("pubsupp_recv_calls_total", "recv() system calls.", Counter::RECV_CALLS);
+		counter("pubsupp_partial_writes_total", "send() calls that wrote only part of the buffer.", Counter::PARTIAL_WRITES);
+		counter("pubsupp_reconnects_total", "Successful reconnects after a lost connection.", Counter::RECONNECTS);
+		counter("pubsupp_decode_errors_total", "Inbound packets that could not be decoded or handled.", Counter::DECODE_ERRORS);
+
+		out << "# HELP pubsupp_inflight_messages QoS 1/2 publishes waiting for their acknowledgement.\n# TYPE pubsupp_inflight_messages gauge\n";
+		for (const auto& [client, snapshot] : snapshots) {
+			out << "pubsupp_inflight_messages{client=\"" << escapeLabel(client) << "\"} " << snapshot.inflight << "\n";
+		}
+
+		if (allocationTrackingEnabled()) {
+			out << "# HELP pubsupp_allocations_total Heap allocations of the process.\n# TYPE pubsupp_allocations_total counter\n";
+			out << "pubsupp_allocations_total " << allocationCount() << "\n";
+		}
+	}
+
+
+
+
+
+	Metrics::Metrics() : id(nextMetricsId.fetch_add(1, std::memory_order_relaxed)) {}
+
+
+	Metrics::~Metrics() = default;
+
+
+	Metrics::Slot& Metrics::slot() {
+		struct CacheEntry {
+			uint64_t owner = 0;
+			Slot* slot = nullptr;
+		};
+		thread_local std::array<CacheEntry, 4> cache;
+		thread_local size_t nextVictim = 0;
+
+		for (const CacheEntry& entry : cache) {
+			if (entry.owner == this->id) {
+				return *entry.slot;
+			}
+		}
+
+		Slot& slot = this->registerThread();
+		cache[nextVictim] = {this->id, &slot};
+		nextVictim = (nextVictim + 1) % cache.size();
+		return slot;
+	}
+
+
+	// first count of this thread (or it fell out of the cache), find or create its slot
+	Metrics::Slot& Metrics::registerThread() {
+		std::thread::id self = std::this_thread::get_id();
+		std::lock_guard lock(this->mutex);
+
+		for (auto& [owner, slot] : this->slots) {
+			if (owner == self) {
+				return *slot;
+			}
+		}
+		this->slots.emplace_back(self, std::make_unique<Slot>());
+		return *this->slots.back().second;
+	}
+
+
+	MetricsSnapshot Metrics::snapshot() const {
+		MetricsSnapshot snapshot;
+		std::lock_guard lock(this->mutex);
+
+		for (const auto& [owner, slot] : this->slots) {
+			auto value = [&slot](size_t index) { return slot->values[index].load(std::memory_order_relaxed); };
+
+			for (size_t i = 0; i < snapshot.counters.size(); ++i) {
+				snapshot.counters[i] += value(i);
+			}
+			for (size_t type = 0; type < TYPES; ++type) {
+				snapshot.packetsIn[type] += value(PACKETS_IN + type);
+				snapshot.bytesIn[type] += value(BYTES_IN + type);
+				snapshot.packetsOut[type] += value(PACKETS_OUT + type);
+				snapshot.bytesOut[type] += value(BYTES_OUT + type);
+			}
+		}
+		snapshot.inflight = this->inflight.load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+
+
+
+
+	MetricsExporter::MetricsExporter(Source source) : source(std::move(source)) {}
+
+
+	MetricsExporter::~MetricsExporter() { this->stop(); }
+
+
+	void MetricsExporter::writeFile(const std::string& path) const {
+		std::string temporary = path + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::trunc);
+			if (!file) {
+				throw std::runtime_error("Failed to open metrics file: " + temporary);
+			}
+			file << this->source();
+			if (!file.flush()) {
+				throw std::runtime_error("Failed to write metrics file: " + temporary);
+			}
+		}
+
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			throw std::runtime_error("Failed to replace metrics file " + path + ": " + std::strerror(errno));
+		}
+	}
+
+
+	void MetricsExporter::serve(const std::string& bindAddress, uint16_t port) {
+		if (this->thread.joinable()) {
+			throw std::runtime_error("Metrics exporter already serving");
+		}
+
+		this->listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (this->listenFd < 0) {
+			throw std::runtime_error("Failed to create metrics socket");
+		}
+		int reuse = 1;
+		::setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		if (::inet_pton(AF_INET, bindAddress.c_str(), &address.sin_addr) != 1 || ::bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+			::listen(this->listenFd, 16) < 0) {
+			::close(this->listenFd);
+			this->listenFd = -1;
+			throw std::runtime_error("Failed to serve metrics on " + bindAddress + ":" + std::to_string(port));
+		}
+
+		socklen_t length = sizeof(address);
+		::getsockname(this->listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+		this->boundPort = ntohs(address.sin_port);
+
+		this->thread = std::thread([this]() { this->acceptLoop(); });
+	}
+
+
+	void MetricsExporter::stop() {
+		if (!this->thread.joinable()) {
+			return;
+		}
+		this->notifier.notify();
+		this->thread.join();
+		::close(this->listenFd);
+		this->listenFd = -1;
+	}
+
+
+	// one scrape per connection: read whatever request came in, answer, close
+	void MetricsExporter::acceptLoop() {
+		while (true) {
+			pollfd fds[2] = {{this->listenFd, POLLIN, 0}, {this->notifier.fd(), POLLIN, 0}};
+			if (::poll(fds, 2, -1) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return;
+			}
+			if (fds[1].revents & POLLIN) {
+				this->notifier.drain();
+				return;
+			}
+
+			int fd = ::accept(this->listenFd, nullptr, nullptr);
+			if (fd < 0) {
+				continue;
+			}
+
+			pollfd request = {fd, POLLIN, 0};
+			char buffer[1024];
+			if (::poll(&request, 1, 1000) > 0) {
+				::recv(fd, buffer, sizeof(buffer), 0);
+			}
+
+			std::string body;
+			try {
+				body = this->source();
+			} catch (const std::exception& e) {
+				PUBSUPP_LOG_ERROR("Failed to collect metrics: " << e.what());
+			}
+			std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+			size_t sent = 0;
+			while (sent < response.size()) {
+				ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) {
+					break;
+				}
+				sent += static_cast<size_t>(n);
+			}
+			::close(fd);
+		}
+	}
+
+} // namespace pubsupp
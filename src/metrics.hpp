@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+#include "messages/mqttMessage.hpp"
+#include "notifier.hpp"
+
+
+
+namespace pubsupp {
+
+	enum class Counter : uint8_t {
+		SEND_CALLS, // send() syscalls
+		RECV_CALLS, // recv() syscalls
+		PARTIAL_WRITES, // send() calls that took only part of the buffer
+		RECONNECTS,
+		DECODE_ERRORS, // inbound frames that could not be decoded or handled
+		COUNT
+	};
+
+
+	// totals of one connection (or several, merged)
+	struct MetricsSnapshot {
+		static constexpr size_t TYPES = 16; // indexed by MessageType
+
+		std::array<uint64_t, TYPES> packetsIn{};
+		std::array<uint64_t, TYPES> bytesIn{};
+		std::array<uint64_t, TYPES> packetsOut{};
+		std::array<uint64_t, TYPES> bytesOut{};
+		std::array<uint64_t, static_cast<size_t>(Counter::COUNT)> counters{};
+		int64_t inflight = 0; // QoS 1/2 publishes waiting for their ack
+
+		uint64_t operator[](Counter counter) const { return this->counters[static_cast<size_t>(counter)]; }
+		void merge(const MetricsSnapshot& other);
+	};
+
+
+	// Prometheus text exposition of `snapshots`, labelled client="<name>", plus the process wide allocation count
+	void writePrometheus(std::ostream& out, const std::vector<std::pair<std::string, MetricsSnapshot>>& snapshots);
+
+
+
+	/*
+	 * Counters of one connection, cheap enough for every packet.
+	 *
+	 * Each thread that counts gets a slot of its own (cache-line aligned, found through a small
+	 * thread-local cache), and only ever writes its own slot: an increment is a relaxed load and store,
+	 * no locked instruction and no shared cache line. snapshot() sums the slots on demand,
+	 * from any thread, and may be a few increments behind.
+	 */
+	class Metrics {
+	  public:
+		Metrics();
+		~Metrics();
+
+		Metrics(const Metrics&) = delete;
+		Metrics& operator=(const Metrics&) = delete;
+
+		void add(Counter counter, uint64_t n = 1) { this->bump(static_cast<size_t>(counter), n); }
+		void packetIn(uint8_t header, size_t bytes) { this->packet(PACKETS_IN, header, bytes); }
+		void packetOut(uint8_t header, size_t bytes) { this->packet(PACKETS_OUT, header, bytes); }
+		void setInflight(int64_t depth) { this->inflight.store(depth, std::memory_order_relaxed); }
+
+		MetricsSnapshot snapshot() const;
+
+	  private:
+		static constexpr size_t TYPES = MetricsSnapshot::TYPES;
+		static constexpr size_t PACKETS_IN = static_cast<size_t>(Counter::COUNT);
+		static constexpr size_t BYTES_IN = PACKETS_IN + TYPES;
+		static constexpr size_t PACKETS_OUT = BYTES_IN + TYPES;
+		static constexpr size_t BYTES_OUT = PACKETS_OUT + TYPES;
+		static constexpr size_t VALUES = BYTES_OUT + TYPES;
+
+		struct alignas(64) Slot {
+			std::array<std::atomic<uint64_t>, VALUES> values{};
+		};
+
+		void packet(size_t base, uint8_t header, size_t bytes) {
+			Slot& slot = this->slot();
+			size_t type = header >> 4;
+			increment(slot.values[base + type], 1);
+			increment(slot.values[base + TYPES + type], bytes);
+		}
+
+		void bump(size_t index, uint64_t n) { increment(this->slot().values[index], n); }
+
+		// single writer per slot, so no read-modify-write instruction needed
+		static void increment(std::atomic<uint64_t>& value, uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+		Slot& slot();
+		Slot& registerThread();
+
+		uint64_t id; // never reused, unlike addresses, so thread-local caches cannot go stale
+		mutable std::mutex mutex;
+		std::vector<std::pair<std::thread::id, std::unique_ptr<Slot>>> slots;
+		std::atomic<int64_t> inflight = 0;
+	};
+
+
+
+	/*
+	 * Publishes Prometheus text produced by `source`: written to a file (atomically, via rename, as the
+	 * node exporter textfile collector expects) or served over HTTP to whoever connects to a local port.
+	 */
+	class MetricsExporter {
+	  public:
+		using Source = std::function<std::string()>;
+
+		explicit MetricsExporter(Source source);
+		~MetricsExporter();
+
+		MetricsExporter(const MetricsExporter&) = delete;
+		MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+		void writeFile(const std::string& path) const;
+		// answer every request on bindAddress:port (0 picks a free one) with the current metrics
+		void serve(const std::string& bindAddress, uint16_t port);
+		void stop();
+		uint16_t port() const { return this->boundPort; }
+
+	  private:
+		void acceptLoop();
+
+		Source source;
+		int listenFd = -1;
+		uint16_t boundPort = 0;
+		Notifier notifier;
+		std::thread thread;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,445 @@
+#include "mockBroker.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+
+#include "logger.hpp"
+#include "messages/connectMessage.hpp"
+#include "messages/subscribeMessage.hpp"
+#include "tcpClient.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		// read per connection and loop iteration, so one busy publisher can't hold up the writes of everyone else
+		constexpr size_t MAX_READ_PER_ITERATION = 256 * 1024;
+
+
+		uint16_t packetIdOf(std::span<const uint8_t> frame) {
+			if (frame.size() < 4) {
+				throw std::runtime_error("Frame too short for a packet id");
+			}
+			return (frame[2] << 8) | frame[3];
+		}
+
+
+		void setNonBlocking(int fd) {
+			int flags = fcntl(fd, F_GETFL, 0);
+			if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+				throw std::runtime_error("Failed to make socket non-blocking: " + std::string(std::strerror(errno)));
+			}
+		}
+	} // namespace
+
+
+
+	MockBroker::MockBroker(MockBrokerConfig config) : config(std::move(config)) {
+		std::string path = unixSocketPath(this->config.bindAddress);
+		this->listenFd = socket(path.empty() ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+		if (this->listenFd < 0) {
+			throw std::runtime_error("Failed to create listening socket: " + std::string(std::strerror(errno)));
+		}
+
+		if (!path.empty()) {
+			sockaddr_un address{};
+			if (path.size() >= sizeof(address.sun_path)) {
+				::close(this->listenFd);
+				throw std::runtime_error("Unix socket path too long: " + path);
+			}
+			address.sun_family = AF_UNIX;
+			std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+			::unlink(path.c_str()); // left behind by an earlier run
+			if (bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(this->listenFd, 128) < 0) {
+				std::string error = std::strerror(errno);
+				::close(this->listenFd);
+				throw std::runtime_error("Failed to listen on " + this->config.bindAddress + ": " + error);
+			}
+			setNonBlocking(this->listenFd);
+			this->socketPath = path;
+			return;
+		}
+
+		int reuse = 1;
+		setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(this->config.port);
+		if (inet_pton(AF_INET, this->config.bindAddress.c_str(), &address.sin_addr) != 1) {
+			::close(this->listenFd);
+			throw std::runtime_error("Invalid bind address: " + this->config.bindAddress);
+		}
+
+		if (bind(this->listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(this->listenFd, 128) < 0) {
+			std::string error = std::strerror(errno);
+			::close(this->listenFd);
+			throw std::runtime_error("Failed to listen on " + this->config.bindAddress + ":" + std::to_string(this->config.port) + ": " + error);
+		}
+		setNonBlocking(this->listenFd);
+
+		socklen_t length = sizeof(address);
+		getsockname(this->listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+		this->boundPort = ntohs(address.sin_port);
+	}
+
+
+	MockBroker::~MockBroker() {
+		this->stop();
+
+		for (auto& [id, connection] : this->connections) {
+			::close(connection->fd);
+		}
+		::close(this->listenFd);
+		if (!this->socketPath.empty()) {
+			::unlink(this->socketPath.c_str());
+		}
+	}
+
+
+	void MockBroker::start() {
+		if (this->thread.joinable()) {
+			throw std::runtime_error("Broker thread already running");
+		}
+		this->stopRequested = false;
+		this->thread = std::thread([this]() { this->run(); });
+	}
+
+
+	void MockBroker::stop() {
+		this->stopRequested = true;
+		this->notifier.notify();
+
+		if (this->thread.joinable() && this->thread.get_id() != std::this_thread::get_id()) {
+			this->thread.join();
+		}
+	}
+
+
+	void MockBroker::run() {
+		std::vector<pollfd> fds;
+		std::vector<uint64_t> ids;
+
+		while (!this->stopRequested) {
+			fds.clear();
+			ids.clear();
+			fds.push_back({this->listenFd, POLLIN, 0});
+			fds.push_back({this->notifier.fd(), POLLIN, 0});
+
+			auto now = Clock::now();
+			for (auto& [id, connection] : this->connections) {
+				bool writable = !connection->out.empty() && connection->out.front().due <= now;
+				fds.push_back({connection->fd, static_cast<short>(POLLIN | (writable ? POLLOUT : 0)), 0});
+				ids.push_back(id);
+			}
+
+			// sleep until the next delayed frame is due at the latest
+			timespec timeout{};
+			timespec* timeoutPtr = nullptr;
+			Clock::time_point due;
+			if (this->nextDue(due)) {
+				auto wait = std::max(Clock::duration::zero(), due - now);
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+				timeout.tv_sec = ns / 1000000000;
+				timeout.tv_nsec = ns % 1000000000;
+				timeoutPtr = &timeout;
+			}
+
+			if (ppoll(fds.data(), fds.size(), timeoutPtr, nullptr) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::runtime_error("Broker poll failed: " + std::string(std::strerror(errno)));
+			}
+
+			if (fds[1].revents & POLLIN) {
+				this->notifier.drain();
+			}
+			if (fds[0].revents & POLLIN) {
+				this->acceptConnections();
+			}
+
+			for (size_t i = 0; i < ids.size(); ++i) {
+				auto it = this->connections.find(ids[i]);
+				if (it == this->connections.end()) {
+					continue;
+				}
+				Connection& connection = *it->second;
+				short revents = fds[i + 2].revents;
+
+				bool open = true;
+				try {
+					if (revents & (POLLIN | POLLHUP | POLLERR)) {
+						open = this->readFrom(connection);
+						// frames of this read, in order, consumed from the front and compacted once
+						size_t offset = 0;
+						size_t length;
+						while (open && !connection.closing &&
+							   (length = MqttMessage::packetLength(connection.in.data() + offset, connection.in.size() - offset)) > 0) {
+							this->handleFrame(ids[i], connection, std::span<const uint8_t>(connection.in.data() + offset, length));
+							offset += length;
+						}
+						connection.in.erase(connection.in.begin(), connection.in.begin() + offset);
+					}
+				} catch (const std::exception& e) {
+					PUBSUPP_LOG_WARN("Closing connection " << connection.clientId << ": " << e.what());
+					open = false;
+				}
+
+				if (!open) {
+					this->close(ids[i]);
+				}
+			}
+
+			// write whatever is due, including what was just queued for other connections
+			std::vector<uint64_t> closed;
+			for (auto& [id, connection] : this->connections) {
+				if (!this->writeTo(*connection) || (connection->closing && connection->out.empty())) {
+					closed.push_back(id);
+				}
+			}
+			for (uint64_t id : closed) {
+				this->close(id);
+			}
+		}
+	}
+
+
+	void MockBroker::acceptConnections() {
+		while (true) {
+			int fd = accept(this->listenFd, nullptr, nullptr);
+			if (fd < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					PUBSUPP_LOG_WARN("Accept failed: " << std::strerror(errno));
+				}
+				return;
+			}
+			setNonBlocking(fd);
+			if (this->socketPath.empty()) {
+				int noDelay = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+			}
+
+			auto connection = std::make_unique<Connection>();
+			connection->fd = fd;
+			this->connections.emplace(this->nextConnectionId++, std::move(connection));
+		}
+	}
+
+
+	// false once the peer closed, whatever is left unread is picked up by the next iteration
+	bool MockBroker::readFrom(Connection& connection) {
+		uint8_t buffer[64 * 1024];
+		for (size_t read = 0; read < MAX_READ_PER_ITERATION;) {
+			ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+			if (n > 0) {
+				connection.in.insert(connection.in.end(), buffer, buffer + n);
+				read += static_cast<size_t>(n);
+				continue;
+			}
+			if (n == 0) {
+				return false; // peer closed
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		}
+		return true;
+	}
+
+
+	bool MockBroker::writeTo(Connection& connection) {
+		auto now = Clock::now();
+		while (!connection.out.empty() && connection.out.front().due <= now) {
+			const std::vector<uint8_t>& data = connection.out.front().data;
+			ssize_t n = ::send(connection.fd, data.data() + connection.outOffset, data.size() - connection.outOffset, MSG_NOSIGNAL);
+			if (n < 0) {
+				return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+			}
+
+			connection.outOffset += static_cast<size_t>(n);
+			if (connection.outOffset < data.size()) {
+				return true; // socket buffer full, continue on POLLOUT
+			}
+			connection.out.pop_front();
+			connection.outOffset = 0;
+		}
+		return true;
+	}
+
+
+	const std::vector<uint8_t>& MockBroker::decodable(std::span<const uint8_t> frame) {
+		this->decodeBuffer.assign(frame.begin(), frame.end());
+		return this->decodeBuffer;
+	}
+
+
+	void MockBroker::handleFrame(uint64_t id, Connection& connection, std::span<const uint8_t> frame) {
+		auto type = static_cast<MessageType>(frame[0] >> 4);
+
+		if (!connection.connected && type != MessageType::CONNECT) {
+			throw std::runtime_error("Expected CONNECT as first packet");
+		}
+
+		switch (type) {
+			case MessageType::CONNECT: {
+				auto connect = parseConnectMessage(this->decodable(frame));
+				connection.clientId = static_cast<const ConnectMessage&>(*connect).getClientId();
+				connection.connected = true;
+				this->send(connection, createConnackMessage(false, 0)->encode());
+				break;
+			}
+			case MessageType::PUBLISH: this->handlePublish(connection, frame); break;
+			case MessageType::PUBACK: break; // nothing is redelivered, nothing to release
+			case MessageType::PUBREC: this->send(connection, createPubrelMessage(packetIdOf(frame))->encode()); break;
+			case MessageType::PUBREL: {
+				uint16_t packetId = packetIdOf(frame);
+				connection.inboundQos2.erase(packetId);
+				this->send(connection, createPubcompMessage(packetId)->encode());
+				break;
+			}
+			case MessageType::PUBCOMP: break;
+			case MessageType::SUBSCRIBE: this->handleSubscribe(id, connection, frame); break;
+			case MessageType::UNSUBSCRIBE: this->handleUnsubscribe(connection, frame); break;
+			case MessageType::PINGREQ: this->send(connection, {static_cast<uint8_t>(MessageType::PINGRESP) << 4, 0x00}); break;
+			case MessageType::DISCONNECT: connection.closing = true; break;
+			default: throw std::runtime_error("Unexpected packet type " + std::to_string(static_cast<int>(type)));
+		}
+	}
+
+
+	void MockBroker::handlePublish(Connection& connection, std::span<const uint8_t> frame) {
+		auto message = parsePublishMessage(this->decodable(frame));
+		const PublishMessage& publish = static_cast<const PublishMessage&>(*message);
+		uint16_t packetId = publish.getPacketId();
+
+		bool route = true;
+		switch (publish.getQoS()) {
+			case QoS::AT_MOST_ONCE: break;
+			case QoS::AT_LEAST_ONCE: this->send(connection, createPubackMessage(packetId)->encode()); break;
+			case QoS::EXACTLY_ONCE:
+				route = connection.inboundQos2.insert(packetId).second;
+				this->send(connection, createPubrecMessage(packetId)->encode());
+				break;
+		}
+
+		if (route) {
+			this->subscriptions.forEachMatch(publish.getTopic(), [&publish](const Subscription& subscription) { subscription.handler(publish); });
+		}
+	}
+
+
+	void MockBroker::handleSubscribe(uint64_t id, Connection& connection, std::span<const uint8_t> frame) {
+		auto message = parseSubscribeMessage(this->decodable(frame));
+		const SubscribeMessage& subscribe = static_cast<const SubscribeMessage&>(*message);
+		QoS qos = subscribe.getQoS();
+
+		uint8_t returnCode = static_cast<uint8_t>(qos);
+		try {
+			// a repeated subscription replaces the old one (3.8.4)
+			auto existing = connection.subscriptions.find(subscribe.getTopic());
+			if (existing != connection.subscriptions.end()) {
+				this->subscriptions.remove(existing->second);
+				connection.subscriptions.erase(existing);
+			}
+			SubscriptionId subscriptionId = this->subscriptions.add(subscribe.getTopic(), [this, id, qos](const PublishMessage& publish) { this->deliver(id, qos, publish); });
+			connection.subscriptions.emplace(subscribe.getTopic(), subscriptionId);
+		} catch (const std::exception& e) {
+			returnCode = 0x80; // failure, e.g. an invalid filter
+		}
+
+		this->send(connection, createSubackMessage(subscribe.getPacketId(), returnCode)->encode());
+	}
+
+
+	void MockBroker::handleUnsubscribe(Connection& connection, std::span<const uint8_t> frame) {
+		// fixed header, packet id, one topic filter; the codec has no UNSUBSCRIBE message yet
+		size_t offset = 1;
+		while (offset < frame.size() && (frame[offset] & 128) != 0) {
+			offset++;
+		}
+		offset++;
+		if (offset + 4 > frame.size()) {
+			throw std::runtime_error("UNSUBSCRIBE message too short");
+		}
+		uint16_t packetId = (frame[offset] << 8) | frame[offset + 1];
+		uint16_t topicLength = (frame[offset + 2] << 8) | frame[offset + 3];
+		offset += 4;
+		if (offset + topicLength > frame.size()) {
+			throw std::runtime_error("UNSUBSCRIBE message incomplete: missing topic filter");
+		}
+		std::string topic(frame.begin() + offset, frame.begin() + offset + topicLength);
+
+		auto existing = connection.subscriptions.find(topic);
+		if (existing != connection.subscriptions.end()) {
+			this->subscriptions.remove(existing->second);
+			connection.subscriptions.erase(existing);
+		}
+		this->send(connection, {static_cast<uint8_t>(MessageType::UNSUBACK) << 4, 0x02, static_cast<uint8_t>(packetId >> 8), static_cast<uint8_t>(packetId & 0xFF)});
+	}
+
+
+	void MockBroker::deliver(uint64_t id, QoS subscribedQos, const PublishMessage& publish) {
+		auto it = this->connections.find(id);
+		if (it == this->connections.end()) {
+			return;
+		}
+		Connection& connection = *it->second;
+
+		QoS qos = std::min(subscribedQos, publish.getQoS());
+		uint16_t packetId = 0;
+		if (qos != QoS::AT_MOST_ONCE) {
+			packetId = connection.nextPacketId++;
+			if (connection.nextPacketId == 0) {
+				connection.nextPacketId = 1;
+			}
+		}
+
+		this->send(connection, createPublishMessage(publish.getTopic(), qos, publish.getPayload(), packetId)->encode());
+		this->routed.fetch_add(1, std::memory_order_relaxed);
+	}
+
+
+	void MockBroker::send(Connection& connection, std::vector<uint8_t> data) {
+		connection.out.push_back({Clock::now() + this->config.latency, std::move(data)});
+	}
+
+
+	void MockBroker::close(uint64_t id) {
+		auto it = this->connections.find(id);
+		if (it == this->connections.end()) {
+			return;
+		}
+
+		for (auto& [filter, subscriptionId] : it->second->subscriptions) {
+			this->subscriptions.remove(subscriptionId);
+		}
+		::close(it->second->fd);
+		this->connections.erase(it);
+	}
+
+
+	bool MockBroker::nextDue(Clock::time_point& due) const {
+		bool any = false;
+		for (const auto& [id, connection] : this->connections) {
+			if (!connection->out.empty() && (!any || connection->out.front().due < due)) {
+				due = connection->out.front().due;
+				any = true;
+			}
+		}
+		return any;
+	}
+
+} // namespace pubsupp
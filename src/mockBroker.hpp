@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+#include "messages/mqttMessage.hpp"
+#include "messages/publishMessage.hpp"
+#include "notifier.hpp"
+#include "subscriptionTrie.hpp"
+
+
+
+namespace pubsupp {
+
+	struct MockBrokerConfig {
+		std::string bindAddress = "127.0.0.1"; // or unix://<path> for a Unix domain socket (the file is replaced)
+		uint16_t port = 1883; // 0 picks a free port, see MockBroker::port(); unused for Unix domain sockets
+		std::chrono::microseconds latency{0}; // added to everything the broker sends
+	};
+
+
+	/*
+	 * Minimal MQTT 3.1.1 broker for benchmarks and local testing, built on the client's message codec.
+	 *
+	 * Accepts CONNECT, SUBSCRIBE/UNSUBSCRIBE (one filter per packet, like MqttClient sends them), PUBLISH,
+	 * PINGREQ and DISCONNECT. Messages are routed to every connection with a matching filter through a
+	 * SubscriptionTrie and delivered with the lower of the publish and subscription QoS.
+	 * QoS 1 and 2 are acknowledged (PUBACK, PUBREC/PUBREL/PUBCOMP), inbound QoS 2 messages are routed once.
+	 *
+	 * There are no sessions, retained messages, wills or redeliveries: state lives as long as the connection.
+	 * Every frame the broker sends is held back for `latency`, so benchmarks see a predictable network delay.
+	 *
+	 * Single-threaded: one poll loop serves all connections, either on the caller's thread (run())
+	 * or on a thread of its own (start()).
+	 */
+	class MockBroker {
+	  public:
+		explicit MockBroker(MockBrokerConfig config = {}); // listens right away
+		~MockBroker();
+
+		MockBroker(const MockBroker&) = delete;
+		MockBroker& operator=(const MockBroker&) = delete;
+
+		void run(); // until stop()
+		void start();
+		void stop();
+
+		uint16_t port() const { return this->boundPort; }
+		uint64_t messagesRouted() const { return this->routed.load(std::memory_order_relaxed); }
+
+	  private:
+		using Clock = std::chrono::steady_clock;
+
+		struct PendingWrite {
+			Clock::time_point due;
+			std::vector<uint8_t> data;
+		};
+
+		struct Connection {
+			int fd = -1;
+			std::string clientId;
+			bool connected = false;
+			bool closing = false; // close once everything is written
+			std::vector<uint8_t> in;
+			std::deque<PendingWrite> out;
+			size_t outOffset = 0; // bytes of out.front() already written
+			std::map<std::string, SubscriptionId> subscriptions;
+			std::unordered_set<uint16_t> inboundQos2; // PUBREC sent, waiting for PUBREL
+			uint16_t nextPacketId = 1;
+		};
+
+		void acceptConnections();
+		bool readFrom(Connection& connection);
+		bool writeTo(Connection& connection);
+		// frames point into Connection::in, valid until the next read
+		void handleFrame(uint64_t id, Connection& connection, std::span<const uint8_t> frame);
+		void handlePublish(Connection& connection, std::span<const uint8_t> frame);
+		void handleSubscribe(uint64_t id, Connection& connection, std::span<const uint8_t> frame);
+		void handleUnsubscribe(Connection& connection, std::span<const uint8_t> frame);
+		// the message codec decodes from vectors, frames it needs are copied into `decodeBuffer`
+		const std::vector<uint8_t>& decodable(std::span<const uint8_t> frame);
+		void deliver(uint64_t id, QoS subscribedQos, const PublishMessage& publish);
+		void send(Connection& connection, std::vector<uint8_t> data);
+		void close(uint64_t id);
+		bool nextDue(Clock::time_point& due) const;
+
+		MockBrokerConfig config;
+		int listenFd = -1;
+		uint16_t boundPort = 0;
+		std::string socketPath; // Unix domain socket file, removed again by the destructor
+		std::vector<uint8_t> decodeBuffer;
+
+		std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+		uint64_t nextConnectionId = 1;
+		SubscriptionTrie subscriptions;
+
+		Notifier notifier;
+		std::atomic<bool> stopRequested = false;
+		std::thread thread;
+		std::atomic<uint64_t> routed = 0;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Unbounded lock-free multi-producer single-consumer queue (Vyukov's intrusive MPSC queue).
+	 *
+	 * push() is wait-free: one atomic exchange plus one store, safe from any number of threads.
+	 * tryPop() must only be called from a single consumer thread. Items pushed by the same
+	 * producer are popped in the order they were pushed.
+	 */
+	template <typename T>
+	class MpscQueue {
+	  public:
+		MpscQueue() : head(&stub), tail(&stub) {}
+		~MpscQueue() {
+			T value;
+			while (this->tryPop(value)) {
+			}
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		void push(T value) {
+			Node* node = new Node(std::move(value));
+			this->link(node);
+		}
+
+		// false if the queue is empty (or a producer is halfway through a push)
+		bool tryPop(T& out) {
+			NodeBase* tail = this->tail;
+			NodeBase* next = tail->next.load(std::memory_order_acquire);
+
+			if (tail == &this->stub) {
+				if (!next) {
+					return false;
+				}
+				this->tail = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next) {
+				this->tail = next;
+				return this->take(tail, out);
+			}
+
+			if (tail != this->head.load(std::memory_order_acquire)) {
+				return false; // a producer swapped the head but did not link its node yet
+			}
+
+			// tail is the last node: put the stub behind it so the node can be handed out
+			this->link(&this->stub);
+
+			next = tail->next.load(std::memory_order_acquire);
+			if (next) {
+				this->tail = next;
+				return this->take(tail, out);
+			}
+			return false;
+		}
+
+	  private:
+		struct NodeBase {
+			std::atomic<NodeBase*> next{nullptr};
+		};
+
+		struct Node : NodeBase {
+			explicit Node(T&& value) : value(std::move(value)) {}
+			T value;
+		};
+
+		void link(NodeBase* node) {
+			node->next.store(nullptr, std::memory_order_relaxed);
+			NodeBase* prev = this->head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		bool take(NodeBase* node, T& out) {
+			Node* valueNode = static_cast<Node*>(node);
+			out = std::move(valueNode->value);
+			delete valueNode;
+			return true;
+		}
+
+		// producers and consumer touch different ends, keep them on different cache lines
+		alignas(64) std::atomic<NodeBase*> head;
+		alignas(64) NodeBase* tail;
+		NodeBase stub;
+	};
+
+} // namespace pubsupp
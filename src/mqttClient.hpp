@@ -1,33 +1,373 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 
 #include "messages/mqttMessage.hpp"
+#include "duplicateFilter.hpp"
+#include "lastValueCache.hpp"
+#include "latencyHistogram.hpp"
+#include "metrics.hpp"
+#include "messages/publishMessage.hpp"
+#include "mpscQueue.hpp"
+#include "mqttSessionState.hpp"
+#include "notifier.hpp"
+#include "offlineBuffer.hpp"
+#include "partitionedExecutor.hpp"
+#include "subscriptionTrie.hpp"
+#include "task.hpp"
 #include "tcpClient.hpp"
+#include "transport.hpp"
 
 
 
 namespace pubsupp {
 
-	class MqttClient {
+	// latencies of one client (or several, merged), in nanoseconds
+	struct ClientLatencies {
+		LatencyHistogram enqueueToWrite; // enqueuePublish() until the PUBLISH went to the socket
+		LatencyHistogram writeToAck; // QoS 1/2 PUBLISH written until its PUBACK/PUBCOMP arrived
+		LatencyHistogram decodeToHandler; // inbound PUBLISH decoded until its handlers start
+		LatencyHistogram handlerRun; // all handlers of one inbound message
+
+		void merge(const ClientLatencies& other) {
+			this->enqueueToWrite.merge(other.enqueueToWrite);
+			this->writeToAck.merge(other.writeToAck);
+			this->decodeToHandler.merge(other.decodeToHandler);
+			this->handlerRun.merge(other.handlerRun);
+		}
+	};
+
+
+
+	// requests sent in the same write as CONNECT, see BasicMqttClient::connectPipelined
+	struct ConnectBatch {
+		struct Subscribe {
+			std::string filter;
+			QoS qos = QoS::AT_MOST_ONCE;
+			MessageHandler handler; // optional, registered before anything is sent
+		};
+
+		struct Publish {
+			std::string topic;
+			QoS qos = QoS::AT_MOST_ONCE;
+			std::string payload;
+		};
+
+		std::vector<Subscribe> subscriptions;
+		std::vector<Publish> publishes;
+	};
+
+
+
+	/*
+	 * MQTT client with a single-threaded event loop.
+	 *
+	 * Every request is sent right away, its acknowledgement is picked up by poll(), which reads
+	 * the inbound frames and dispatches them: acks complete pending requests (looked up by packet id),
+	 * PUBLISH messages go to the message handler and to the handlers of every matching subscription filter.
+	 *
+	 * connect/subscribe/publish block by running the loop until their request completed.
+	 * The async* versions return awaitables instead, resumed by the loop once the ack arrived:
+	 *
+	 *   client.runUntilComplete([&]() -> Task<> {
+	 *       co_await client.asyncSubscribe("sensors/#", QoS::AT_LEAST_ONCE);
+	 *       co_await client.asyncPublish("sensors/1", QoS::AT_LEAST_ONCE, "42");
+	 *   }());
+	 *
+	 * Any number of spawned tasks can wait on the same loop. Blocking calls must not be made from inside a task.
+	 *
+	 * The client belongs to the thread running its loop (the I/O thread, see start()). The only call that
+	 * is safe from other threads is enqueuePublish(): it pushes onto a lock-free MPSC queue which the loop
+	 * drains, messages of one producer thread go out in the order they were enqueued.
+	 *
+	 * Handlers run on the loop thread unless parallel handlers are enabled: then they run on a pool of workers,
+	 * partitioned by topic, so messages of one topic are handled in order while different topics run in parallel.
+	 *
+	 * With an offline buffer enabled, publishing while disconnected does not fail: messages are buffered
+	 * (and publish() returns without waiting for an ack) until the connection is back, then sent before
+	 * anything newer. run()/start() then also reconnect on their own, with exponential backoff.
+	 *
+	 * The byte stream below is a compile-time policy (see MqttTransport), so sends and receives are direct,
+	 * inlinable calls. MqttClient runs over TCP, DynamicMqttClient over a type-erased AnyTransport.
+	 * Both are instantiated in mqttClient.cpp, include mqttClientImpl.hpp to instantiate others.
+	 */
+	template <MqttTransport Transport>
+	class BasicMqttClient {
 	  public:
-		MqttClient(std::string& host, int port, const std::string& clientId);
-		~MqttClient();
+		// one request waiting for its acknowledgement
+		struct Completion {
+			bool done = false;
+			uint8_t returnCode = 0;
+			std::exception_ptr error;
+			std::coroutine_handle<> waiter;
+		};
+
+
+		class ConnectOperation {
+		  public:
+			ConnectOperation(BasicMqttClient& client) : client(client) {}
+			ConnectOperation(const ConnectOperation&) = delete;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> waiter);
+			void await_resume();
+
+		  private:
+			BasicMqttClient& client;
+			Completion completion;
+		};
+
+
+		class PublishOperation {
+		  public:
+			PublishOperation(BasicMqttClient& client, const std::string& topic, QoS qos, const std::string& payload)
+				: client(client), topic(topic), qos(qos), payload(payload) {}
+			PublishOperation(const PublishOperation&) = delete;
+
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> waiter);
+			void await_resume();
+
+		  private:
+			BasicMqttClient& client;
+			std::string topic;
+			QoS qos;
+			std::string payload;
+			Completion completion;
+		};
+
+
+		class SubscribeOperation {
+		  public:
+			SubscribeOperation(BasicMqttClient& client, const std::string& topic, QoS qos) : client(client), topic(topic), qos(qos) {}
+			SubscribeOperation(const SubscribeOperation&) = delete;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> waiter);
+			void await_resume();
+
+		  private:
+			BasicMqttClient& client;
+			std::string topic;
+			QoS qos;
+			Completion completion;
+		};
+
+
+
+		// the transport is default constructed
+		BasicMqttClient(std::string& host, int port, const std::string& clientId);
+		// the transport is constructed from `transportArgs`
+		template <typename... TransportArgs>
+		BasicMqttClient(std::string& host, int port, const std::string& clientId, std::in_place_t, TransportArgs&&... transportArgs);
+		~BasicMqttClient();
 
 		void connect(); // get broker details from config
 		void connect(std::string& brokerAddress, int brokerPort);
+		// optimistic connect (3.1.4): CONNECT, the batch and whatever enqueuePublish() queued so far go out in one write,
+		// then this waits for the CONNACK and every ack of the batch, so startup costs one round trip instead of one per request.
+		// A refused connection throws and drops the batch, the broker discards everything sent after a refused CONNECT
+		void connectPipelined(const ConnectBatch& batch);
+		// connect without blocking, for driving many clients from one thread (see ConnectionStorm): beginConnect() starts the
+		// TCP handshake and returns true if CONNECT went out right away, else continueConnect() sends it once socketHandle()
+		// is writable. After that poll() handles the CONNACK and connectCompleted() turns true, or rethrows a refusal
+		bool beginConnect() requires NonBlockingConnectTransport<Transport>;
+		void continueConnect() requires NonBlockingConnectTransport<Transport>;
+		bool connectCompleted() const;
+		auto socketHandle() const requires NonBlockingConnectTransport<Transport> { return this->transport.nativeHandle(); }
 		void disconnect();
 
 		void publish(const std::string& topic, QoS qos, const std::string& payload);
 		void subscribe(const std::string& topic, QoS qos, uint16_t keepalive);
+		// subscribe and route messages matching `topic` to `handler`
+		SubscriptionId subscribe(const std::string& topic, QoS qos, MessageHandler handler);
+
+		// awaitable versions, completed by the event loop
+		ConnectOperation asyncConnect() { return ConnectOperation(*this); }
+		PublishOperation asyncPublish(const std::string& topic, QoS qos, const std::string& payload) { return PublishOperation(*this, topic, qos, payload); }
+		SubscribeOperation asyncSubscribe(const std::string& topic, QoS qos) { return SubscribeOperation(*this, topic, qos); }
+
+		// thread-safe, fire and forget: sent by the I/O thread, acks are handled by the loop. While not connected
+		// (e.g. during connect()) messages stay queued, disconnect() drops them unless an offline buffer takes them
+		void enqueuePublish(const std::string& topic, QoS qos, const std::string& payload);
+		// enqueued messages the I/O thread has not taken yet, safe to call from any thread
+		size_t queuedPublishes() const { return this->queuedCount.load(std::memory_order_relaxed); }
+
+		// called for every PUBLISH received from the broker
+		void setMessageHandler(MessageHandler handler);
+		// called for every PUBLISH matching `filter`, may be changed from any thread
+		SubscriptionId addHandler(const std::string& filter, MessageHandler handler);
+		bool removeHandler(SubscriptionId id);
+
+		// event loop: read + dispatch inbound frames, timeoutMs < 0 waits until something arrives
+		void poll(int timeoutMs = 0);
+		// poll until stop() is called or the connection is gone
+		void run();
+		// run the loop on a background I/O thread, stop() ends and joins it
+		void start();
+		void stop();
+		// start a detached task on the loop
+		void spawn(Task<void> task);
+		void runUntilComplete(Task<void> task);
+
+		// keep in-flight messages in a session log at `path`, resumed on (re)connect
+		void enableSessionPersistence(const std::string& path);
+		// buffer publishes while disconnected, spilling to `spillDirectory` beyond `memoryLimit` bytes
+		void enableOfflineBuffer(size_t memoryLimit, const std::string& spillDirectory = "");
+		// run handlers on `workers` threads, ordered per topic or, with prefixLevels > 0, per topic prefix
+		// (e.g. 4 for "tenant/site/device/<id>"). QoS1/2 messages are acknowledged once queued, not once handled
+		void enableParallelHandlers(size_t workers, size_t prefixLevels = 0);
+		// drop redelivered messages before the handlers run, see DuplicateFilter
+		void enableDuplicateSuppression(std::chrono::milliseconds window, size_t capacity = 65536, DuplicateKey key = DuplicateKey::PACKET_ID_AND_CONTENT);
+		uint64_t duplicatesDropped() const { return this->duplicateFilter ? this->duplicateFilter->dropped() : 0; }
+		// keep the latest message per topic, see LastValueCache
+		void enableLastValueCache(size_t memoryLimit, bool retainedOnly = false);
+		// nullptr unless enabled, safe to read from any thread
+		LastValueCache* lastValues() { return this->lastValueCache.get(); }
+		// record the latencies in ClientLatencies, has to be called before start()
+		void enableLatencyTracking();
+		// snapshot of everything recorded so far, empty unless enabled, safe to call from any thread
+		ClientLatencies latencies() const;
+		// packet, byte and syscall counters of this connection, safe to call from any thread
+		MetricsSnapshot metrics() const { return this->connectionMetrics.snapshot(); }
+		// record every frame sent and received to a capture file, see CaptureWriter and CaptureReplayer
+		void enableWireCapture(const std::string& path) requires CapturingTransport<Transport> { this->transport.enableCapture(path); }
 
 	  private:
-		std::unique_ptr<TcpClient> tcpClient;
+		// upper bound of frames handled per poll(), so resumed tasks get to run in between
+		static constexpr int MAX_FRAMES_PER_POLL = 64;
+		// same for buffered publishes sent after a reconnect
+		static constexpr int MAX_BUFFERED_PER_POLL = 4096;
+		static constexpr int MAX_RECONNECT_DELAY_MS = 30000;
+
+		void startConnect(std::string& brokerAddress, int brokerPort, Completion& completion);
+		void sendConnect(Completion& completion);
+		uint16_t startPublish(const std::string& topic, QoS qos, const std::string& payload, Completion* completion, uint64_t enqueuedNs = 0);
+		uint16_t sendPublish(const std::string& topic, QoS qos, const std::string& payload, Completion* completion, uint64_t enqueuedNs = 0);
+		uint16_t startSubscribe(const std::string& topic, QoS qos, Completion& completion);
+		void waitFor(Completion& completion);
+
+		void registerCompletion(uint16_t packetId, Completion* completion);
+		Completion* takeCompletion(uint16_t packetId);
+		void complete(Completion* completion, uint8_t returnCode = 0, std::exception_ptr error = nullptr);
+		void failPending(std::exception_ptr error);
+		void resumeReady();
+		void reapTasks();
+
+		void handleIncoming(const std::vector<uint8_t>& frame);
+		void handleConnack(const std::vector<uint8_t>& frame);
+		void handlePublish(const std::vector<uint8_t>& frame);
+		// `owned` holds `publish` unless it is inboundPublish, only needed with parallel handlers
+		void dispatch(const PublishMessage& publish, std::unique_ptr<PublishMessage> owned, uint64_t decodedNs);
+		uint64_t partitionKey(const PublishMessage& publish) const;
+		void handleOutboundAck(MessageType type, uint16_t packetId);
+		void handleSuback(const std::vector<uint8_t>& frame);
+		void handlePubrel(uint16_t packetId);
+		void sendAck(MessageType type, uint16_t packetId);
+		// every packet goes out through here, collected into one write while corked
+		void writePacket(const uint8_t* data, size_t length);
+		void uncork();
+		void resendInflight();
+		void runLoop();
+		void drainPublishQueue();
+		void discardPublishQueue();
+		bool drainOfflineBuffer();
+		void reconnect();
+
+		using SubscriptionList = std::vector<std::shared_ptr<const Subscription>>;
+
+		// subscriptions matching one topic, valid while the trie is at `version`
+		struct Route {
+			uint64_t version = UINT64_MAX;
+			std::shared_ptr<const SubscriptionList> subscriptions; // shared with queued handler jobs
+		};
+
+		struct QueuedPublish {
+			std::string topic;
+			QoS qos = QoS::AT_MOST_ONCE;
+			std::string payload;
+			uint64_t enqueuedNs = 0; // only stamped with latency tracking enabled
+		};
+
+		struct LatencyRecorders {
+			LatencyRecorder enqueueToWrite;
+			LatencyRecorder writeToAck;
+			LatencyRecorder decodeToHandler;
+			LatencyRecorder handlerRun;
+			std::vector<uint64_t> writtenNs; // by packet id, I/O thread only
+		};
+
+		Metrics connectionMetrics;
+		Transport transport;
+		std::unique_ptr<SessionState> sessionState;
 		std::string host;
 		int port;
 		const std::string& clientId;
 		std::shared_ptr<MqttMessage> message;
-		bool isConnected = false;
-		uint16_t nextPacketId = 1;
+		std::atomic<bool> isConnected = false;
+
+		// requests waiting for their ack, indexed by packet id
+		std::vector<Completion*> completions;
+		Completion* connackCompletion = nullptr;
+		std::vector<std::coroutine_handle<>> ready;
+		std::vector<Task<void>> tasks;
+		std::shared_ptr<const MessageHandler> messageHandler;
+		SubscriptionTrie subscriptions;
+		// per topic, cleared when full so a subscriber to '#' on a busy broker stays bounded
+		static constexpr size_t MAX_ROUTES = 4096;
+		struct TopicHash {
+			using is_transparent = void;
+			size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+		};
+		std::unordered_map<std::string, Route, TopicHash, std::equal_to<>> routes;
+		std::unique_ptr<PartitionedExecutor> handlerExecutor;
+		size_t partitionPrefixLevels = 0;
+		std::atomic<bool> stopRequested = false;
+
+		MpscQueue<QueuedPublish> publishQueue;
+		std::atomic<bool> wakeupPending = false;
+		std::atomic<size_t> queuedCount = 0;
+		Notifier notifier;
+		std::thread ioThread;
+
+		std::unique_ptr<OfflineBuffer> offlineBuffer;
+		std::unique_ptr<LastValueCache> lastValueCache;
+		std::unique_ptr<DuplicateFilter> duplicateFilter;
+		std::unique_ptr<LatencyRecorders> latencyRecorders;
+		int reconnectDelayMs = 0;
+
+		// reused across messages, so steady-state publishing and receiving does not allocate
+		std::vector<uint8_t> sendBuffer;
+		std::vector<uint8_t> receiveBuffer;
+		PublishMessage inboundPublish;
+		bool inboundPublishInUse = false;
+
+		// CONNACK of a connect started with beginConnect()
+		Completion stagedConnack;
+
+		// connectPipelined: packets of the first flight, and whether in-flight messages were already resent in it
+		bool corked = false;
+		std::vector<uint8_t> corkBuffer;
+		bool inflightResentEarly = false;
 	};
+
+
+	using MqttClient = BasicMqttClient<TcpClient>;
+	using DynamicMqttClient = BasicMqttClient<AnyTransport>;
+
+	extern template class BasicMqttClient<TcpClient>;
+	extern template class BasicMqttClient<AnyTransport>;
+	extern template BasicMqttClient<AnyTransport>::BasicMqttClient(std::string& host, int port, const std::string& clientId, std::in_place_t, AnyTransport&& transport);
 } // namespace pubsupp
@@ -0,0 +1,1171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "messages/connectMessage.hpp"
+#include "messages/disconnectMessage.hpp"
+#include "messages/mqttMessage.hpp"
+#include "messages/publishMessage.hpp"
+#include "messages/subackMessage.hpp"
+#include "messages/subscribeMessage.hpp"
+#include "logger.hpp"
+#include "mqttClient.hpp"
+
+
+
+
+namespace pubsupp {
+	// pass the client's configuration details
+	template <MqttTransport Transport>
+	BasicMqttClient<Transport>::BasicMqttClient(std::string& host, int port, const std::string& clientId)
+		: BasicMqttClient(host, port, clientId, std::in_place) {}
+
+
+	template <MqttTransport Transport>
+	template <typename... TransportArgs>
+	BasicMqttClient<Transport>::BasicMqttClient(std::string& host, int port, const std::string& clientId, std::in_place_t, TransportArgs&&... transportArgs)
+		: transport(std::forward<TransportArgs>(transportArgs)...), host(host), port(port), clientId(clientId) {
+		this->transport.setMetrics(&this->connectionMetrics);
+		this->sessionState = std::make_unique<SessionState>();
+	}
+
+
+	template <MqttTransport Transport>
+	BasicMqttClient<Transport>::~BasicMqttClient() {
+		this->stop();
+		this->handlerExecutor.reset(); // runs the handlers still queued
+
+		try {
+			this->disconnect();
+		} catch (const std::exception& e) {
+			PUBSUPP_LOG_WARN("Failed to disconnect cleanly: " << e.what());
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::connect() { connect(this->host, this->port); }
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::connect(std::string& brokerAddress, int brokerPort) {
+		Completion completion;
+		this->startConnect(brokerAddress, brokerPort, completion);
+
+		try {
+			this->waitFor(completion);
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to receive or parse CONNACK message: " + std::string(e.what()));
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::connectPipelined(const ConnectBatch& batch) {
+		// registered by address, so sized once up front
+		std::vector<Completion> completions(batch.subscriptions.size() + batch.publishes.size());
+		std::vector<SubscriptionId> handlers(batch.subscriptions.size(), 0);
+		std::vector<uint16_t> packetIds(completions.size(), 0);
+		Completion connack;
+
+		// undo everything of the batch, the broker refused or never saw it
+		auto abandon = [&](std::exception_ptr error) {
+			this->corked = false;
+			this->corkBuffer.clear();
+			this->inflightResentEarly = false;
+			this->isConnected = false;
+			try {
+				this->transport.disconnect();
+			} catch (const std::exception&) {
+				// already gone
+			}
+			this->failPending(error);
+
+			for (SubscriptionId id : handlers) {
+				if (id != 0) {
+					this->subscriptions.remove(id);
+				}
+			}
+			for (size_t i = 0; i < packetIds.size(); ++i) {
+				if (packetIds[i] == 0) {
+					continue;
+				}
+				if (i < batch.subscriptions.size()) {
+					this->sessionState->releasePacketId(packetIds[i]);
+				} else {
+					this->sessionState->releaseOutbound(packetIds[i]);
+				}
+			}
+			this->connectionMetrics.setInflight(this->sessionState->outboundCount());
+		};
+
+		this->corked = true;
+		try {
+			this->startConnect(this->host, this->port, connack);
+
+			// the broker processes everything behind CONNECT once it accepted it, or nothing at all
+			this->isConnected = true;
+			this->resendInflight();
+			this->inflightResentEarly = true;
+
+			for (size_t i = 0; i < batch.subscriptions.size(); ++i) {
+				const ConnectBatch::Subscribe& subscription = batch.subscriptions[i];
+				if (subscription.handler) {
+					handlers[i] = this->subscriptions.add(subscription.filter, subscription.handler);
+				}
+				packetIds[i] = this->startSubscribe(subscription.filter, subscription.qos, completions[i]);
+			}
+			for (size_t i = 0; i < batch.publishes.size(); ++i) {
+				const ConnectBatch::Publish& publish = batch.publishes[i];
+				size_t index = batch.subscriptions.size() + i;
+				packetIds[index] = this->startPublish(publish.topic, publish.qos, publish.payload, &completions[index]);
+				completions[index].done = packetIds[index] == 0; // QoS 0 (or buffered): nothing to wait for
+			}
+			this->drainPublishQueue();
+
+			this->uncork();
+			PUBSUPP_LOG_DEBUG("CONNECT sent with " << batch.subscriptions.size() << " subscriptions and " << batch.publishes.size() << " publishes");
+		} catch (const std::exception& e) {
+			abandon(std::current_exception());
+			throw std::runtime_error("Failed to send CONNECT batch: " + std::string(e.what()));
+		}
+
+		try {
+			this->waitFor(connack);
+		} catch (const std::exception& e) {
+			abandon(std::current_exception());
+			throw std::runtime_error("Failed to receive or parse CONNACK message: " + std::string(e.what()));
+		}
+
+		// the connection stays up when single requests fail, like after subscribe() or publish()
+		std::exception_ptr firstError;
+		for (size_t i = 0; i < completions.size(); ++i) {
+			try {
+				this->waitFor(completions[i]);
+			} catch (const std::exception&) {
+				if (i < handlers.size() && handlers[i] != 0) {
+					this->subscriptions.remove(handlers[i]);
+				}
+				if (!firstError) {
+					firstError = std::current_exception();
+				}
+			}
+		}
+		if (firstError) {
+			std::rethrow_exception(firstError);
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::startConnect(std::string& brokerAddress, int brokerPort, Completion& completion) {
+		try {
+			this->transport.tryConnect(brokerAddress, brokerPort);
+			PUBSUPP_LOG_INFO("Connected to " << brokerAddress << ":" << brokerPort);
+
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to establish connection: " + std::string(e.what()));
+		}
+
+		this->sendConnect(completion);
+	}
+
+
+	template <MqttTransport Transport>
+	bool BasicMqttClient<Transport>::beginConnect() requires NonBlockingConnectTransport<Transport> {
+		this->stagedConnack = Completion{};
+		try {
+			if (!this->transport.beginConnect(this->host, this->port)) {
+				return false;
+			}
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to establish connection: " + std::string(e.what()));
+		}
+
+		PUBSUPP_LOG_INFO("Connected to " << this->host << ":" << this->port);
+		this->sendConnect(this->stagedConnack);
+		return true;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::continueConnect() requires NonBlockingConnectTransport<Transport> {
+		try {
+			this->transport.finishConnect();
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to establish connection: " + std::string(e.what()));
+		}
+
+		PUBSUPP_LOG_INFO("Connected to " << this->host << ":" << this->port);
+		this->sendConnect(this->stagedConnack);
+	}
+
+
+	template <MqttTransport Transport>
+	bool BasicMqttClient<Transport>::connectCompleted() const {
+		if (this->stagedConnack.error) {
+			std::rethrow_exception(this->stagedConnack.error);
+		}
+		return this->stagedConnack.done;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::sendConnect(Completion& completion) {
+		// create and send connect: a persisted session is only useful if the broker keeps its part too
+		bool cleanSession = !this->sessionState->isPersistent();
+		auto connectMsg = createConnectMessage(clientId, cleanSession, 60);
+		std::vector<uint8_t> connectData = connectMsg->encode();
+
+		try {
+			this->writePacket(connectData.data(), connectData.size());
+			PUBSUPP_LOG_DEBUG("CONNECT message sent (" << connectData.size() << " bytes)");
+
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to send CONNECT message: " + std::string(e.what()));
+		}
+
+		this->connackCompletion = &completion;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableOfflineBuffer(size_t memoryLimit, const std::string& spillDirectory) {
+		this->offlineBuffer = std::make_unique<OfflineBuffer>(memoryLimit, spillDirectory);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableDuplicateSuppression(std::chrono::milliseconds window, size_t capacity, DuplicateKey key) {
+		this->duplicateFilter = std::make_unique<DuplicateFilter>(window, capacity, key);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableLastValueCache(size_t memoryLimit, bool retainedOnly) {
+		this->lastValueCache = std::make_unique<LastValueCache>(memoryLimit, retainedOnly);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableLatencyTracking() {
+		if (!this->latencyRecorders) {
+			this->latencyRecorders = std::make_unique<LatencyRecorders>();
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	ClientLatencies BasicMqttClient<Transport>::latencies() const {
+		ClientLatencies latencies;
+		if (this->latencyRecorders) {
+			latencies.enqueueToWrite = this->latencyRecorders->enqueueToWrite.snapshot();
+			latencies.writeToAck = this->latencyRecorders->writeToAck.snapshot();
+			latencies.decodeToHandler = this->latencyRecorders->decodeToHandler.snapshot();
+			latencies.handlerRun = this->latencyRecorders->handlerRun.snapshot();
+		}
+		return latencies;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableParallelHandlers(size_t workers, size_t prefixLevels) {
+		this->handlerExecutor.reset(); // finish whatever the old pool still has queued
+		this->handlerExecutor = std::make_unique<PartitionedExecutor>(workers);
+		this->partitionPrefixLevels = prefixLevels;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enableSessionPersistence(const std::string& path) {
+		if (this->isConnected) {
+			throw std::runtime_error("Session persistence has to be enabled before connecting");
+		}
+
+		this->sessionState = std::make_unique<SessionState>(path);
+	}
+
+
+	/*
+	 * Resend publishes of a resumed session that never got acknowledged (4.4).
+	 * They go out again with the DUP flag set, in the order they were originally sent;
+	 * QoS2 messages that already got their PUBREC continue with PUBREL.
+	 * The acks are handled by the event loop like any other.
+	 */
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::resendInflight() {
+		for (const InflightMessage* entry : this->sessionState->pendingOutbound()) {
+			try {
+				if (entry->state == SessionRecordType::OUTBOUND_PUBREL) {
+					this->sendAck(MessageType::PUBREL, entry->packetId);
+					continue;
+				}
+
+				std::vector<uint8_t> publishData = entry->data;
+				publishData[0] |= static_cast<uint8_t>(ControlFlags::DUP);
+				this->writePacket(publishData.data(), publishData.size());
+				PUBSUPP_LOG_DEBUG("PUBLISH message resent (packet ID: " << entry->packetId << ")");
+
+			} catch (const std::exception& e) {
+				throw std::runtime_error("Failed to resend in-flight message: " + std::string(e.what()));
+			}
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::disconnect() {
+		// create + send disconnect packet
+		if (this->isConnected) {
+			try {
+				DisconnectMessage disconnectMsg;
+				auto payload = disconnectMsg.encode();
+				this->writePacket(payload.data(), payload.size());
+				PUBSUPP_LOG_DEBUG("DISCONNECT message sent (" << payload.size() << " bytes)");
+
+			} catch (const std::exception& e) {
+				throw std::runtime_error("Failed to send DISCONNECT message: " + std::string(e.what()));
+			}
+		}
+
+		// close the transport
+		try {
+			this->transport.disconnect();
+			this->isConnected = false;
+			this->failPending(std::make_exception_ptr(std::runtime_error("Disconnected from MQTT broker")));
+			if (!this->offlineBuffer) {
+				this->discardPublishQueue();
+			}
+			PUBSUPP_LOG_INFO("Connection closed");
+
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to disconnect from MQTT broker: " + std::string(e.what()));
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::subscribe(const std::string& topic, QoS qos, uint16_t keepalive) {
+		Completion completion;
+		this->startSubscribe(topic, qos, completion);
+
+		try {
+			this->waitFor(completion);
+		} catch (const std::exception& e) {
+			throw std::runtime_error("Failed to receive or parse SUBACK message: " + std::string(e.what()));
+		}
+
+		PUBSUPP_LOG_DEBUG("Subscription successful (return code: " << static_cast<int>(completion.returnCode) << ")");
+	}
+
+
+	// the handler is registered before SUBSCRIBE goes out, so no message sent right after the SUBACK is missed
+	template <MqttTransport Transport>
+	SubscriptionId BasicMqttClient<Transport>::subscribe(const std::string& topic, QoS qos, MessageHandler handler) {
+		SubscriptionId id = this->subscriptions.add(topic, std::move(handler));
+
+		try {
+			this->subscribe(topic, qos, 0);
+		} catch (...) {
+			this->subscriptions.remove(id);
+			throw;
+		}
+		return id;
+	}
+
+
+	template <MqttTransport Transport>
+	uint16_t BasicMqttClient<Transport>::startSubscribe(const std::string& topic, QoS qos, Completion& completion) {
+		if (!this->isConnected) {
+			throw std::runtime_error("Not connected to MQTT broker");
+		}
+
+		if (static_cast<uint8_t>(qos) > 2) {
+			throw std::runtime_error("Invalid QoS value: must be 0, 1, or 2");
+		}
+
+		uint16_t packetId = this->sessionState->acquirePacketId();
+
+		auto subscribeMsg = createSubscribeMessage(topic, qos, packetId);
+		std::vector<uint8_t> subscribeData = subscribeMsg->encode();
+
+		try {
+			this->writePacket(subscribeData.data(), subscribeData.size());
+			PUBSUPP_LOG_DEBUG("SUBSCRIBE message sent for topic: " << topic << " (QoS: " << static_cast<int>(qos) << ", packet ID: " << packetId << ")");
+		} catch (const std::exception& e) {
+			this->sessionState->releasePacketId(packetId);
+			throw std::runtime_error("Failed to send SUBSCRIBE message: " + std::string(e.what()));
+		}
+
+		this->registerCompletion(packetId, &completion);
+		return packetId;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::publish(const std::string& topic, QoS qos, const std::string& payload) {
+		Completion completion;
+		if (this->startPublish(topic, qos, payload, &completion) == 0) {
+			return; // QoS 0: nothing to wait for
+		}
+
+		this->waitFor(completion);
+	}
+
+
+	// returns the packet id the ack will carry, 0 if there is nothing to wait for
+	template <MqttTransport Transport>
+	uint16_t BasicMqttClient<Transport>::startPublish(const std::string& topic, QoS qos, const std::string& payload, Completion* completion, uint64_t enqueuedNs) {
+		if (static_cast<uint8_t>(qos) > 2) {
+			throw std::runtime_error("Invalid QoS value: must be 0, 1, or 2");
+		}
+
+		// while older messages are still buffered, newer ones queue up behind them
+		if (this->offlineBuffer && (!this->isConnected || !this->offlineBuffer->empty())) {
+			if (!this->offlineBuffer->push(topic, qos, payload)) {
+				throw std::runtime_error("Offline buffer full, message to " + topic + " dropped");
+			}
+			return 0;
+		}
+
+		if (!this->isConnected) {
+			throw std::runtime_error("Not connected to MQTT broker");
+		}
+
+		return this->sendPublish(topic, qos, payload, completion, enqueuedNs);
+	}
+
+
+	template <MqttTransport Transport>
+	uint16_t BasicMqttClient<Transport>::sendPublish(const std::string& topic, QoS qos, const std::string& payload, Completion* completion, uint64_t enqueuedNs) {
+		// QoS 0 messages carry no packet id, the others keep theirs until fully acknowledged
+		uint16_t packetId = qos == QoS::AT_MOST_ONCE ? 0 : this->sessionState->acquirePacketId();
+
+		// encoded into the same buffer every time, it only grows for the largest message so far
+		std::vector<uint8_t>& publishData = this->sendBuffer;
+		try {
+			PublishMessage::encode(publishData, topic, qos, payload, packetId);
+		} catch (const std::exception&) {
+			if (packetId != 0) {
+				this->sessionState->releasePacketId(packetId);
+			}
+			throw;
+		}
+
+		if (packetId != 0) {
+			this->sessionState->storeOutbound(packetId, publishData);
+			this->connectionMetrics.setInflight(this->sessionState->outboundCount());
+		}
+
+		try {
+			this->writePacket(publishData.data(), publishData.size());
+			PUBSUPP_LOG_TRACE("PUBLISH message sent for topic: " << topic << " (QoS: " << static_cast<int>(qos) << ", packet ID: " << packetId << ", " << payload.size() << " bytes)");
+		} catch (const std::exception& e) {
+			// the message stays in the session and is resent on the next connect
+			throw std::runtime_error("Failed to send PUBLISH message: " + std::string(e.what()));
+		}
+
+		if (this->latencyRecorders) {
+			uint64_t now = monotonicNs();
+			if (enqueuedNs != 0) {
+				this->latencyRecorders->enqueueToWrite.record(now > enqueuedNs ? now - enqueuedNs : 0);
+			}
+			auto& writtenNs = this->latencyRecorders->writtenNs;
+			if (packetId != 0) {
+				if (packetId >= writtenNs.size()) {
+					writtenNs.resize(packetId + 1, 0);
+				}
+				writtenNs[packetId] = now;
+			}
+		}
+
+		if (packetId != 0) {
+			this->registerCompletion(packetId, completion);
+		}
+		return packetId;
+	}
+
+
+
+
+
+	// event loop
+
+	// send up to a batch of buffered publishes, returns whether more are left to send
+	template <MqttTransport Transport>
+	bool BasicMqttClient<Transport>::drainOfflineBuffer() {
+		if (!this->offlineBuffer || !this->isConnected) {
+			return false;
+		}
+
+		BufferedPublish buffered;
+		for (int i = 0; i < MAX_BUFFERED_PER_POLL; ++i) {
+			if (!this->sessionState->packetIdAvailable() || !this->offlineBuffer->pop(buffered)) {
+				return false;
+			}
+			this->sendPublish(buffered.topic, buffered.qos, buffered.payload, nullptr);
+		}
+		return !this->offlineBuffer->empty();
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::setMessageHandler(MessageHandler handler) { this->messageHandler = std::make_shared<const MessageHandler>(std::move(handler)); }
+
+
+	template <MqttTransport Transport>
+	SubscriptionId BasicMqttClient<Transport>::addHandler(const std::string& filter, MessageHandler handler) { return this->subscriptions.add(filter, std::move(handler)); }
+
+
+	template <MqttTransport Transport>
+	bool BasicMqttClient<Transport>::removeHandler(SubscriptionId id) { return this->subscriptions.remove(id); }
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::poll(int timeoutMs) {
+		if (!this->isConnected && !this->connackCompletion) {
+			throw std::runtime_error("Not connected to MQTT broker");
+		}
+
+		try {
+			this->drainPublishQueue();
+
+			// keep going without blocking while buffered publishes are waiting to be sent
+			if (this->drainOfflineBuffer()) {
+				timeoutMs = 0;
+			}
+
+			bool readable = this->transport.waitReadable(timeoutMs, this->notifier.fd());
+			if (!readable && timeoutMs != 0) {
+				// woken up or timed out: a notify() racing with the last drain may still be pending
+				this->notifier.drain();
+			}
+			for (int i = 0; readable && i < MAX_FRAMES_PER_POLL; ++i) {
+				// reused for every frame: nothing reads a frame once handleIncoming returned,
+				// and a nested poll (a blocking call from a handler) only runs after it was decoded
+				this->transport.tryReceiveMqttMessage(this->receiveBuffer);
+				try {
+					this->handleIncoming(this->receiveBuffer);
+				} catch (const std::exception&) {
+					this->connectionMetrics.add(Counter::DECODE_ERRORS);
+					throw;
+				}
+				readable = this->transport.waitReadable(0, -1);
+			}
+
+			this->drainPublishQueue();
+
+		} catch (const std::exception& e) {
+			// anything going wrong on the wire leaves the connection in an unknown state
+			std::string reason = "Connection lost: " + std::string(e.what());
+			this->isConnected = false;
+			try {
+				this->transport.disconnect();
+			} catch (const std::exception&) {
+				// already gone
+			}
+			this->failPending(std::make_exception_ptr(std::runtime_error(reason)));
+			this->resumeReady();
+			this->reapTasks();
+			throw std::runtime_error(reason);
+		}
+
+		this->resumeReady();
+		this->reapTasks();
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::run() {
+		this->stopRequested = false;
+		this->runLoop();
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::runLoop() {
+		while (!this->stopRequested) {
+			if (this->isConnected || this->connackCompletion) {
+				try {
+					this->poll(-1);
+				} catch (const std::exception& e) {
+					if (!this->offlineBuffer) {
+						throw;
+					}
+					PUBSUPP_LOG_WARN(e.what() << ", buffering until the broker is back");
+				}
+				continue;
+			}
+
+			if (!this->offlineBuffer) {
+				break;
+			}
+			this->reconnect();
+		}
+	}
+
+
+	// offline: keep what producers queue up and retry the broker with exponential backoff
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::reconnect() {
+		this->drainPublishQueue();
+
+		try {
+			this->connect();
+			this->reconnectDelayMs = 0;
+			this->connectionMetrics.add(Counter::RECONNECTS);
+			return;
+		} catch (const std::exception& e) {
+			PUBSUPP_LOG_WARN("Reconnect failed: " << e.what());
+		}
+
+		this->reconnectDelayMs = std::clamp(this->reconnectDelayMs * 2, 100, MAX_RECONNECT_DELAY_MS);
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(this->reconnectDelayMs);
+
+		while (!this->stopRequested) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0) {
+				break;
+			}
+			this->notifier.wait(static_cast<int>(remaining));
+			this->notifier.drain();
+			this->drainPublishQueue();
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::start() {
+		if (this->ioThread.joinable()) {
+			throw std::runtime_error("I/O thread already running");
+		}
+
+		this->stopRequested = false;
+		this->ioThread = std::thread([this]() {
+			try {
+				this->runLoop();
+			} catch (const std::exception& e) {
+				PUBSUPP_LOG_ERROR("I/O thread stopped: " << e.what());
+			}
+		});
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::stop() {
+		this->stopRequested = true;
+		this->notifier.notify();
+
+		if (this->ioThread.joinable() && this->ioThread.get_id() != std::this_thread::get_id()) {
+			this->ioThread.join();
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::enqueuePublish(const std::string& topic, QoS qos, const std::string& payload) {
+		if (static_cast<uint8_t>(qos) > 2) {
+			throw std::runtime_error("Invalid QoS value: must be 0, 1, or 2");
+		}
+		// rejected here, the I/O thread has nobody to throw to (topic length and packet id take 4 bytes)
+		if (4 + topic.size() + payload.size() > MqttMessage::MAX_REMAINING_LENGTH) {
+			throw std::runtime_error("PUBLISH to " + topic + " exceeds the maximum packet size");
+		}
+
+		this->queuedCount.fetch_add(1, std::memory_order_relaxed);
+		this->publishQueue.push(QueuedPublish{topic, qos, payload, this->latencyRecorders ? monotonicNs() : 0});
+
+		// only the first producer after the loop went to sleep pays for the syscall
+		if (!this->wakeupPending.exchange(true)) {
+			this->notifier.notify();
+		}
+	}
+
+
+	// I/O thread: send everything producers queued up (or buffer it while offline)
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::drainPublishQueue() {
+		// the notifier only needs draining after a producer's wakeup, saving a read() per poll otherwise
+		if (this->wakeupPending.exchange(false)) {
+			this->notifier.drain();
+		}
+
+		// not connected yet (or any more): without a buffer they wait for the CONNACK, or for disconnect() to drop them
+		if (!this->isConnected && !this->offlineBuffer) {
+			return;
+		}
+		if (!this->isConnected) {
+			QueuedPublish queued;
+			while (this->publishQueue.tryPop(queued)) {
+				this->queuedCount.fetch_sub(1, std::memory_order_relaxed);
+				if (!this->offlineBuffer->push(queued.topic, queued.qos, queued.payload)) {
+					PUBSUPP_LOG_WARN("Offline buffer full, message to " << queued.topic << " dropped");
+				}
+			}
+			return;
+		}
+
+		// with all packet ids in flight the rest stays queued until acks free some up
+		QueuedPublish queued;
+		while (this->sessionState->packetIdAvailable() && this->publishQueue.tryPop(queued)) {
+			this->queuedCount.fetch_sub(1, std::memory_order_relaxed);
+			this->startPublish(queued.topic, queued.qos, queued.payload, nullptr, queued.enqueuedNs);
+		}
+	}
+
+
+	// after an explicit disconnect without an offline buffer nothing would ever send what is still queued
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::discardPublishQueue() {
+		size_t dropped = 0;
+		QueuedPublish queued;
+		while (this->publishQueue.tryPop(queued)) {
+			this->queuedCount.fetch_sub(1, std::memory_order_relaxed);
+			++dropped;
+		}
+		if (dropped > 0) {
+			PUBSUPP_LOG_WARN("Disconnected with " << dropped << " enqueued messages unsent, dropped");
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::spawn(Task<void> task) {
+		this->tasks.push_back(std::move(task));
+		this->tasks.back().start();
+		this->reapTasks();
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::runUntilComplete(Task<void> task) {
+		task.start();
+		while (!task.done()) {
+			this->poll(-1);
+		}
+		task.result();
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::waitFor(Completion& completion) {
+		while (!completion.done) {
+			this->poll(-1);
+		}
+		if (completion.error) {
+			std::rethrow_exception(completion.error);
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::registerCompletion(uint16_t packetId, Completion* completion) {
+		if (packetId >= this->completions.size()) {
+			this->completions.resize(std::min<size_t>(65536, std::max<size_t>(packetId + 1, this->completions.size() * 2)));
+		}
+		this->completions[packetId] = completion;
+	}
+
+
+	template <MqttTransport Transport>
+	auto BasicMqttClient<Transport>::takeCompletion(uint16_t packetId) -> Completion* {
+		if (packetId >= this->completions.size()) {
+			return nullptr;
+		}
+		return std::exchange(this->completions[packetId], nullptr);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::complete(Completion* completion, uint8_t returnCode, std::exception_ptr error) {
+		if (!completion) {
+			return;
+		}
+
+		completion->done = true;
+		completion->returnCode = returnCode;
+		completion->error = error;
+		if (completion->waiter) {
+			this->ready.push_back(completion->waiter);
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::failPending(std::exception_ptr error) {
+		for (Completion*& completion : this->completions) {
+			this->complete(std::exchange(completion, nullptr), 0, error);
+		}
+		this->complete(std::exchange(this->connackCompletion, nullptr), 0, error);
+	}
+
+
+	// resume tasks whose request completed, they may complete further requests in turn
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::resumeReady() {
+		std::vector<std::coroutine_handle<>> resuming;
+		while (!this->ready.empty()) {
+			resuming.swap(this->ready);
+			for (std::coroutine_handle<> handle : resuming) {
+				handle.resume();
+			}
+			resuming.clear();
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::reapTasks() {
+		for (auto it = this->tasks.begin(); it != this->tasks.end();) {
+			if (!it->done()) {
+				++it;
+				continue;
+			}
+
+			try {
+				it->result();
+			} catch (const std::exception& e) {
+				PUBSUPP_LOG_ERROR("Task failed: " << e.what());
+			}
+			it = this->tasks.erase(it);
+		}
+	}
+
+
+
+
+
+	// inbound dispatch
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handleIncoming(const std::vector<uint8_t>& frame) {
+		MessageType type = static_cast<MessageType>(frame[0] >> 4);
+
+		switch (type) {
+			case MessageType::CONNACK: this->handleConnack(frame); break;
+			case MessageType::PUBLISH: this->handlePublish(frame); break;
+			case MessageType::SUBACK: this->handleSuback(frame); break;
+			// acks are decoded straight from the frame, they carry nothing but the packet id
+			case MessageType::PUBACK:
+			case MessageType::PUBREC:
+			case MessageType::PUBCOMP: this->handleOutboundAck(type, decodeAckPacketId(type, frame)); break;
+			case MessageType::PUBREL: this->handlePubrel(decodeAckPacketId(type, frame)); break;
+			case MessageType::PINGRESP: break;
+			default: throw std::runtime_error("Unexpected message type from broker: " + std::to_string(static_cast<int>(type)));
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handleConnack(const std::vector<uint8_t>& frame) {
+		PUBSUPP_LOG_DEBUG("CONNACK message received (" << frame.size() << " bytes)");
+		Completion* completion = std::exchange(this->connackCompletion, nullptr);
+
+		auto connackMsg = parseConnackMessage(frame);
+
+		if (!ConnackMessageHelper::isSuccess(*connackMsg)) {
+			uint8_t returnCode = ConnackMessageHelper::returnCode(*connackMsg);
+			std::string description = ConnackMessageHelper::getReturnCodeDescription(*connackMsg);
+
+			this->isConnected = false; // set early by connectPipelined
+			this->complete(completion, returnCode, std::make_exception_ptr(std::runtime_error("Connection refused: " + description + " (code: " + std::to_string(returnCode) + ")")));
+			return;
+		}
+
+		bool sessionPresent = ConnackMessageHelper::sessionPresent(*connackMsg);
+		this->isConnected = true;
+		PUBSUPP_LOG_INFO("Connection established" << (sessionPresent ? ", session present" : ""));
+
+		if (!std::exchange(this->inflightResentEarly, false)) {
+			this->resendInflight();
+		}
+		this->complete(completion);
+	}
+
+
+	/*
+	 * Acks for our own publishes (4.3.2, 4.3.3), matched against the in-flight table by packet id.
+	 * Acks for unknown ids (e.g. duplicates after a resend) are ignored.
+	 */
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handleOutboundAck(MessageType type, uint16_t packetId) {
+		const InflightMessage* entry = this->sessionState->findOutbound(packetId);
+		SessionRecordType expected = type == MessageType::PUBCOMP ? SessionRecordType::OUTBOUND_PUBREL : SessionRecordType::OUTBOUND_PUBLISH;
+
+		if (!entry || entry->state != expected) {
+			PUBSUPP_LOG_WARN("Ignoring acknowledgement for unknown packet ID " << packetId);
+			return;
+		}
+
+		if (type == MessageType::PUBREC) {
+			// QoS2, second half: PUBREL -> PUBCOMP
+			this->sessionState->markPubrelSent(packetId);
+			this->sendAck(MessageType::PUBREL, packetId);
+			return;
+		}
+
+		PUBSUPP_LOG_TRACE("Publish acknowledged (packet ID: " << packetId << ")");
+		if (this->latencyRecorders && packetId < this->latencyRecorders->writtenNs.size() && this->latencyRecorders->writtenNs[packetId] != 0) {
+			this->latencyRecorders->writeToAck.recordSince(std::exchange(this->latencyRecorders->writtenNs[packetId], 0));
+		}
+		this->sessionState->releaseOutbound(packetId);
+		this->connectionMetrics.setInflight(this->sessionState->outboundCount());
+		this->complete(this->takeCompletion(packetId));
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handleSuback(const std::vector<uint8_t>& frame) {
+		PUBSUPP_LOG_DEBUG("SUBACK message received (" << frame.size() << " bytes)");
+
+		auto subackMsg = parseSubackMessage(frame);
+		const SubackMessage* suback = dynamic_cast<const SubackMessage*>(subackMsg.get());
+		if (!suback) {
+			throw std::runtime_error("Failed to cast to SubackMessage");
+		}
+
+		uint16_t packetId = suback->getPacketId();
+		Completion* completion = this->takeCompletion(packetId);
+		if (!completion) {
+			PUBSUPP_LOG_WARN("Ignoring SUBACK for unknown packet ID " << packetId);
+			return;
+		}
+		this->sessionState->releasePacketId(packetId);
+
+		if (!suback->isSuccess()) {
+			uint8_t returnCode = suback->getReturnCode();
+			this->complete(completion, returnCode, std::make_exception_ptr(std::runtime_error("Subscription failed: server returned failure code (0x" + std::to_string(returnCode) + ")")));
+			return;
+		}
+
+		this->complete(completion, suback->getReturnCode());
+	}
+
+
+	/*
+	 * PUBLISH from the broker (4.3): QoS1 is acknowledged after the handler ran,
+	 * QoS2 is only delivered once and remembered until the broker releases it with PUBREL.
+	 */
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handlePublish(const std::vector<uint8_t>& frame) {
+		// handled inline, messages are decoded into the same object every time. Queued jobs own theirs,
+		// and so does a message arriving while handlers still look at the previous one (nested poll)
+		std::unique_ptr<PublishMessage> owned;
+		PublishMessage* decoded = &this->inboundPublish;
+		if (this->handlerExecutor || this->inboundPublishInUse) {
+			owned = std::make_unique<PublishMessage>();
+			decoded = owned.get();
+		}
+		decoded->decodeInPlace(frame);
+
+		uint64_t decodedNs = this->latencyRecorders ? monotonicNs() : 0;
+		const PublishMessage& publish = *decoded;
+		uint16_t packetId = publish.getPacketId();
+
+		bool deliver = true;
+		if (publish.getQoS() == QoS::EXACTLY_ONCE) {
+			deliver = !this->sessionState->hasInbound(packetId);
+			if (deliver) {
+				this->sessionState->storeInbound(packetId);
+			}
+		}
+
+		// still acknowledged below, the broker has to stop redelivering
+		if (deliver && this->duplicateFilter && this->duplicateFilter->isDuplicate(publish)) {
+			deliver = false;
+		}
+
+		QoS qos = publish.getQoS();
+		if (deliver) {
+			// cached before the handlers run, so they see their own message in there
+			if (this->lastValueCache) {
+				this->lastValueCache->update(publish);
+			}
+			bool reused = !owned;
+			if (reused) {
+				this->inboundPublishInUse = true;
+			}
+			this->dispatch(publish, std::move(owned), decodedNs);
+			if (reused) {
+				this->inboundPublishInUse = false;
+			}
+		}
+
+		if (qos == QoS::AT_LEAST_ONCE) {
+			this->sendAck(MessageType::PUBACK, packetId);
+		} else if (qos == QoS::EXACTLY_ONCE) {
+			this->sendAck(MessageType::PUBREC, packetId);
+		}
+	}
+
+
+	/*
+	 * Hands a received message to the catch-all handler and the handlers of all matching subscriptions,
+	 * either right away or queued on the handler executor.
+	 */
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::dispatch(const PublishMessage& publish, std::unique_ptr<PublishMessage> owned, uint64_t decodedNs) {
+		// the trie is only walked again for a topic once the subscriptions changed
+		auto cached = this->routes.find(std::string_view(publish.getTopic()));
+		if (cached == this->routes.end()) {
+			if (this->routes.size() >= MAX_ROUTES) {
+				this->routes.clear();
+			}
+			cached = this->routes.emplace(publish.getTopic(), Route{}).first;
+		}
+		Route& route = cached->second;
+		uint64_t version = this->subscriptions.version();
+		if (route.version != version) {
+			route.subscriptions = std::make_shared<const SubscriptionList>(this->subscriptions.match(publish.getTopic()));
+			route.version = version;
+		}
+
+		LatencyRecorders* latencies = this->latencyRecorders.get();
+		auto run = [latencies, decodedNs](const PublishMessage& publish, const MessageHandler* catchAll, const SubscriptionList& subscriptions) {
+			uint64_t startNs = 0;
+			if (latencies) {
+				startNs = monotonicNs();
+				latencies->decodeToHandler.record(startNs > decodedNs ? startNs - decodedNs : 0);
+			}
+
+			auto call = [&publish](const MessageHandler& handler) {
+				try {
+					handler(publish);
+				} catch (const std::exception& e) {
+					PUBSUPP_LOG_ERROR("Message handler failed for topic " << publish.getTopic() << ": " << e.what());
+				}
+			};
+
+			if (catchAll && *catchAll) {
+				call(*catchAll);
+			}
+			for (const auto& subscription : subscriptions) {
+				call(subscription->handler);
+			}
+
+			if (latencies) {
+				latencies->handlerRun.recordSince(startNs);
+			}
+		};
+
+		if (!this->handlerExecutor) {
+			run(publish, this->messageHandler.get(), *route.subscriptions);
+			return;
+		}
+
+		// the job owns everything it touches, handlers may be replaced while it is queued
+		std::shared_ptr<const PublishMessage> shared(std::move(owned));
+		this->handlerExecutor->submit(this->partitionKey(publish), [run, shared, catchAll = this->messageHandler, subscriptions = route.subscriptions]() {
+			run(*shared, catchAll.get(), *subscriptions);
+		});
+	}
+
+
+	template <MqttTransport Transport>
+	uint64_t BasicMqttClient<Transport>::partitionKey(const PublishMessage& publish) const {
+		const std::string& topic = publish.getTopic();
+		if (this->partitionPrefixLevels == 0) {
+			return std::hash<std::string_view>{}(topic);
+		}
+
+		size_t end = 0;
+		for (size_t level = 0; level < this->partitionPrefixLevels; ++level) {
+			end = topic.find('/', level == 0 ? 0 : end + 1);
+			if (end == std::string::npos) {
+				break;
+			}
+		}
+		return std::hash<std::string_view>{}(std::string_view(topic).substr(0, end));
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::handlePubrel(uint16_t packetId) {
+		this->sessionState->releaseInbound(packetId);
+		this->sendAck(MessageType::PUBCOMP, packetId);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::sendAck(MessageType type, uint16_t packetId) {
+		std::array<uint8_t, 4> ack = encodeAck(type, packetId);
+		this->writePacket(ack.data(), ack.size());
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::writePacket(const uint8_t* data, size_t length) {
+		if (this->corked) {
+			this->corkBuffer.insert(this->corkBuffer.end(), data, data + length);
+			return;
+		}
+		this->transport.trySend(data, length);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::uncork() {
+		this->corked = false;
+		if (!this->corkBuffer.empty()) {
+			this->transport.trySend(this->corkBuffer.data(), this->corkBuffer.size());
+		}
+		this->corkBuffer.clear();
+	}
+
+
+
+
+
+	// awaitable operations
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::ConnectOperation::await_suspend(std::coroutine_handle<> waiter) {
+		this->completion.waiter = waiter;
+		this->client.startConnect(this->client.host, this->client.port, this->completion);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::ConnectOperation::await_resume() {
+		if (this->completion.error) {
+			std::rethrow_exception(this->completion.error);
+		}
+	}
+
+
+	// QoS 0 completes right away, the coroutine is not suspended at all
+	template <MqttTransport Transport>
+	bool BasicMqttClient<Transport>::PublishOperation::await_suspend(std::coroutine_handle<> waiter) {
+		this->completion.waiter = waiter;
+		return this->client.startPublish(this->topic, this->qos, this->payload, &this->completion) != 0;
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::PublishOperation::await_resume() {
+		if (this->completion.error) {
+			std::rethrow_exception(this->completion.error);
+		}
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::SubscribeOperation::await_suspend(std::coroutine_handle<> waiter) {
+		this->completion.waiter = waiter;
+		this->client.startSubscribe(this->topic, this->qos, this->completion);
+	}
+
+
+	template <MqttTransport Transport>
+	void BasicMqttClient<Transport>::SubscribeOperation::await_resume() {
+		if (this->completion.error) {
+			std::rethrow_exception(this->completion.error);
+		}
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mqttSessionState.hpp"
+
+
+
+
+namespace pubsupp {
+	// note: the session log relies on mmap, so it is only available on Linux/macOS
+
+	static constexpr char LOG_MAGIC[8] = {'P', 'S', 'S', 'E', 'S', 'S', '0', '1'};
+	static constexpr size_t FILE_HEADER_SIZE = 16; // magic + 8 reserved bytes
+
+	// record layout: length (4) | packet id (2) | type (1) | reserved (1) | checksum (4) | data
+	static constexpr size_t RECORD_HEADER_SIZE = 12;
+
+
+	// FNV-1a, cheap enough to not show up next to the memcpy
+	static uint32_t checksum(const uint8_t* header, const uint8_t* data, uint32_t length) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < 8; ++i) {
+			hash = (hash ^ header[i]) * 16777619u;
+		}
+		for (uint32_t i = 0; i < length; ++i) {
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+
+	static size_t writeRecord(uint8_t* dst, SessionRecordType type, uint16_t packetId, const uint8_t* data, uint32_t length) {
+		uint8_t header[RECORD_HEADER_SIZE] = {};
+		std::memcpy(header, &length, 4);
+		std::memcpy(header + 4, &packetId, 2);
+		header[6] = static_cast<uint8_t>(type);
+
+		uint32_t sum = checksum(header, data, length);
+		std::memcpy(header + 8, &sum, 4);
+
+		// data first, header last: a record only becomes visible once it is complete
+		if (length > 0) {
+			std::memcpy(dst + RECORD_HEADER_SIZE, data, length);
+		}
+		std::memcpy(dst, header, RECORD_HEADER_SIZE);
+
+		return RECORD_HEADER_SIZE + length;
+	}
+
+
+	static uint8_t* mapFile(int fd, size_t size) {
+		void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			throw std::runtime_error("Failed to map session log: " + std::string(std::strerror(errno)));
+		}
+		return static_cast<uint8_t*>(addr);
+	}
+
+
+
+
+
+	InflightMessage& InflightTable::insert(uint16_t packetId, SessionRecordType state) {
+		if (packetId >= this->slots.size()) {
+			this->slots.resize(std::min<size_t>(65536, std::max<size_t>(packetId + 1, this->slots.size() * 2)));
+		}
+
+		InflightMessage& entry = this->slots[packetId];
+		if (entry.state == SessionRecordType::NONE) {
+			entry.packetId = packetId;
+			entry.prev = this->tail;
+			entry.next = 0;
+
+			if (this->tail != 0) {
+				this->slots[this->tail].next = packetId;
+			} else {
+				this->head = packetId;
+			}
+			this->tail = packetId;
+			this->count++;
+		}
+
+		entry.state = state;
+		return entry;
+	}
+
+
+	void InflightTable::erase(uint16_t packetId) {
+		InflightMessage* entry = this->find(packetId);
+		if (!entry) {
+			return;
+		}
+
+		if (entry->prev != 0) {
+			this->slots[entry->prev].next = entry->next;
+		} else {
+			this->head = entry->next;
+		}
+		if (entry->next != 0) {
+			this->slots[entry->next].prev = entry->prev;
+		} else {
+			this->tail = entry->prev;
+		}
+
+		// data keeps its capacity, the next message in this slot reuses it
+		entry->state = SessionRecordType::NONE;
+		entry->data.clear();
+		entry->prev = 0;
+		entry->next = 0;
+		this->count--;
+	}
+
+
+	void InflightTable::clear() {
+		this->slots.clear();
+		this->head = 0;
+		this->tail = 0;
+		this->count = 0;
+	}
+
+
+
+
+
+	SessionState::SessionState(const std::string& path, size_t capacity, uint32_t syncInterval)
+		: path(path), syncInterval(syncInterval == 0 ? 1 : syncInterval) {
+		this->open(std::max(capacity, FILE_HEADER_SIZE + RECORD_HEADER_SIZE));
+	}
+
+
+	SessionState::~SessionState() {
+		if (this->base) {
+			::msync(this->base, this->capacity, MS_SYNC);
+		}
+		this->unmap();
+		if (this->fd != -1) {
+			::close(this->fd);
+		}
+	}
+
+
+	void SessionState::open(size_t minCapacity) {
+		this->fd = ::open(this->path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (this->fd == -1) {
+			throw std::runtime_error("Failed to open session log " + this->path + ": " + std::strerror(errno));
+		}
+
+		struct stat st;
+		if (::fstat(this->fd, &st) == -1) {
+			throw std::runtime_error("Failed to stat session log " + this->path);
+		}
+
+		bool fresh = st.st_size == 0;
+		size_t size = std::max(static_cast<size_t>(st.st_size), minCapacity);
+		if (static_cast<size_t>(st.st_size) < size && ::ftruncate(this->fd, size) == -1) {
+			throw std::runtime_error("Failed to resize session log " + this->path);
+		}
+
+		this->map(size);
+
+		if (fresh) {
+			std::memcpy(this->base, LOG_MAGIC, sizeof(LOG_MAGIC));
+		} else if (std::memcmp(this->base, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+			throw std::runtime_error("Invalid session log: " + this->path);
+		}
+
+		this->replay();
+	}
+
+
+	void SessionState::map(size_t size) {
+		this->base = mapFile(this->fd, size);
+		this->capacity = size;
+	}
+
+
+	void SessionState::unmap() {
+		if (this->base) {
+			::munmap(this->base, this->capacity);
+			this->base = nullptr;
+		}
+	}
+
+
+	void SessionState::replay() {
+		size_t offset = FILE_HEADER_SIZE;
+		bool torn = false;
+
+		while (offset + RECORD_HEADER_SIZE <= this->capacity) {
+			const uint8_t* header = this->base + offset;
+			if (header[6] == static_cast<uint8_t>(SessionRecordType::NONE)) {
+				break; // end of log
+			}
+
+			uint32_t length;
+			uint16_t packetId;
+			uint32_t sum;
+			std::memcpy(&length, header, 4);
+			std::memcpy(&packetId, header + 4, 2);
+			std::memcpy(&sum, header + 8, 4);
+
+			if (offset + RECORD_HEADER_SIZE + length > this->capacity || checksum(header, header + RECORD_HEADER_SIZE, length) != sum) {
+				torn = true;
+				break;
+			}
+
+			this->apply(static_cast<SessionRecordType>(header[6]), packetId, header + RECORD_HEADER_SIZE, length);
+			offset += RECORD_HEADER_SIZE + length;
+		}
+
+		// drop whatever is left of a record that was being written when the process died
+		if (torn) {
+			std::memset(this->base + offset, 0, this->capacity - offset);
+		}
+
+		this->writeOffset = offset;
+		this->syncedOffset = offset;
+	}
+
+
+	void SessionState::apply(SessionRecordType type, uint16_t packetId, const uint8_t* data, uint32_t length) {
+		switch (type) {
+			case SessionRecordType::OUTBOUND_PUBLISH:
+				this->packetIds.reserve(packetId);
+				this->outbound.insert(packetId, type).data.assign(data, data + length);
+				break;
+			case SessionRecordType::OUTBOUND_PUBREL:
+				this->packetIds.reserve(packetId);
+				this->outbound.insert(packetId, type).data.clear(); // the publish itself is not needed anymore
+				break;
+			case SessionRecordType::INBOUND_PUBREC:
+				if (!this->inbound.test(packetId)) {
+					this->inbound.set(packetId);
+					this->inboundEntries++;
+				}
+				break;
+			case SessionRecordType::RELEASE_OUTBOUND:
+				this->outbound.erase(packetId);
+				this->packetIds.release(packetId);
+				break;
+			case SessionRecordType::RELEASE_INBOUND:
+				if (this->inbound.test(packetId)) {
+					this->inbound.reset(packetId);
+					this->inboundEntries--;
+				}
+				break;
+			default: throw std::runtime_error("Invalid session record type: " + std::to_string(static_cast<int>(type)));
+		}
+	}
+
+
+	void SessionState::append(SessionRecordType type, uint16_t packetId, const uint8_t* data, uint32_t length) {
+		if (!this->base) { // in memory only
+			this->apply(type, packetId, data, length);
+			return;
+		}
+
+		size_t recordSize = RECORD_HEADER_SIZE + length;
+
+		if (this->writeOffset + recordSize > this->capacity) {
+			this->compact();
+
+			// still no room: grow the log
+			if (this->writeOffset + recordSize > this->capacity) {
+				size_t newCapacity = this->capacity;
+				while (this->writeOffset + recordSize > newCapacity) {
+					newCapacity *= 2;
+				}
+
+				this->unmap();
+				if (::ftruncate(this->fd, newCapacity) == -1) {
+					throw std::runtime_error("Failed to grow session log " + this->path);
+				}
+				this->map(newCapacity);
+			}
+		}
+
+		this->writeOffset += writeRecord(this->base + this->writeOffset, type, packetId, data, length);
+		this->apply(type, packetId, data, length);
+
+		if (++this->unsyncedRecords >= this->syncInterval) {
+			size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+			size_t start = this->syncedOffset & ~(pageSize - 1);
+
+			::msync(this->base + start, this->writeOffset - start, MS_ASYNC);
+			this->syncedOffset = this->writeOffset;
+			this->unsyncedRecords = 0;
+		}
+	}
+
+
+	size_t SessionState::liveBytes() const {
+		size_t bytes = FILE_HEADER_SIZE;
+		this->outbound.forEach([&bytes](const InflightMessage& entry) { bytes += RECORD_HEADER_SIZE + entry.data.size(); });
+		bytes += this->inboundEntries * RECORD_HEADER_SIZE;
+		return bytes;
+	}
+
+
+	void SessionState::storeOutbound(uint16_t packetId, const std::vector<uint8_t>& publishData) {
+		this->append(SessionRecordType::OUTBOUND_PUBLISH, packetId, publishData.data(), static_cast<uint32_t>(publishData.size()));
+	}
+
+
+	void SessionState::markPubrelSent(uint16_t packetId) {
+		this->append(SessionRecordType::OUTBOUND_PUBREL, packetId, nullptr, 0);
+	}
+
+
+	void SessionState::releaseOutbound(uint16_t packetId) {
+		if (!this->outbound.find(packetId)) {
+			return;
+		}
+		this->append(SessionRecordType::RELEASE_OUTBOUND, packetId, nullptr, 0);
+	}
+
+
+	void SessionState::storeInbound(uint16_t packetId) {
+		this->append(SessionRecordType::INBOUND_PUBREC, packetId, nullptr, 0);
+	}
+
+
+	void SessionState::releaseInbound(uint16_t packetId) {
+		if (!this->inbound.test(packetId)) {
+			return;
+		}
+		this->append(SessionRecordType::RELEASE_INBOUND, packetId, nullptr, 0);
+	}
+
+
+	std::vector<const InflightMessage*> SessionState::pendingOutbound() const {
+		std::vector<const InflightMessage*> pending;
+		pending.reserve(this->outbound.size());
+		this->outbound.forEach([&pending](const InflightMessage& entry) { pending.push_back(&entry); });
+		return pending;
+	}
+
+
+	void SessionState::sync() {
+		if (!this->base) {
+			return;
+		}
+		if (::msync(this->base, this->writeOffset, MS_SYNC) == -1) {
+			throw std::runtime_error("Failed to sync session log " + this->path);
+		}
+		this->syncedOffset = this->writeOffset;
+		this->unsyncedRecords = 0;
+	}
+
+
+	/*
+	 * Rewrite the live entries into `<path>.compact` and rename it over the log.
+	 * Entries keep their relative order, so replaying the new log yields the same state.
+	 */
+	void SessionState::compact() {
+		if (!this->base) {
+			return;
+		}
+
+		size_t newCapacity = std::max(this->capacity, this->liveBytes() * 2);
+		std::string tmpPath = this->path + ".compact";
+
+		int newFd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (newFd == -1) {
+			throw std::runtime_error("Failed to create " + tmpPath + ": " + std::strerror(errno));
+		}
+		if (::ftruncate(newFd, newCapacity) == -1) {
+			::close(newFd);
+			throw std::runtime_error("Failed to resize " + tmpPath);
+		}
+
+		uint8_t* newBase;
+		try {
+			newBase = mapFile(newFd, newCapacity);
+		} catch (...) {
+			::close(newFd);
+			throw;
+		}
+
+		std::memcpy(newBase, LOG_MAGIC, sizeof(LOG_MAGIC));
+		size_t offset = FILE_HEADER_SIZE;
+
+		this->outbound.forEach([&](const InflightMessage& entry) {
+			offset += writeRecord(newBase + offset, entry.state, entry.packetId, entry.data.data(), static_cast<uint32_t>(entry.data.size()));
+		});
+
+		for (uint32_t id = 1; id < this->inbound.size(); ++id) {
+			if (this->inbound.test(id)) {
+				offset += writeRecord(newBase + offset, SessionRecordType::INBOUND_PUBREC, static_cast<uint16_t>(id), nullptr, 0);
+			}
+		}
+
+		if (::msync(newBase, offset, MS_SYNC) == -1 || ::rename(tmpPath.c_str(), this->path.c_str()) == -1) {
+			::munmap(newBase, newCapacity);
+			::close(newFd);
+			throw std::runtime_error("Failed to replace session log " + this->path);
+		}
+
+		this->unmap();
+		::close(this->fd);
+
+		this->fd = newFd;
+		this->base = newBase;
+		this->capacity = newCapacity;
+		this->writeOffset = offset;
+		this->syncedOffset = offset;
+		this->unsyncedRecords = 0;
+	}
+
+} // namespace pubsupp
@@ -1,23 +1,154 @@
-#include <memory>
-#include <queue>
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 
 #include "messages/mqttMessage.hpp"
+#include "packetIdAllocator.hpp"
 
 
 
 namespace pubsupp {
-	// TODO
+
+	// kind of a single record in the session log
+	enum class SessionRecordType : uint8_t {
+		NONE = 0, // end of log (zero filled)
+		OUTBOUND_PUBLISH = 1, // QoS1/QoS2 publish sent, waiting for PUBACK/PUBREC
+		OUTBOUND_PUBREL = 2, // QoS2: PUBREC received, PUBREL sent, waiting for PUBCOMP
+		INBOUND_PUBREC = 3, // QoS2: publish received, PUBREC sent, waiting for PUBREL
+		RELEASE_OUTBOUND = 4, // tombstone for an outbound entry
+		RELEASE_INBOUND = 5 // tombstone for an inbound entry
+	};
+
+
+	struct InflightMessage {
+		uint16_t packetId = 0;
+		SessionRecordType state = SessionRecordType::NONE; // NONE = free slot
+		std::vector<uint8_t> data; // encoded PUBLISH packet, kept while waiting for PUBACK/PUBREC
+
+		// links in insertion order (packet ids, 0 = none)
+		uint16_t prev = 0;
+		uint16_t next = 0;
+	};
+
+
+
+	/*
+	 * Flat table of in-flight messages, indexed directly by packet id.
+	 * Entries are linked in insertion order, so they can be replayed in the order they were sent.
+	 * The slab only grows up to the highest id in use, which PacketIdAllocator keeps low.
+	 */
+	class InflightTable {
+	  public:
+		InflightMessage* find(uint16_t packetId) {
+			if (packetId >= this->slots.size() || this->slots[packetId].state == SessionRecordType::NONE) {
+				return nullptr;
+			}
+			return &this->slots[packetId];
+		}
+
+		const InflightMessage* find(uint16_t packetId) const { return const_cast<InflightTable*>(this)->find(packetId); }
+
+		// an existing entry keeps its position, only its state changes
+		InflightMessage& insert(uint16_t packetId, SessionRecordType state);
+		void erase(uint16_t packetId);
+		void clear();
+
+		size_t size() const { return this->count; }
+
+		template <typename Fn>
+		void forEach(Fn&& fn) const {
+			for (uint16_t id = this->head; id != 0; id = this->slots[id].next) {
+				fn(this->slots[id]);
+			}
+		}
+
+	  private:
+		std::vector<InflightMessage> slots;
+		uint16_t head = 0;
+		uint16_t tail = 0;
+		size_t count = 0;
+	};
+
+
+
+	/*
+	 * Client session state (4.1)
+	 * https://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html
+	 *
+	 * - QoS 1 and QoS 2 messages which have been sent to the Server, but have not been completely acknowledged
+	 * - QoS 2 messages which have been received from the Server, but have not been completely acknowledged
+	 *
+	 * Also owns the packet identifiers: ids of stored messages stay taken until they are released.
+	 *
+	 * Optionally the state is backed by an append-only log in a memory-mapped file, so a restarted
+	 * process can pick up its session again. Every change is a single record memcpy'd to
+	 * the end of the mapping; removing an entry appends a tombstone. Once the log runs full
+	 * it gets compacted into a fresh file holding only the live entries, which then replaces
+	 * the old one via rename (so a crash mid compaction leaves the old log intact).
+	 *
+	 * Records carry a checksum, replaying stops at the first torn or corrupt record.
+	 * The mapping is msync'd asynchronously every `syncInterval` records, sync() forces it.
+	 */
 	class SessionState {
 	  public:
-		SessionState();
+		SessionState() = default; // in memory only
+		SessionState(const std::string& path, size_t capacity = 4 * 1024 * 1024, uint32_t syncInterval = 64);
 		~SessionState();
 
+		SessionState(const SessionState&) = delete;
+		SessionState& operator=(const SessionState&) = delete;
+
+		uint16_t acquirePacketId() { return this->packetIds.acquire(); }
+		void releasePacketId(uint16_t packetId) { this->packetIds.release(packetId); }
+		bool packetIdAvailable() const { return this->packetIds.inUse() < 65535; }
+
+		void storeOutbound(uint16_t packetId, const std::vector<uint8_t>& publishData);
+		void markPubrelSent(uint16_t packetId);
+		void releaseOutbound(uint16_t packetId);
+		const InflightMessage* findOutbound(uint16_t packetId) const { return this->outbound.find(packetId); }
+
+		void storeInbound(uint16_t packetId);
+		void releaseInbound(uint16_t packetId);
+		bool hasInbound(uint16_t packetId) const { return this->inbound.test(packetId); }
+
+		// outbound entries in the order they were stored
+		std::vector<const InflightMessage*> pendingOutbound() const;
+		size_t outboundCount() const { return this->outbound.size(); }
+		size_t inboundCount() const { return this->inboundEntries; }
+
+		bool isPersistent() const { return this->base != nullptr; }
+		void sync();
+		void compact();
+
 	  private:
+		void open(size_t minCapacity);
+		void map(size_t size);
+		void unmap();
+		void replay();
+		void append(SessionRecordType type, uint16_t packetId, const uint8_t* data, uint32_t length);
+		void apply(SessionRecordType type, uint16_t packetId, const uint8_t* data, uint32_t length);
+		size_t liveBytes() const;
+
+		std::string path;
+		uint32_t syncInterval = 0;
+		int fd = -1;
+		uint8_t* base = nullptr;
+		size_t capacity = 0;
+		size_t writeOffset = 0;
+		size_t syncedOffset = 0;
+		uint32_t unsyncedRecords = 0;
+
+		PacketIdAllocator packetIds;
 		// QoS1 + QoS2 msgs sent to server but not completely acknowledged
-		std::queue<std::shared_ptr<MqttMessage>> sentToSrvNotAcked;
+		InflightTable outbound;
 		// QoS2 msgs received from server but not completely acknowledged
-		std::queue<std::shared_ptr<MqttMessage>> receivedBySrvNotCompleted;
+		std::bitset<65536> inbound;
+		size_t inboundEntries = 0;
 	};
 
 
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+	#include <sys/eventfd.h>
+#endif
+
+#include "notifier.hpp"
+
+
+
+
+namespace pubsupp {
+
+	Notifier::Notifier() {
+#ifdef __linux__
+		this->readFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (this->readFd == -1) {
+			throw std::runtime_error("Failed to create eventfd");
+		}
+		this->writeFd = this->readFd;
+#else
+		int fds[2];
+		if (::pipe(fds) == -1) {
+			throw std::runtime_error("Failed to create pipe");
+		}
+		for (int fd : fds) {
+			::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+		}
+		this->readFd = fds[0];
+		this->writeFd = fds[1];
+#endif
+	}
+
+
+	Notifier::~Notifier() {
+		if (this->writeFd != this->readFd) {
+			::close(this->writeFd);
+		}
+		::close(this->readFd);
+	}
+
+
+	void Notifier::notify() {
+		uint64_t one = 1;
+		// a full pipe / counter means a wakeup is pending anyway
+		[[maybe_unused]] ssize_t written = ::write(this->writeFd, &one, sizeof(one));
+	}
+
+
+	void Notifier::drain() {
+		uint64_t buffer[16];
+		while (::read(this->readFd, buffer, sizeof(buffer)) > 0) {
+		}
+	}
+
+
+	void Notifier::wait(int timeoutMs) {
+		struct pollfd pfd = {};
+		pfd.fd = this->readFd;
+		pfd.events = POLLIN;
+		::poll(&pfd, 1, timeoutMs);
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,31 @@
+#pragma once
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Wakes up a thread blocked in poll() from another thread.
+	 * Backed by an eventfd on Linux and a pipe elsewhere, fd() is what goes into the poll set.
+	 */
+	class Notifier {
+	  public:
+		Notifier();
+		~Notifier();
+
+		Notifier(const Notifier&) = delete;
+		Notifier& operator=(const Notifier&) = delete;
+
+		void notify();
+		// reset after waking up
+		void drain();
+		// block until notified, timeoutMs < 0 waits forever
+		void wait(int timeoutMs);
+		int fd() const { return this->readFd; }
+
+	  private:
+		int readFd = -1;
+		int writeFd = -1;
+	};
+
+} // namespace pubsupp
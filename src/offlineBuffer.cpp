@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+	#include <process.h>
+	#define getpid _getpid
+#else
+	#include <unistd.h>
+#endif
+
+#include "offlineBuffer.hpp"
+
+
+
+
+namespace pubsupp {
+	static constexpr size_t RECORD_HEADER_SIZE = 7; // length (4) + qos (1) + topic length (2)
+	static std::atomic<uint64_t> nextInstance = 0;
+
+
+	static void encodeRecord(std::vector<uint8_t>& record, const std::string& topic, QoS qos, const std::string& payload) {
+		uint32_t length = static_cast<uint32_t>(RECORD_HEADER_SIZE + topic.size() + payload.size());
+		uint16_t topicLength = static_cast<uint16_t>(topic.size());
+
+		record.resize(length);
+		std::memcpy(record.data(), &length, 4);
+		record[4] = static_cast<uint8_t>(qos);
+		std::memcpy(record.data() + 5, &topicLength, 2);
+		std::memcpy(record.data() + RECORD_HEADER_SIZE, topic.data(), topic.size());
+		std::memcpy(record.data() + RECORD_HEADER_SIZE + topic.size(), payload.data(), payload.size());
+	}
+
+
+	static void decodeRecord(const uint8_t* record, uint32_t length, BufferedPublish& out) {
+		uint16_t topicLength;
+		std::memcpy(&topicLength, record + 5, 2);
+
+		out.qos = static_cast<QoS>(record[4]);
+		out.topic.assign(reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE), topicLength);
+		out.payload.assign(reinterpret_cast<const char*>(record + RECORD_HEADER_SIZE + topicLength), length - RECORD_HEADER_SIZE - topicLength);
+	}
+
+
+
+
+
+	OfflineBuffer::OfflineBuffer(size_t memoryLimit, const std::string& spillDirectory, size_t segmentSize, size_t diskLimit)
+		: ring(memoryLimit), spillDirectory(spillDirectory), segmentSize(segmentSize), diskLimit(diskLimit) {
+		if (!this->spillDirectory.empty()) {
+			this->segmentPrefix = this->spillDirectory + "/pubsupp-offline-" + std::to_string(getpid()) + "-" + std::to_string(nextInstance++) + "-";
+		}
+	}
+
+
+	OfflineBuffer::~OfflineBuffer() {
+		this->writer.close();
+		this->reader.close();
+		for (const Segment& segment : this->segments) {
+			std::remove(segment.path.c_str());
+		}
+	}
+
+
+	bool OfflineBuffer::push(const std::string& topic, QoS qos, const std::string& payload) {
+		if (topic.size() > 65535) {
+			throw std::runtime_error("Topic too long to buffer: " + std::to_string(topic.size()) + " bytes");
+		}
+
+		encodeRecord(this->scratch, topic, qos, payload);
+
+		// once something is on disk, everything newer has to go there too
+		if (this->diskCount == 0 && this->ring.size() - this->ringUsed >= this->scratch.size()) {
+			this->ringWrite(this->scratch.data(), this->scratch.size());
+			this->ringCount++;
+			this->count++;
+			return true;
+		}
+
+		if (!this->spill(this->scratch)) {
+			this->droppedCount++;
+			return false;
+		}
+		this->count++;
+		return true;
+	}
+
+
+	bool OfflineBuffer::pop(BufferedPublish& out) {
+		if (this->ringCount > 0) {
+			uint32_t length;
+			this->ringRead(reinterpret_cast<uint8_t*>(&length), 4);
+			this->scratch.resize(length);
+			std::memcpy(this->scratch.data(), &length, 4);
+			this->ringRead(this->scratch.data() + 4, length - 4);
+
+			decodeRecord(this->scratch.data(), length, out);
+			this->ringCount--;
+			this->count--;
+			return true;
+		}
+
+		if (this->diskCount > 0) {
+			this->readFromDisk(out);
+			this->count--;
+			return true;
+		}
+
+		return false;
+	}
+
+
+	void OfflineBuffer::ringWrite(const uint8_t* data, size_t length) {
+		size_t position = (this->ringHead + this->ringUsed) % this->ring.size();
+		size_t first = std::min(length, this->ring.size() - position);
+
+		std::memcpy(this->ring.data() + position, data, first);
+		std::memcpy(this->ring.data(), data + first, length - first);
+		this->ringUsed += length;
+	}
+
+
+	void OfflineBuffer::ringRead(uint8_t* data, size_t length) {
+		size_t first = std::min(length, this->ring.size() - this->ringHead);
+
+		std::memcpy(data, this->ring.data() + this->ringHead, first);
+		std::memcpy(data + first, this->ring.data(), length - first);
+		this->ringHead = (this->ringHead + length) % this->ring.size();
+		this->ringUsed -= length;
+	}
+
+
+	bool OfflineBuffer::spill(const std::vector<uint8_t>& record) {
+		if (this->spillDirectory.empty() || this->diskUsed + record.size() > this->diskLimit) {
+			return false;
+		}
+
+		// roll over to a new segment
+		if (!this->writer.is_open() || this->segments.back().bytes >= this->segmentSize) {
+			this->writer.close();
+
+			Segment segment;
+			segment.path = this->createSegment();
+			this->writer.open(segment.path, std::ios::binary | std::ios::trunc); // empty, it was just created
+			if (!this->writer) {
+				throw std::runtime_error("Failed to create offline buffer segment " + segment.path);
+			}
+			this->segments.push_back(segment);
+		}
+
+		this->writer.write(reinterpret_cast<const char*>(record.data()), record.size());
+		if (!this->writer) {
+			throw std::runtime_error("Failed to write offline buffer segment " + this->segments.back().path);
+		}
+
+		this->segments.back().bytes += record.size();
+		this->segments.back().records++;
+		this->diskUsed += record.size();
+		this->diskCount++;
+		return true;
+	}
+
+
+	// a new, empty segment file: names left over by an earlier process with the same pid are skipped, not reused
+	std::string OfflineBuffer::createSegment() {
+		while (true) {
+			std::string path = this->segmentPrefix + std::to_string(this->nextSegment++) + ".seg";
+			std::FILE* file = std::fopen(path.c_str(), "wbx");
+			if (file) {
+				std::fclose(file);
+				return path;
+			}
+			if (errno != EEXIST) {
+				throw std::runtime_error("Failed to create offline buffer segment " + path + ": " + std::strerror(errno));
+			}
+		}
+	}
+
+
+	bool OfflineBuffer::readFromDisk(BufferedPublish& out) {
+		Segment& segment = this->segments.front();
+
+		if (!this->reader.is_open()) {
+			// reading the segment that is still being written: finish it, new records start the next one
+			if (this->segments.size() == 1 && this->writer.is_open()) {
+				this->writer.close();
+			}
+
+			this->reader.open(segment.path, std::ios::binary);
+			if (!this->reader) {
+				throw std::runtime_error("Failed to open offline buffer segment " + segment.path);
+			}
+		}
+
+		uint32_t length;
+		this->reader.read(reinterpret_cast<char*>(&length), 4);
+		this->scratch.resize(length);
+		std::memcpy(this->scratch.data(), &length, 4);
+		this->reader.read(reinterpret_cast<char*>(this->scratch.data() + 4), length - 4);
+		if (!this->reader) {
+			throw std::runtime_error("Failed to read offline buffer segment " + segment.path);
+		}
+
+		decodeRecord(this->scratch.data(), length, out);
+		this->diskUsed -= length;
+		this->diskCount--;
+
+		if (--segment.records == 0) {
+			this->reader.close();
+			std::remove(segment.path.c_str());
+			this->segments.pop_front();
+		}
+		return true;
+	}
+
+} // namespace pubsupp
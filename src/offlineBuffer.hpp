@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+#include "messages/mqttMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	struct BufferedPublish {
+		std::string topic;
+		QoS qos = QoS::AT_MOST_ONCE;
+		std::string payload;
+	};
+
+
+
+	/*
+	 * Publishes kept while the broker is unreachable, oldest first.
+	 *
+	 * Messages are serialized into a fixed-size in-memory ring (`memoryLimit` bytes). Once the ring
+	 * is full, new messages spill to segment files in `spillDirectory`, written and read strictly
+	 * sequentially. While anything is on disk new messages keep going there, so the order is kept:
+	 * the ring drains first, then the segments, oldest segment first. Fully read segments are deleted.
+	 *
+	 * Without a spill directory, or once `diskLimit` is reached, push() refuses new messages.
+	 * Segments only extend the buffer, they are removed again when the buffer is destroyed.
+	 * Segment names carry the process id and a per-process instance number, and a segment is only
+	 * ever created new, so buffers sharing a spill directory never write into each other's files.
+	 *
+	 * record: length (4) | qos (1) | topic length (2) | topic | payload
+	 */
+	class OfflineBuffer {
+	  public:
+		OfflineBuffer(size_t memoryLimit, const std::string& spillDirectory = "", size_t segmentSize = 16 * 1024 * 1024, size_t diskLimit = 1024 * 1024 * 1024);
+		~OfflineBuffer();
+
+		OfflineBuffer(const OfflineBuffer&) = delete;
+		OfflineBuffer& operator=(const OfflineBuffer&) = delete;
+
+		// false if the message did not fit and was dropped
+		bool push(const std::string& topic, QoS qos, const std::string& payload);
+		bool pop(BufferedPublish& out);
+
+		bool empty() const { return this->count == 0; }
+		size_t size() const { return this->count; }
+		size_t memoryBytes() const { return this->ringUsed; }
+		size_t diskBytes() const { return this->diskUsed; }
+		size_t dropped() const { return this->droppedCount; }
+
+	  private:
+		struct Segment {
+			std::string path;
+			size_t bytes = 0;
+			size_t records = 0;
+		};
+
+		void ringWrite(const uint8_t* data, size_t length);
+		void ringRead(uint8_t* data, size_t length);
+		bool spill(const std::vector<uint8_t>& record);
+		std::string createSegment();
+		bool readFromDisk(BufferedPublish& out);
+
+		// memory ring
+		std::vector<uint8_t> ring;
+		size_t ringHead = 0; // read position
+		size_t ringUsed = 0;
+		size_t ringCount = 0;
+
+		// disk segments, front = oldest
+		std::string spillDirectory;
+		std::string segmentPrefix; // <spillDirectory>/pubsupp-offline-<pid>-<instance>-
+		size_t segmentSize;
+		size_t diskLimit;
+		std::deque<Segment> segments;
+		std::ofstream writer;
+		std::ifstream reader;
+		size_t diskUsed = 0;
+		size_t diskCount = 0;
+		uint64_t nextSegment = 0;
+
+		size_t count = 0;
+		size_t droppedCount = 0;
+		std::vector<uint8_t> scratch;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,72 @@
+#include <bit>
+#include <stdexcept>
+
+#include "packetIdAllocator.hpp"
+
+
+
+
+namespace pubsupp {
+
+	PacketIdAllocator::PacketIdAllocator() {
+		this->clear();
+	}
+
+
+	void PacketIdAllocator::clear() {
+		this->words.fill(0);
+		this->fullWords.fill(0);
+		this->words[0] = 1; // id 0 is invalid, keep it permanently taken
+		this->count = 0;
+	}
+
+
+	uint16_t PacketIdAllocator::acquire() {
+		for (size_t i = 0; i < SUMMARY_WORDS; ++i) {
+			uint64_t candidates = ~this->fullWords[i];
+			if (candidates == 0) {
+				continue;
+			}
+
+			size_t word = i * 64 + std::countr_zero(candidates);
+			uint16_t packetId = static_cast<uint16_t>(word * 64 + std::countr_zero(~this->words[word]));
+			this->take(packetId);
+			return packetId;
+		}
+
+		throw std::runtime_error("No packet identifier available: 65535 messages in flight");
+	}
+
+
+	void PacketIdAllocator::take(uint16_t packetId) {
+		size_t word = packetId >> 6;
+		this->words[word] |= 1ULL << (packetId & 63);
+		if (this->words[word] == ~0ULL) {
+			this->fullWords[word >> 6] |= 1ULL << (word & 63);
+		}
+		this->count++;
+	}
+
+
+	void PacketIdAllocator::reserve(uint16_t packetId) {
+		if (packetId == 0) {
+			throw std::runtime_error("Invalid packet identifier: 0");
+		}
+		if (!this->isInUse(packetId)) {
+			this->take(packetId);
+		}
+	}
+
+
+	void PacketIdAllocator::release(uint16_t packetId) {
+		if (packetId == 0 || !this->isInUse(packetId)) {
+			return;
+		}
+
+		size_t word = packetId >> 6;
+		this->words[word] &= ~(1ULL << (packetId & 63));
+		this->fullWords[word >> 6] &= ~(1ULL << (word & 63));
+		this->count--;
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Packet identifier allocator (2.3.1)
+	 * https://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html
+	 *
+	 * - Packet identifiers are 16 bit, 0 is not a valid identifier
+	 * - A identifier becomes available for reuse once the matching acknowledgement was processed
+	 *
+	 * Ids in use are tracked in a 64K-bit bitmap, a 1K-bit summary marks the bitmap words that are
+	 * completely full. acquire() hands out the lowest free id: a find-first-zero over the summary and
+	 * then over one bitmap word, so at most a few word scans no matter how many messages are in flight.
+	 * Preferring low ids keeps tables indexed by packet id as small as the number of messages in flight.
+	 */
+	class PacketIdAllocator {
+	  public:
+		PacketIdAllocator();
+
+		// throws if all 65535 ids are in use
+		uint16_t acquire();
+		// mark an id handed out elsewhere (e.g. restored from a session) as in use
+		void reserve(uint16_t packetId);
+		void release(uint16_t packetId);
+		void clear();
+
+		bool isInUse(uint16_t packetId) const { return (this->words[packetId >> 6] >> (packetId & 63)) & 1; }
+		size_t inUse() const { return this->count; }
+
+	  private:
+		static constexpr size_t WORDS = 65536 / 64;
+		static constexpr size_t SUMMARY_WORDS = WORDS / 64;
+
+		void take(uint16_t packetId);
+
+		std::array<uint64_t, WORDS> words;
+		std::array<uint64_t, SUMMARY_WORDS> fullWords;
+		size_t count = 0;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,171 @@
+#include "partitionedExecutor.hpp"
+
+#include <algorithm>
+#include <exception>
+
+
+#include "logger.hpp"
+
+
+
+namespace pubsupp {
+
+	PartitionedExecutor::PartitionedExecutor(size_t workers, size_t partitionsPerWorker) {
+		workers = std::max<size_t>(workers, 1);
+		size_t partitionCount = workers * std::max<size_t>(partitionsPerWorker, 1);
+
+		for (size_t i = 0; i < partitionCount; ++i) {
+			this->partitions.push_back(std::make_unique<Partition>());
+		}
+		for (size_t i = 0; i < workers; ++i) {
+			this->workers.push_back(std::make_unique<Worker>());
+		}
+		// started only once all workers exist, they steal from each other
+		for (size_t i = 0; i < workers; ++i) {
+			this->workers[i]->thread = std::thread([this, i]() { this->workerLoop(i); });
+		}
+	}
+
+
+	PartitionedExecutor::~PartitionedExecutor() {
+		this->drain();
+		{
+			std::lock_guard<std::mutex> lock(this->sleepMutex);
+			this->stopping = true;
+		}
+		this->wakeup.notify_all();
+
+		for (auto& worker : this->workers) {
+			worker->thread.join();
+		}
+	}
+
+
+	void PartitionedExecutor::submit(uint64_t key, std::function<void()> job) {
+		// keys are often small dense ids, mix them before picking the partition
+		key *= 0x9E3779B97F4A7C15ull;
+		uint32_t index = static_cast<uint32_t>((key >> 32) % this->partitions.size());
+		Partition& partition = *this->partitions[index];
+
+		this->pendingJobs.fetch_add(1, std::memory_order_relaxed);
+		bool schedule = false;
+		{
+			std::lock_guard<std::mutex> lock(partition.mutex);
+			partition.jobs.push_back(std::move(job));
+			if (!partition.scheduled) {
+				partition.scheduled = true;
+				schedule = true;
+			}
+		}
+
+		if (schedule) {
+			this->schedule(index % this->workers.size(), index);
+		}
+	}
+
+
+	void PartitionedExecutor::drain() {
+		std::unique_lock<std::mutex> lock(this->sleepMutex);
+		this->idle.wait(lock, [this]() { return this->pendingJobs.load() == 0; });
+	}
+
+
+	void PartitionedExecutor::schedule(size_t worker, uint32_t partition) {
+		{
+			std::lock_guard<std::mutex> lock(this->workers[worker]->mutex);
+			this->workers[worker]->ready.push_back(partition);
+		}
+		{
+			// under the sleep mutex, so a worker about to sleep cannot miss it
+			std::lock_guard<std::mutex> lock(this->sleepMutex);
+			this->readyCount.fetch_add(1);
+		}
+		this->wakeup.notify_one();
+	}
+
+
+	bool PartitionedExecutor::takePartition(size_t self, uint32_t& partition) {
+		{
+			Worker& own = *this->workers[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.ready.empty()) {
+				partition = own.ready.front();
+				own.ready.pop_front();
+				this->readyCount.fetch_sub(1);
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < this->workers.size(); ++i) {
+			Worker& victim = *this->workers[(self + i) % this->workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.ready.empty()) {
+				partition = victim.ready.back();
+				victim.ready.pop_back();
+				this->readyCount.fetch_sub(1);
+				this->steals.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+	void PartitionedExecutor::workerLoop(size_t self) {
+		while (true) {
+			uint32_t partition;
+			if (this->takePartition(self, partition)) {
+				this->runPartition(self, partition);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(this->sleepMutex);
+			this->wakeup.wait(lock, [this]() { return this->stopping || this->readyCount.load() > 0; });
+			if (this->stopping && this->readyCount.load() == 0) {
+				return;
+			}
+		}
+	}
+
+
+	void PartitionedExecutor::runPartition(size_t self, uint32_t index) {
+		Partition& partition = *this->partitions[index];
+
+		for (size_t i = 0; i < BATCH_SIZE; ++i) {
+			std::function<void()> job;
+			{
+				std::lock_guard<std::mutex> lock(partition.mutex);
+				if (partition.jobs.empty()) {
+					partition.scheduled = false;
+					return;
+				}
+				job = std::move(partition.jobs.front());
+				partition.jobs.pop_front();
+			}
+
+			try {
+				job();
+			} catch (const std::exception& e) {
+				PUBSUPP_LOG_ERROR("Partitioned job failed: " << e.what());
+			} catch (...) {
+				PUBSUPP_LOG_ERROR("Partitioned job failed with an unknown exception");
+			}
+
+			if (this->pendingJobs.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(this->sleepMutex);
+				this->idle.notify_all();
+			}
+		}
+
+		// batch used up: requeue behind the other ready partitions, still marked scheduled
+		{
+			std::lock_guard<std::mutex> lock(partition.mutex);
+			if (partition.jobs.empty()) {
+				partition.scheduled = false;
+				return;
+			}
+		}
+		this->schedule(self, index);
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Runs jobs on a pool of worker threads, keeping jobs with the same key (topic) in order.
+	 *
+	 * Keys are hashed onto a fixed set of partitions, several per worker. A partition is a FIFO
+	 * of jobs that is scheduled on at most one worker at a time, so jobs of one key never overlap
+	 * or overtake each other, while different partitions run in parallel.
+	 *
+	 * A partition with pending jobs sits in the ready deque of its home worker. Workers take from
+	 * the front of their own deque and, once that is empty, steal from the back of the others',
+	 * so one slow partition only holds up the keys hashed onto it.
+	 * A partition runs a bounded batch of jobs and is then requeued, for fairness between partitions.
+	 */
+	class PartitionedExecutor {
+	  public:
+		explicit PartitionedExecutor(size_t workers = std::thread::hardware_concurrency(), size_t partitionsPerWorker = 16);
+		~PartitionedExecutor(); // runs everything still queued, then joins the workers
+
+		PartitionedExecutor(const PartitionedExecutor&) = delete;
+		PartitionedExecutor& operator=(const PartitionedExecutor&) = delete;
+
+		void submit(uint64_t key, std::function<void()> job);
+		void submit(std::string_view key, std::function<void()> job) { this->submit(std::hash<std::string_view>{}(key), std::move(job)); }
+
+		// block until every job submitted so far has run
+		void drain();
+
+		size_t workerCount() const { return this->workers.size(); }
+		uint64_t stolen() const { return this->steals.load(std::memory_order_relaxed); }
+
+	  private:
+		static constexpr size_t BATCH_SIZE = 32;
+
+		struct Partition {
+			std::mutex mutex;
+			std::deque<std::function<void()>> jobs;
+			bool scheduled = false; // queued on or running on a worker
+		};
+
+		struct Worker {
+			std::mutex mutex;
+			std::deque<uint32_t> ready; // partitions
+			std::thread thread;
+		};
+
+		void workerLoop(size_t self);
+		bool takePartition(size_t self, uint32_t& partition);
+		void schedule(size_t worker, uint32_t partition);
+		void runPartition(size_t self, uint32_t partition);
+
+		std::vector<std::unique_ptr<Partition>> partitions;
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		std::mutex sleepMutex;
+		std::condition_variable wakeup;
+		std::condition_variable idle;
+		std::atomic<size_t> readyCount = 0; // partitions in any ready deque
+		std::atomic<size_t> pendingJobs = 0;
+		std::atomic<uint64_t> steals = 0;
+		bool stopping = false;
+	};
+
+} // namespace pubsupp
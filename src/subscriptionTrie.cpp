@@ -0,0 +1,149 @@
+#include "subscriptionTrie.hpp"
+
+#include <stdexcept>
+
+
+#include "topic.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		std::vector<std::string> parseFilterLevels(const std::string& filter) {
+			if (!TopicFilter::isValid(filter)) {
+				throw std::runtime_error("Invalid topic filter: " + filter);
+			}
+
+			std::vector<std::string> levels;
+			size_t start = 0;
+			while (true) {
+				size_t pos = filter.find('/', start);
+				if (pos == std::string::npos) {
+					levels.emplace_back(filter.substr(start));
+					return levels;
+				}
+				levels.emplace_back(filter.substr(start, pos - start));
+				start = pos + 1;
+			}
+		}
+	} // namespace
+
+
+
+	SubscriptionTrie::SubscriptionTrie() : root(std::make_shared<const Node>()) {}
+
+
+	SubscriptionId SubscriptionTrie::add(const std::string& filter, MessageHandler handler) {
+		std::vector<std::string> levels = parseFilterLevels(filter);
+
+		std::lock_guard<std::mutex> lock(this->writeMutex);
+		auto subscription = std::make_shared<Subscription>();
+		subscription->id = this->nextId++;
+		subscription->filter = filter;
+		subscription->handler = std::move(handler);
+
+		std::shared_ptr<const Node> current = this->root.load(std::memory_order_relaxed);
+		this->root.store(insert(current.get(), levels, 0, subscription), std::memory_order_release);
+		this->filters.emplace(subscription->id, filter);
+		this->writes.fetch_add(1, std::memory_order_release);
+
+		return subscription->id;
+	}
+
+
+	bool SubscriptionTrie::remove(SubscriptionId id) {
+		std::lock_guard<std::mutex> lock(this->writeMutex);
+		auto it = this->filters.find(id);
+		if (it == this->filters.end()) {
+			return false;
+		}
+
+		std::vector<std::string> levels = parseFilterLevels(it->second);
+		std::shared_ptr<const Node> current = this->root.load(std::memory_order_relaxed);
+		std::shared_ptr<const Node> updated = erase(*current, levels, 0, id);
+		this->root.store(updated ? updated : std::make_shared<const Node>(), std::memory_order_release);
+		this->filters.erase(it);
+		this->writes.fetch_add(1, std::memory_order_release);
+
+		return true;
+	}
+
+
+	size_t SubscriptionTrie::size() const {
+		std::lock_guard<std::mutex> lock(this->writeMutex);
+		return this->filters.size();
+	}
+
+
+	std::vector<std::shared_ptr<const Subscription>> SubscriptionTrie::match(std::string_view topic) const {
+		std::vector<std::shared_ptr<const Subscription>> matches;
+		std::shared_ptr<const Node> root = this->root.load(std::memory_order_acquire);
+		bool systemTopic = !topic.empty() && topic[0] == '$';
+
+		// shared_ptr copies keep the subscriptions alive after the snapshot is dropped
+		auto collect = [&](const Subscription& subscription) {
+			matches.emplace_back(std::shared_ptr<const Subscription>(root, &subscription));
+		};
+		matchLevel(*root, topic, 0, systemTopic, collect);
+
+		return matches;
+	}
+
+
+	// copies the path down to the filter's node, untouched subtrees are shared with the old trie
+	std::shared_ptr<const SubscriptionTrie::Node> SubscriptionTrie::insert(const Node* node, const std::vector<std::string>& levels, size_t index, const std::shared_ptr<const Subscription>& subscription) {
+		auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+
+		if (index == levels.size()) {
+			copy->exact.push_back(subscription);
+			return copy;
+		}
+
+		const std::string& level = levels[index];
+		if (level == "#") {
+			copy->multiLevel.push_back(subscription);
+		} else if (level == "+") {
+			copy->plus = insert(copy->plus.get(), levels, index + 1, subscription);
+		} else {
+			auto& child = copy->children[level];
+			child = insert(child.get(), levels, index + 1, subscription);
+		}
+		return copy;
+	}
+
+
+	// returns nullptr if the node ends up empty, so dead branches get pruned
+	std::shared_ptr<const SubscriptionTrie::Node> SubscriptionTrie::erase(const Node& node, const std::vector<std::string>& levels, size_t index, SubscriptionId id) {
+		auto copy = std::make_shared<Node>(node);
+		auto dropId = [id](std::vector<std::shared_ptr<const Subscription>>& subscriptions) {
+			std::erase_if(subscriptions, [id](const auto& subscription) { return subscription->id == id; });
+		};
+
+		if (index == levels.size()) {
+			dropId(copy->exact);
+		} else if (levels[index] == "#") {
+			dropId(copy->multiLevel);
+		} else if (levels[index] == "+") {
+			if (copy->plus) {
+				copy->plus = erase(*copy->plus, levels, index + 1, id);
+			}
+		} else {
+			auto child = copy->children.find(levels[index]);
+			if (child != copy->children.end()) {
+				std::shared_ptr<const Node> updated = erase(*child->second, levels, index + 1, id);
+				if (updated) {
+					child->second = std::move(updated);
+				} else {
+					copy->children.erase(child);
+				}
+			}
+		}
+
+		if (copy->empty()) {
+			return nullptr;
+		}
+		return copy;
+	}
+
+} // namespace pubsupp
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+#include "messages/publishMessage.hpp"
+
+
+
+namespace pubsupp {
+
+	using MessageHandler = std::function<void(const PublishMessage&)>;
+	using SubscriptionId = uint64_t;
+
+
+	struct Subscription {
+		SubscriptionId id = 0;
+		std::string filter;
+		MessageHandler handler;
+	};
+
+
+
+	/*
+	 * Routes topics to the handlers of all matching topic filters (4.7).
+	 *
+	 * Filters are stored level by level: literal levels are looked up in a hash map per node,
+	 * '+' and '#' have their own slot. Matching a topic walks its levels once, following the literal
+	 * and the '+' branch, and collects '#' subscriptions on the way, so it costs time proportional to the
+	 * topic depth instead of the number of filters.
+	 * Topics starting with '$' are not matched by a leading wildcard (4.7.2).
+	 *
+	 * Readers never lock: they work on an immutable snapshot of the trie. Writers (serialized by a mutex)
+	 * copy the nodes along the changed path and publish a new root, which makes add/remove rather expensive
+	 * but keeps matching wait-free with respect to them.
+	 */
+	class SubscriptionTrie {
+	  public:
+		SubscriptionTrie();
+
+		// throws if the filter is invalid
+		SubscriptionId add(const std::string& filter, MessageHandler handler);
+		bool remove(SubscriptionId id);
+		size_t size() const;
+		// bumped on every add/remove, lets callers cache match results
+		uint64_t version() const { return this->writes.load(std::memory_order_acquire); }
+
+		// calls fn(const Subscription&) for every subscription matching the topic
+		template <typename Fn>
+		void forEachMatch(std::string_view topic, Fn&& fn) const {
+			std::shared_ptr<const Node> root = this->root.load(std::memory_order_acquire);
+			bool systemTopic = !topic.empty() && topic[0] == '$';
+			matchLevel(*root, topic, 0, systemTopic, fn);
+		}
+
+		std::vector<std::shared_ptr<const Subscription>> match(std::string_view topic) const;
+
+	  private:
+		struct StringHash {
+			using is_transparent = void;
+			size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+		};
+
+		struct Node {
+			std::unordered_map<std::string, std::shared_ptr<const Node>, StringHash, std::equal_to<>> children;
+			std::shared_ptr<const Node> plus; // '+'
+			std::vector<std::shared_ptr<const Subscription>> multiLevel; // '#' below this node
+			std::vector<std::shared_ptr<const Subscription>> exact; // filter ends at this node
+
+			bool empty() const { return this->children.empty() && !this->plus && this->multiLevel.empty() && this->exact.empty(); }
+		};
+
+		template <typename Fn>
+		static void matchLevel(const Node& node, std::string_view topic, size_t start, bool noWildcards, Fn& fn) {
+			// '#' also matches the parent level: "sport/#" matches "sport"
+			if (!noWildcards) {
+				for (const auto& subscription : node.multiLevel) {
+					fn(*subscription);
+				}
+			}
+
+			if (start > topic.size()) { // all levels consumed
+				for (const auto& subscription : node.exact) {
+					fn(*subscription);
+				}
+				return;
+			}
+
+			size_t end = topic.find('/', start);
+			if (end == std::string_view::npos) {
+				end = topic.size();
+			}
+			std::string_view level = topic.substr(start, end - start);
+
+			auto child = node.children.find(level);
+			if (child != node.children.end()) {
+				matchLevel(*child->second, topic, end + 1, false, fn);
+			}
+			if (node.plus && !noWildcards) {
+				matchLevel(*node.plus, topic, end + 1, false, fn);
+			}
+		}
+
+		static std::shared_ptr<const Node> insert(const Node* node, const std::vector<std::string>& levels, size_t index, const std::shared_ptr<const Subscription>& subscription);
+		static std::shared_ptr<const Node> erase(const Node& node, const std::vector<std::string>& levels, size_t index, SubscriptionId id);
+
+		std::atomic<std::shared_ptr<const Node>> root;
+		mutable std::mutex writeMutex;
+		std::unordered_map<SubscriptionId, std::string> filters;
+		SubscriptionId nextId = 1;
+		std::atomic<uint64_t> writes = 0;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+
+
+namespace pubsupp {
+
+	/*
+	 * Lazy coroutine task used together with the awaitable MqttClient operations.
+	 *
+	 * A Task does not run until it is co_await'ed or handed to MqttClient::spawn().
+	 * When it finishes, control transfers straight back to whoever awaited it (symmetric transfer),
+	 * so chains of tasks neither grow the stack nor need a scheduler.
+	 */
+	template <typename T = void>
+	class Task;
+
+
+	namespace detail {
+		template <typename T>
+		struct TaskPromiseBase {
+			std::coroutine_handle<> continuation;
+			std::exception_ptr error;
+
+			struct FinalAwaiter {
+				bool await_ready() const noexcept { return false; }
+
+				template <typename Promise>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+					std::coroutine_handle<> continuation = handle.promise().continuation;
+					return continuation ? continuation : std::noop_coroutine();
+				}
+
+				void await_resume() const noexcept {}
+			};
+
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			FinalAwaiter final_suspend() const noexcept { return {}; }
+			void unhandled_exception() noexcept { this->error = std::current_exception(); }
+		};
+
+
+		template <typename T>
+		struct TaskPromise : TaskPromiseBase<T> {
+			std::optional<T> value;
+
+			Task<T> get_return_object() noexcept;
+			void return_value(T v) { this->value.emplace(std::move(v)); }
+
+			T result() {
+				if (this->error) {
+					std::rethrow_exception(this->error);
+				}
+				return std::move(*this->value);
+			}
+		};
+
+
+		template <>
+		struct TaskPromise<void> : TaskPromiseBase<void> {
+			Task<void> get_return_object() noexcept;
+			void return_void() const noexcept {}
+
+			void result() {
+				if (this->error) {
+					std::rethrow_exception(this->error);
+				}
+			}
+		};
+	} // namespace detail
+
+
+
+	template <typename T>
+	class Task {
+	  public:
+		using promise_type = detail::TaskPromise<T>;
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Task() = default;
+		explicit Task(Handle handle) : handle(handle) {}
+		Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other) {
+				this->destroy();
+				this->handle = std::exchange(other.handle, {});
+			}
+			return *this;
+		}
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+		~Task() { this->destroy(); }
+
+		bool done() const { return !this->handle || this->handle.done(); }
+
+		// run until the first suspension point (used by the event loop for detached tasks)
+		void start() {
+			if (this->handle && !this->handle.done()) {
+				this->handle.resume();
+			}
+		}
+
+		// value of a finished task, rethrows whatever escaped the coroutine
+		decltype(auto) result() { return this->handle.promise().result(); }
+
+		bool await_ready() const noexcept { return this->done(); }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+			this->handle.promise().continuation = awaiting;
+			return this->handle;
+		}
+
+		decltype(auto) await_resume() { return this->handle.promise().result(); }
+
+	  private:
+		void destroy() {
+			if (this->handle) {
+				this->handle.destroy();
+				this->handle = {};
+			}
+		}
+
+		Handle handle;
+	};
+
+
+
+	namespace detail {
+		template <typename T>
+		Task<T> TaskPromise<T>::get_return_object() noexcept {
+			return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+		}
+
+		inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+			return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+		}
+	} // namespace detail
+
+} // namespace pubsupp
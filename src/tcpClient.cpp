@@ -1,11 +1,37 @@
+#include <cerrno>
+#include <cstddef>
 #include <cstring>
-#include <iostream>
 #include <stdexcept>
 #include <vector>
 
+#include "logger.hpp"
+#include "messages/mqttMessage.hpp"
 #include "tcpClient.hpp"
 
 namespace pubsupp {
+    namespace {
+        // a write into a connection the broker reset fails with EPIPE instead of raising SIGPIPE,
+        // which would end the process before the offline buffer and reconnect could take over
+#ifdef MSG_NOSIGNAL
+        constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+        constexpr int SEND_FLAGS = 0; // no SIGPIPE on Windows, macOS sets SO_NOSIGPIPE on the socket instead
+#endif
+
+
+        SocketType openSocket(int family) {
+            SocketType handle = socket(family, SOCK_STREAM, 0);
+#ifdef SO_NOSIGPIPE
+            if (handle != INVALID_SOCKET_VALUE) {
+                int on = 1;
+                ::setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+            }
+#endif
+            return handle;
+        }
+    } // namespace
+
+
     void TcpClient::initializeSocket() {
         // note: windows specific code is AI-generated, I only implemented and tested it
         // on Linux...
@@ -38,10 +64,10 @@ namespace pubsupp {
     TcpClient::TcpClient()
         : ipAddress("127.0.0.1"), port(8080), tcpSocket(INVALID_SOCKET_VALUE),
           socketInitialized(false) {
-        std::cout << "TcpClient created with IP " << ipAddress << " and port " << port << std::endl;
+        PUBSUPP_LOG_DEBUG("TcpClient created with IP " << ipAddress << " and port " << port);
         this->initializeSocket();
 
-        this->tcpSocket = socket(AF_INET, SOCK_STREAM, 0);
+        this->tcpSocket = openSocket(AF_INET);
         if (tcpSocket == INVALID_SOCKET_VALUE) {
             this->cleanupSocket();
 
@@ -53,10 +79,10 @@ namespace pubsupp {
     TcpClient::TcpClient(std::string &serverAddress, int serverPort)
         : ipAddress(serverAddress), port(serverPort),
           tcpSocket(INVALID_SOCKET_VALUE), socketInitialized(false) {
-        std::cout << "TcpClient created with IP " << ipAddress << " and port " << port << std::endl;
+        PUBSUPP_LOG_DEBUG("TcpClient created with IP " << ipAddress << " and port " << port);
         this->initializeSocket();
 
-        this->tcpSocket = socket(AF_INET, SOCK_STREAM, 0);
+        this->tcpSocket = openSocket(AF_INET);
         if (tcpSocket == INVALID_SOCKET_VALUE) {
             this->cleanupSocket();
             throw std::runtime_error("Failed to create socket");
@@ -65,18 +91,120 @@ namespace pubsupp {
 
 
     TcpClient::~TcpClient() {
-        std::cout << "TcpClient destroyed" << std::endl;
+        PUBSUPP_LOG_DEBUG("TcpClient destroyed");
         this->disconnect();
         this->cleanupSocket();
     }
 
 
     void TcpClient::tryConnect(std::string &serverAddress, int serverPort) {
+        struct sockaddr_storage server;
+        socklen_t serverLength = this->prepareConnect(serverAddress, serverPort, server);
+
+        if (::connect(this->tcpSocket, (struct sockaddr *)&server, serverLength) == SOCKET_ERROR_VALUE) {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+            this->disconnect();
+            throw std::runtime_error("Failed to connect to server " + this->endpoint() + " (Error: " + std::to_string(error) + ")");
+#else
+            this->disconnect(); // the socket is unusable after a failed connect
+            throw std::runtime_error("Failed to connect to server " + this->endpoint());
+#endif
+        }
+    }
+
+
+    // starts the handshake without waiting for it: true if it is already done, else the socket turns
+    // writable once it finished and finishConnect() tells how it went
+    bool TcpClient::beginConnect(std::string &serverAddress, int serverPort) {
+        struct sockaddr_storage server;
+        socklen_t serverLength = this->prepareConnect(serverAddress, serverPort, server);
+        this->setBlocking(false);
+
+        if (::connect(this->tcpSocket, (struct sockaddr *)&server, serverLength) != SOCKET_ERROR_VALUE) {
+            this->setBlocking(true);
+            return true;
+        }
+#ifdef _WIN32
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK) {
+            return false;
+        }
+#else
+        int error = errno;
+        if (error == EINPROGRESS) {
+            return false;
+        }
+#endif
+        this->disconnect();
+        throw std::runtime_error("Failed to connect to server " + this->endpoint() + " (Error: " + std::to_string(error) + ")");
+    }
+
+
+    void TcpClient::finishConnect() {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(this->tcpSocket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &length) == SOCKET_ERROR_VALUE || error != 0) {
+            this->disconnect();
+            throw std::runtime_error("Failed to connect to server " + this->endpoint() + " (Error: " + std::to_string(error) + ")");
+        }
+        this->setBlocking(true); // everything after the handshake uses blocking I/O
+    }
+
+
+    std::string unixSocketPath(const std::string &address) {
+        static const std::string scheme = "unix://";
+        if (address.rfind(scheme, 0) != 0) {
+            return "";
+        }
+        if (address.size() == scheme.size()) {
+            throw std::runtime_error("Missing socket path in broker address: " + address);
+        }
+        return address.substr(scheme.size());
+    }
+
+
+    socklen_t TcpClient::prepareConnect(std::string &serverAddress, int serverPort, struct sockaddr_storage &address) {
         this->serverAddress = serverAddress;
         this->serverPort = serverPort;
+        std::memset(&address, 0, sizeof(address));
 
-        struct sockaddr_in server;
-        std::memset(&server, 0, sizeof(server));
+        std::string path = unixSocketPath(serverAddress);
+#ifdef _WIN32
+        if (!path.empty()) {
+            throw std::runtime_error("Unix domain sockets are not supported on this platform");
+        }
+        int family = AF_INET;
+#else
+        int family = path.empty() ? AF_INET : AF_UNIX;
+#endif
+
+        // reconnecting: the previous socket was closed by disconnect() or a failed attempt,
+        // or it was opened for the other kind of address
+        if (this->tcpSocket != INVALID_SOCKET_VALUE && this->socketFamily != family) {
+            this->disconnect();
+        }
+        if (this->tcpSocket == INVALID_SOCKET_VALUE) {
+            this->tcpSocket = openSocket(family);
+            if (this->tcpSocket == INVALID_SOCKET_VALUE) {
+                throw std::runtime_error("Failed to create socket");
+            }
+            this->socketFamily = family;
+        }
+
+#ifndef _WIN32
+        if (family == AF_UNIX) {
+            struct sockaddr_un *local = reinterpret_cast<struct sockaddr_un *>(&address);
+            if (path.size() >= sizeof(local->sun_path)) {
+                throw std::runtime_error("Unix socket path too long: " + path);
+            }
+            local->sun_family = AF_UNIX;
+            std::memcpy(local->sun_path, path.c_str(), path.size() + 1);
+            return static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size() + 1);
+        }
+#endif
+
+        struct sockaddr_in &server = reinterpret_cast<struct sockaddr_in &>(address);
         server.sin_family = AF_INET;
         server.sin_port = htons(this->serverPort);
 
@@ -99,23 +227,38 @@ namespace pubsupp {
             }
         }
 #endif
+        return sizeof(struct sockaddr_in);
+    }
+
+
+    std::string TcpClient::endpoint() const {
+        if (this->serverAddress.rfind("unix://", 0) == 0) {
+            return this->serverAddress; // no port
+        }
+        return this->serverAddress + ":" + std::to_string(this->serverPort);
+    }
 
-        if (::connect(this->tcpSocket, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR_VALUE) {
+
+    void TcpClient::setBlocking(bool blocking) {
 #ifdef _WIN32
-            int error = WSAGetLastError();
-            throw std::runtime_error("Failed to connect to server " + serverAddress + ":" + std::to_string(this->serverPort) + " (Error: " + std::to_string(error) + ")");
+        u_long nonBlocking = blocking ? 0 : 1;
+        if (::ioctlsocket(this->tcpSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+            throw std::runtime_error("Failed to change blocking mode of socket");
+        }
 #else
-            throw std::runtime_error("Failed to connect to server " + serverAddress + ":" + std::to_string(this->serverPort));
-#endif
+        int flags = ::fcntl(this->tcpSocket, F_GETFL, 0);
+        if (flags == -1 || ::fcntl(this->tcpSocket, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK) == -1) {
+            throw std::runtime_error("Failed to change blocking mode of socket");
         }
+#endif
     }
 
 
     void TcpClient::trySend(std::string &message) {
 #ifdef _WIN32
-        int bytesSent = ::send(this->tcpSocket, message.c_str(), static_cast<int>(message.size()), 0);
+        int bytesSent = ::send(this->tcpSocket, message.c_str(), static_cast<int>(message.size()), SEND_FLAGS);
 #else
-        ssize_t bytesSent = ::send(this->tcpSocket, message.c_str(), message.size(), 0);
+        ssize_t bytesSent = ::send(this->tcpSocket, message.c_str(), message.size(), SEND_FLAGS);
 #endif
         if (bytesSent == SOCKET_ERROR_VALUE) {
             throw std::runtime_error("Failed to send message");
@@ -123,14 +266,48 @@ namespace pubsupp {
     }
 
 
+    // every call sends one or more complete MQTT packets, send() may take less than all of it
     void TcpClient::trySend(const std::vector<uint8_t> &data) {
+        this->trySend(data.data(), data.size());
+    }
+
+
+    void TcpClient::trySend(const uint8_t *data, size_t length) {
+        size_t sent = 0;
+        while (sent < length) {
 #ifdef _WIN32
-        int bytesSent = ::send(this->tcpSocket, reinterpret_cast<const char *>(data.data()), static_cast<int>(data.size()), 0);
+            int bytesSent = ::send(this->tcpSocket, reinterpret_cast<const char *>(data + sent), static_cast<int>(length - sent), SEND_FLAGS);
 #else
-        ssize_t bytesSent = ::send(this->tcpSocket, data.data(), data.size(), 0);
+            ssize_t bytesSent = ::send(this->tcpSocket, data + sent, length - sent, SEND_FLAGS);
 #endif
-        if (bytesSent == SOCKET_ERROR_VALUE) {
-            throw std::runtime_error("Failed to send binary data");
+            if (this->metrics) {
+                this->metrics->add(Counter::SEND_CALLS);
+            }
+            if (bytesSent == SOCKET_ERROR_VALUE) {
+                throw std::runtime_error("Failed to send binary data");
+            }
+
+            sent += bytesSent;
+            if (sent < length && this->metrics) {
+                this->metrics->add(Counter::PARTIAL_WRITES);
+            }
+        }
+
+        if (!this->metrics && !this->capture) {
+            return;
+        }
+        // counted and captured per packet, a corked write carries several
+        for (size_t offset = 0, packetLength; offset < length; offset += packetLength) {
+            packetLength = MqttMessage::packetLength(data + offset, length - offset);
+            if (packetLength == 0) {
+                packetLength = length - offset; // not a whole packet, recorded as it is
+            }
+            if (this->metrics) {
+                this->metrics->packetOut(data[offset], packetLength);
+            }
+            if (this->capture) {
+                this->capture->record(CaptureDirection::OUTBOUND, data + offset, packetLength);
+            }
         }
     }
 
@@ -173,28 +350,54 @@ namespace pubsupp {
     }
 
 
+    // recv() may return less than asked for, keep reading until the buffer is full
+    void TcpClient::receiveExactly(uint8_t *buffer, size_t length) {
+        size_t received = 0;
+        while (received < length) {
+#ifdef _WIN32
+            int bytesRead = ::recv(this->tcpSocket, reinterpret_cast<char *>(buffer + received), static_cast<int>(length - received), 0);
+#else
+            ssize_t bytesRead = ::recv(this->tcpSocket, buffer + received, length - received, 0);
+#endif
+            if (this->metrics) {
+                this->metrics->add(Counter::RECV_CALLS);
+            }
+            if (bytesRead == SOCKET_ERROR_VALUE) {
+                throw std::runtime_error("Failed to receive binary data");
+            }
+            if (bytesRead == 0) {
+                throw std::runtime_error("Connection closed by peer");
+            }
+            received += bytesRead;
+        }
+    }
+
+
     std::vector<uint8_t> TcpClient::tryReceiveMqttMessage() {
+        std::vector<uint8_t> fullMessage;
+        fullMessage.reserve(8);
+        this->tryReceiveMqttMessage(fullMessage);
+        return fullMessage;
+    }
+
+
+    // the frame replaces the contents of `fullMessage`, reusing its capacity
+    void TcpClient::tryReceiveMqttMessage(std::vector<uint8_t> &fullMessage) {
+        fullMessage.clear();
+
         // fixed header: 1 byte
-        std::vector<uint8_t> fixedHeader = this->tryReceiveBinary(1);
-        if (fixedHeader.empty()) {
-            throw std::runtime_error("Failed to receive MQTT fixed header");
-        }
+        uint8_t byte;
+        this->receiveExactly(&byte, 1);
+        fullMessage.push_back(byte);
 
         // remaining length: 1-4 bytes
-        std::vector<uint8_t> remainingLengthBytes;
-        uint8_t byte;
         uint32_t remainingLength = 0;
         uint32_t multiplier = 1;
         int lengthBytesRead = 0;
 
         do {
-            std::vector<uint8_t> lengthByte = this->tryReceiveBinary(1);
-            if (lengthByte.empty()) {
-                throw std::runtime_error("Failed to receive remaining length byte");
-            }
-
-            byte = lengthByte[0];
-            remainingLengthBytes.push_back(byte);
+            this->receiveExactly(&byte, 1);
+            fullMessage.push_back(byte);
             remainingLength += (byte & 127) * multiplier;
             multiplier *= 128;
             lengthBytesRead++;
@@ -204,16 +407,46 @@ namespace pubsupp {
             }
         } while ((byte & 128) != 0);
 
-        // rest of message
-        std::vector<uint8_t> messageBody = this->tryReceiveBinary(remainingLength);
+        // rest of message (may be empty, e.g. PINGRESP)
+        size_t headerLength = fullMessage.size();
+        fullMessage.resize(headerLength + remainingLength);
+        this->receiveExactly(fullMessage.data() + headerLength, remainingLength);
 
-        // put it all together.
-        std::vector<uint8_t> fullMessage;
-        fullMessage.push_back(fixedHeader[0]);
-        fullMessage.insert(fullMessage.end(), remainingLengthBytes.begin(), remainingLengthBytes.end());
-        fullMessage.insert(fullMessage.end(), messageBody.begin(), messageBody.end());
+        if (this->metrics) {
+            this->metrics->packetIn(fullMessage[0], fullMessage.size());
+        }
+        if (this->capture) {
+            this->capture->record(CaptureDirection::INBOUND, fullMessage.data(), fullMessage.size());
+        }
+    }
 
-        return fullMessage;
+
+    bool TcpClient::waitReadable(int timeoutMs, int wakeFd) {
+#ifdef _WIN32
+        WSAPOLLFD pfd = {};
+        pfd.fd = this->tcpSocket;
+        pfd.events = POLLRDNORM;
+        int result = ::WSAPoll(&pfd, 1, timeoutMs);
+        if (result == SOCKET_ERROR_VALUE) {
+            throw std::runtime_error("Failed to poll socket");
+        }
+        return result > 0;
+#else
+        struct pollfd pfds[2] = {};
+        pfds[0].fd = this->tcpSocket;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = wakeFd;
+        pfds[1].events = POLLIN;
+
+        int result = ::poll(pfds, wakeFd >= 0 ? 2 : 1, timeoutMs);
+        if (result == SOCKET_ERROR_VALUE) {
+            if (errno == EINTR) {
+                return false;
+            }
+            throw std::runtime_error("Failed to poll socket");
+        }
+        return pfds[0].revents != 0;
+#endif
     }
 
 
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "metrics.hpp"
+#include "wireCapture.hpp"
+
 
 
 // set platform-specific includes:
@@ -15,9 +19,12 @@
 	#define SOCKET_ERROR_VALUE SOCKET_ERROR
 #else
 	#include <sys/socket.h>
+	#include <sys/un.h>
 	#include <netinet/in.h>
 	#include <arpa/inet.h>
 	#include <unistd.h>
+	#include <fcntl.h>
+	#include <poll.h>
 	#include <sys/types.h>
 	typedef int SocketType;
 	#define INVALID_SOCKET_VALUE -1
@@ -30,6 +37,16 @@
 
 namespace pubsupp {
 
+	// "unix:///run/mqtt.sock" -> "/run/mqtt.sock", empty for any other address (IPv4 addresses)
+	std::string unixSocketPath(const std::string& address);
+
+
+
+	/*
+	 * Blocking stream socket to the broker. Despite the name it also speaks Unix domain sockets (POSIX only):
+	 * a server address of the form unix://<path> connects to the socket file at <path> and ignores the port,
+	 * which saves the TCP stack for brokers on the same host.
+	 */
 	class TcpClient {
 		public:
 			TcpClient();
@@ -37,24 +54,48 @@ namespace pubsupp {
 			~TcpClient();
 
 			void tryConnect(std::string& serverAddress, int serverPort);
+			// non-blocking connect: returns true if connected right away, otherwise call finishConnect()
+			// once nativeHandle() is writable, it throws if the handshake failed
+			bool beginConnect(std::string& serverAddress, int serverPort);
+			void finishConnect();
+			SocketType nativeHandle() const { return this->tcpSocket; }
 			void disconnect();
 			void trySend(std::string& message);
 			void trySend(const std::vector<uint8_t>& data);
+			void trySend(const uint8_t* data, size_t length);
 			std::string tryReceive(int bufferSize);
 			std::vector<uint8_t> tryReceiveBinary(size_t bufferSize);
 			// Try reading MQTT msg with proper length handling:
 			std::vector<uint8_t> tryReceiveMqttMessage();
+			// same, into a buffer owned by the caller, so a warm buffer takes frames without allocating
+			void tryReceiveMqttMessage(std::vector<uint8_t>& frame);
+			// wait until data can be read, timeoutMs < 0 waits forever.
+			// wakeFd (POSIX only) ends the wait early, returns whether the socket is readable
+			bool waitReadable(int timeoutMs, int wakeFd = -1);
+			// count syscalls and packets into `metrics` (not owned), nullptr turns counting off
+			void setMetrics(Metrics* metrics) { this->metrics = metrics; }
+			// append every MQTT frame sent or received from now on to a capture file at `path`
+			void enableCapture(const std::string& path) { this->capture = std::make_unique<CaptureWriter>(path); }
+			void disableCapture() { this->capture.reset(); }
 
 		private:
 			void initializeSocket();
 			void cleanupSocket();
+			// (re)opens the socket for the address family if needed, resolves the address and returns its length
+			socklen_t prepareConnect(std::string& serverAddress, int serverPort, struct sockaddr_storage& address);
+			void setBlocking(bool blocking);
+			std::string endpoint() const; // for error messages
+			void receiveExactly(uint8_t* buffer, size_t length);
 
 			std::string ipAddress;
 			int port;
 			SocketType tcpSocket;
+			int socketFamily = AF_INET;
 			std::string serverAddress;
 			int serverPort;
 			bool socketInitialized;
+			Metrics* metrics = nullptr;
+			std::unique_ptr<CaptureWriter> capture;
 	};
 
 }
@@ -1,16 +1,16 @@
 #include "topic.hpp"
 
-#include <iostream>
-#include <vector>
-#include <algorithm>
+#include <stdexcept>
+
+
+#include "logger.hpp"
 
 
 namespace pubsupp {
 	void Topic::set(const std::string& newTopic) {
 		if (this->isValid(newTopic)) {
 			this->topic = newTopic;
-			this->parseTopicLevels();
-		} else std::cerr << "Invalid topic: " << newTopic << std::endl;
+		} else PUBSUPP_LOG_WARN("Invalid topic: " << newTopic);
 	}
 
 
@@ -29,90 +29,80 @@ namespace pubsupp {
 	}
 
 
-	void Topic::parseTopicLevels() {
-		this->topicLevels.reserve(std::count(this->topic.begin(), this->topic.end(), '/') + 1);
-
-		size_t start = 0;
-		while (true) {
-			size_t pos = this->topic.find('/', start);
+	namespace {
+		/*
+		 * Topic filter matching rules (4.7)
+		 * - '+' matches exactly one topic level
+		 * - '#' matches zero or more topic levels and must be at the end
+		 * - wildcards at the first level do not match topics starting with '$' (4.7.2)
+		 */
+		bool matchLevels(std::string_view topic, std::string_view filter) {
+			if (!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) return false;
 
-			if (pos == std::string::npos) { // last level
-				this->topicLevels.emplace_back(this->topic.substr(start));
-				break;
-			}
-			this->topicLevels.emplace_back(this->topic.substr(start, pos - start));
-			start  = pos + 1;
-		}
-	}
+			size_t topicPos = 0;
+			size_t filterPos = 0;
+			while (true) {
+				size_t filterEnd = filter.find('/', filterPos);
+				if (filterEnd == std::string_view::npos) filterEnd = filter.length();
+				std::string_view filterLevel = filter.substr(filterPos, filterEnd - filterPos);
 
+				if (filterLevel == "#") return filterEnd == filter.length(); // matches all remaining levels, parent included
+				if (topicPos > topic.length()) return false; // topic has fewer levels
 
-	std::vector<std::string> Topic::parseTopicLevels(const std::string& t) {
-		std::vector<std::string> levels;
-		levels.reserve(std::count(t.begin(), t.end(), '/') + 1);
+				size_t topicEnd = topic.find('/', topicPos);
+				if (topicEnd == std::string_view::npos) topicEnd = topic.length();
 
-		size_t start = 0;
-		while (true) {
-			size_t pos = t.find('/', start);
+				if (filterLevel != "+" && filterLevel != topic.substr(topicPos, topicEnd - topicPos)) return false;
 
-			if (pos == std::string::npos) { // last level
-				levels.emplace_back(t.substr(start));
-				break;
+				filterPos = filterEnd + 1;
+				topicPos = topicEnd + 1;
+				if (filterPos > filter.length()) return topicPos > topic.length(); // both must run out together
 			}
-			levels.emplace_back(t.substr(start, pos - start));
-			start = pos + 1;
 		}
-
-		return levels;
 	}
 
 
 	/*
 	 * Check if a topic passes a filter.
-	 *
-	 * Topic filter matching rules (4.7)
-	 * - '+' matches exactly one topic level
-	 * - '#' matches zero or more topic levels and must be at the end
-	 * - '#' must be preceded by '/' unless it's the only character
+	 * A '#' that is not the last level never matches; use TopicFilter to validate a filter up front.
 	 */
-	bool Topic::passesFilter(const std::string& filter) {
-		const std::string& topic = this->topic;
+	bool Topic::passesFilter(std::string_view filter) const {
+		return matchLevels(this->topic, filter);
+	}
+
 
-		if (filter.empty()) return topic.empty();
-		if (filter == "#") return true;
 
-		// Validate '#' position - must be at the end and preceded by '/'
-		size_t hashPos = filter.find('#');
-		if (hashPos != std::string::npos) {
-			if (hashPos != filter.length() - 1) return false;
-			if (hashPos > 0 && filter[hashPos - 1] != '/') return false;
+	TopicFilter::TopicFilter(std::string filter) : filter(std::move(filter)) {
+		if (!isValid(this->filter)) {
+			throw std::runtime_error("Invalid topic filter: " + this->filter);
 		}
+		this->hasWildcards = this->filter.find_first_of("+#") != std::string::npos;
+	}
 
-		this->parseTopicLevels();
-		std::vector<std::string> filterLevels = this->parseTopicLevels(filter);
 
-		// Handle '#' at the end of filter
-		if (!filterLevels.empty() && filterLevels.back() == "#") {
-			filterLevels.pop_back(); // Remove '#' from levels
-			// Match all remaining topic levels
-			if (filterLevels.size() > topicLevels.size()) return false;
+	bool TopicFilter::isValid(std::string_view filter) {
+		if (filter.empty()) return false;
+		if (filter.length() > 65535) return false;
+		if (filter.find('\0') != std::string_view::npos) return false;
 
-			// Check that all filter levels (except '#') match
-			for (size_t i = 0; i < filterLevels.size(); ++i) {
-				if (filterLevels[i] == "+") continue;
-				if (i >= topicLevels.size() || filterLevels[i] != topicLevels[i]) return false;
-			}
-			return true; // '#' matches all remaining levels
-		}
+		size_t start = 0;
+		while (true) {
+			size_t pos = filter.find('/', start);
+			std::string_view level = filter.substr(start, pos == std::string_view::npos ? std::string_view::npos : pos - start);
 
-		// No '#' in filter - exact level count match required
-		if (filterLevels.size() != topicLevels.size()) return false;
+			if (level.find_first_of("+#") != std::string_view::npos) {
+				if (level.length() != 1) return false;
+				if (level == "#" && pos != std::string_view::npos) return false;
+			}
 
-		// Match each level
-		for (size_t i = 0; i < filterLevels.size(); ++i) {
-			if (filterLevels[i] == "+") continue;
-			if (filterLevels[i] != topicLevels[i]) return false;
+			if (pos == std::string_view::npos) return true;
+			start = pos + 1;
 		}
+	}
 
-		return true;
+
+	bool TopicFilter::matches(std::string_view topic) const {
+		if (!this->hasWildcards) return topic == this->filter;
+		return matchLevels(topic, this->filter);
 	}
 }
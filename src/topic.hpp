@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
-#include <vector>
+#include <string_view>
+
+
+#include "topicInterner.hpp"
 
 
 
@@ -29,17 +32,38 @@ namespace pubsupp {
 
 			void set(const std::string& newTopic);
 			const std::string& get() { return this->topic; };
+			TopicId id() const { return TopicInterner::global().intern(this->topic); }
 
 			bool isValid();
 			bool isValid(const std::string& t);
 
-			bool passesFilter(const std::string& filter);
+			// walks topic and filter level by level, without allocating
+			bool passesFilter(std::string_view filter) const;
 
 		private:
 			std::string topic;
-			std::vector<std::string> topicLevels;
+	};
+
 
-			void parseTopicLevels();
-			std::vector<std::string> parseTopicLevels(const std::string& t);
+
+	/*
+	 * Topic filter validated once on construction, for matching it against many topics.
+	 *
+	 * Wildcard placement (4.7.1)
+	 * - '+' and '#' must occupy an entire level
+	 * - '#' must be the last level
+	 */
+	class TopicFilter {
+		public:
+			explicit TopicFilter(std::string filter); // throws if the filter is invalid
+
+			static bool isValid(std::string_view filter);
+
+			bool matches(std::string_view topic) const;
+			const std::string& get() const { return this->filter; }
+
+		private:
+			std::string filter;
+			bool hasWildcards = false;
 	};
 }
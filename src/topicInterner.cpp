@@ -0,0 +1,141 @@
+#include "topicInterner.hpp"
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+
+
+namespace pubsupp {
+
+	TopicInterner& TopicInterner::global() {
+		static TopicInterner interner;
+		return interner;
+	}
+
+
+	TopicInterner::TopicInterner() : slots(1024) {}
+
+
+	TopicId TopicInterner::intern(std::string_view topic) {
+		uint64_t h = hash(topic);
+		{
+			std::shared_lock<std::shared_mutex> lock(this->mutex);
+			TopicId id = this->lookup(topic, h);
+			if (id != INVALID_TOPIC_ID) {
+				return id;
+			}
+		}
+
+		std::unique_lock<std::shared_mutex> lock(this->mutex);
+		TopicId id = this->lookup(topic, h); // someone else may have inserted it in between
+		if (id != INVALID_TOPIC_ID) {
+			return id;
+		}
+
+		if (this->names.size() >= INVALID_TOPIC_ID) {
+			throw std::runtime_error("Topic intern table full");
+		}
+		if ((this->names.size() + 1) * 2 > this->slots.size()) {
+			this->grow();
+		}
+
+		id = static_cast<TopicId>(this->names.size());
+		this->names.push_back(this->store(topic));
+
+		size_t mask = this->slots.size() - 1;
+		for (size_t i = h & mask;; i = (i + 1) & mask) {
+			if (this->slots[i].id == INVALID_TOPIC_ID) {
+				this->slots[i] = {h, id};
+				break;
+			}
+		}
+		return id;
+	}
+
+
+	TopicId TopicInterner::find(std::string_view topic) const {
+		std::shared_lock<std::shared_mutex> lock(this->mutex);
+		return this->lookup(topic, hash(topic));
+	}
+
+
+	std::string_view TopicInterner::name(TopicId id) const {
+		std::shared_lock<std::shared_mutex> lock(this->mutex);
+		if (id >= this->names.size()) {
+			throw std::runtime_error("Unknown topic id: " + std::to_string(id));
+		}
+		return this->names[id];
+	}
+
+
+	size_t TopicInterner::size() const {
+		std::shared_lock<std::shared_mutex> lock(this->mutex);
+		return this->names.size();
+	}
+
+
+	size_t TopicInterner::memoryBytes() const {
+		std::shared_lock<std::shared_mutex> lock(this->mutex);
+		return this->chunks.size() * CHUNK_SIZE + this->slots.capacity() * sizeof(Slot) + this->names.capacity() * sizeof(std::string_view);
+	}
+
+
+	// libstdc++/libc++ hash strings 8 bytes at a time (murmur/cityhash style), good enough for long device paths
+	uint64_t TopicInterner::hash(std::string_view topic) {
+		return std::hash<std::string_view>{}(topic);
+	}
+
+
+	TopicId TopicInterner::lookup(std::string_view topic, uint64_t hash) const {
+		size_t mask = this->slots.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			const Slot& slot = this->slots[i];
+			if (slot.id == INVALID_TOPIC_ID) {
+				return INVALID_TOPIC_ID;
+			}
+			if (slot.hash == hash && this->names[slot.id] == topic) {
+				return slot.id;
+			}
+		}
+	}
+
+
+	std::string_view TopicInterner::store(std::string_view topic) {
+		if (topic.size() > CHUNK_SIZE) { // longer than any valid topic, but don't rely on the caller
+			throw std::runtime_error("Topic too long to intern");
+		}
+
+		if (this->chunks.empty() || this->chunkUsed + topic.size() > CHUNK_SIZE) {
+			this->chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+			this->chunkUsed = 0;
+		}
+
+		char* dest = this->chunks.back().get() + this->chunkUsed;
+		std::memcpy(dest, topic.data(), topic.size());
+		this->chunkUsed += topic.size();
+
+		return std::string_view(dest, topic.size());
+	}
+
+
+	void TopicInterner::grow() {
+		std::vector<Slot> grown(this->slots.size() * 2);
+		size_t mask = grown.size() - 1;
+
+		for (const Slot& slot : this->slots) {
+			if (slot.id == INVALID_TOPIC_ID) {
+				continue;
+			}
+			for (size_t i = slot.hash & mask;; i = (i + 1) & mask) {
+				if (grown[i].id == INVALID_TOPIC_ID) {
+					grown[i] = slot;
+					break;
+				}
+			}
+		}
+		this->slots = std::move(grown);
+	}
+
+} // namespace pubsupp
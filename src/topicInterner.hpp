@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+
+
+namespace pubsupp {
+
+	using TopicId = uint32_t;
+	constexpr TopicId INVALID_TOPIC_ID = std::numeric_limits<TopicId>::max();
+
+
+	/*
+	 * Process-wide table mapping topic names to dense 32 bit ids (0, 1, 2, ...), so code working
+	 * with a known set of topics (see Topic::id()) can key on integers (or index vectors) instead
+	 * of hashing and comparing the full topic every time.
+	 *
+	 * Names are copied once into an arena of fixed-size chunks and never move, name(id) stays
+	 * valid for the lifetime of the process. The index is an open-addressing table of ids with
+	 * their cached hashes, so a lookup compares the string only on a hash hit.
+	 *
+	 * Ids are never released: the table is meant for the bounded set of topics a process works with,
+	 * not for arbitrary client-generated names. That is why inbound messages are not interned: the
+	 * client routes on the topic string through a bounded per-client cache, and the LastValueCache
+	 * keeps its own copies of the names it holds.
+	 * Lookups take a shared lock, only inserting a new name takes the exclusive one.
+	 */
+	class TopicInterner {
+	  public:
+		static TopicInterner& global();
+
+		TopicInterner();
+		TopicInterner(const TopicInterner&) = delete;
+		TopicInterner& operator=(const TopicInterner&) = delete;
+
+		TopicId intern(std::string_view topic);
+		// INVALID_TOPIC_ID if the topic was never interned
+		TopicId find(std::string_view topic) const;
+		std::string_view name(TopicId id) const;
+
+		size_t size() const;
+		size_t memoryBytes() const;
+
+	  private:
+		struct Slot {
+			uint64_t hash = 0;
+			TopicId id = INVALID_TOPIC_ID;
+		};
+
+		static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+		static uint64_t hash(std::string_view topic);
+		TopicId lookup(std::string_view topic, uint64_t hash) const;
+		std::string_view store(std::string_view topic);
+		void grow();
+
+		mutable std::shared_mutex mutex;
+		std::vector<Slot> slots; // power of two, at most half full
+		std::vector<std::string_view> names; // indexed by id, pointing into the arena
+		std::vector<std::unique_ptr<char[]>> chunks;
+		size_t chunkUsed = 0;
+	};
+
+} // namespace pubsupp
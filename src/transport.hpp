@@ -0,0 +1,139 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+#include "metrics.hpp"
+#include "tcpClient.hpp"
+
+
+
+namespace pubsupp {
+
+	/*
+	 * What BasicMqttClient needs from the byte stream below it (TcpClient is the reference).
+	 *
+	 * - tryConnect/disconnect open and close the stream, reconnecting after disconnect must work
+	 * - trySend writes one or more complete MQTT packets (several while connectPipelined batches the first flight),
+	 *   tryReceiveMqttMessage reads one complete packet into `frame`
+	 * - waitReadable blocks until a packet can be read, `timeoutMs` runs out (< 0 waits forever) or `wakeFd`
+	 *   (-1 for none) becomes readable, and returns whether the stream is readable
+	 * - setMetrics points the transport at the counters of its connection, nullptr turns counting off
+	 *
+	 * Errors are thrown as std::runtime_error, like everywhere else. Transports may also provide
+	 * enableCapture(path)/disableCapture(), see MqttClient::enableWireCapture.
+	 */
+	template <typename T>
+	concept MqttTransport = requires(T transport, std::string& address, int port, const uint8_t* data, size_t length, std::vector<uint8_t>& frame,
+									 int timeoutMs, int wakeFd, Metrics* metrics) {
+		transport.tryConnect(address, port);
+		transport.disconnect();
+		transport.trySend(data, length);
+		transport.tryReceiveMqttMessage(frame);
+		{ transport.waitReadable(timeoutMs, wakeFd) } -> std::convertible_to<bool>;
+		transport.setMetrics(metrics);
+	};
+
+
+	// transports whose connect can run in the background, so one thread can drive many handshakes (see ConnectionStorm)
+	template <typename T>
+	concept NonBlockingConnectTransport = requires(T transport, std::string& address, int port) {
+		{ transport.beginConnect(address, port) } -> std::convertible_to<bool>;
+		transport.finishConnect();
+		transport.nativeHandle();
+	};
+
+
+	template <typename T>
+	concept CapturingTransport = requires(T transport, const std::string& path) {
+		transport.enableCapture(path);
+		transport.disableCapture();
+	};
+
+
+
+	/*
+	 * Type-erased transport, for code that picks the transport at runtime or doesn't want the client
+	 * as a template (DynamicMqttClient). Every call is one virtual call, default constructed it is a TcpClient.
+	 *
+	 *   DynamicMqttClient client(host, port, clientId, std::in_place, AnyTransport::make<MyTransport>(args...));
+	 */
+	class AnyTransport {
+	  public:
+		AnyTransport() : AnyTransport(make<TcpClient>()) {}
+
+		template <MqttTransport T, typename... Args>
+		static AnyTransport make(Args&&... args) {
+			return AnyTransport(std::make_unique<Model<T>>(std::forward<Args>(args)...));
+		}
+
+		AnyTransport(AnyTransport&&) noexcept = default;
+		AnyTransport& operator=(AnyTransport&&) noexcept = default;
+
+		void tryConnect(std::string& address, int port) { this->self->tryConnect(address, port); }
+		void disconnect() { this->self->disconnect(); }
+		void trySend(const uint8_t* data, size_t length) { this->self->trySend(data, length); }
+		void tryReceiveMqttMessage(std::vector<uint8_t>& frame) { this->self->tryReceiveMqttMessage(frame); }
+		bool waitReadable(int timeoutMs, int wakeFd = -1) { return this->self->waitReadable(timeoutMs, wakeFd); }
+		void setMetrics(Metrics* metrics) { this->self->setMetrics(metrics); }
+		// throws if the transport behind it can't capture
+		void enableCapture(const std::string& path) { this->self->enableCapture(path); }
+		void disableCapture() { this->self->disableCapture(); }
+
+	  private:
+		struct Interface {
+			virtual ~Interface() = default;
+			virtual void tryConnect(std::string& address, int port) = 0;
+			virtual void disconnect() = 0;
+			virtual void trySend(const uint8_t* data, size_t length) = 0;
+			virtual void tryReceiveMqttMessage(std::vector<uint8_t>& frame) = 0;
+			virtual bool waitReadable(int timeoutMs, int wakeFd) = 0;
+			virtual void setMetrics(Metrics* metrics) = 0;
+			virtual void enableCapture(const std::string& path) = 0;
+			virtual void disableCapture() = 0;
+		};
+
+
+		template <typename T>
+		struct Model final : Interface {
+			template <typename... Args>
+			explicit Model(Args&&... args) : transport(std::forward<Args>(args)...) {}
+
+			void tryConnect(std::string& address, int port) override { this->transport.tryConnect(address, port); }
+			void disconnect() override { this->transport.disconnect(); }
+			void trySend(const uint8_t* data, size_t length) override { this->transport.trySend(data, length); }
+			void tryReceiveMqttMessage(std::vector<uint8_t>& frame) override { this->transport.tryReceiveMqttMessage(frame); }
+			bool waitReadable(int timeoutMs, int wakeFd) override { return this->transport.waitReadable(timeoutMs, wakeFd); }
+			void setMetrics(Metrics* metrics) override { this->transport.setMetrics(metrics); }
+
+			void enableCapture(const std::string& path) override {
+				if constexpr (CapturingTransport<T>) {
+					this->transport.enableCapture(path);
+				} else {
+					throw std::runtime_error("Transport does not support wire capture");
+				}
+			}
+
+			void disableCapture() override {
+				if constexpr (CapturingTransport<T>) {
+					this->transport.disableCapture();
+				}
+			}
+
+			T transport;
+		};
+
+
+		explicit AnyTransport(std::unique_ptr<Interface> self) : self(std::move(self)) {}
+
+		std::unique_ptr<Interface> self;
+	};
+
+} // namespace pubsupp
@@ -0,0 +1,134 @@
+#include "wireCapture.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+
+#include "latencyHistogram.hpp"
+
+
+
+namespace pubsupp {
+
+	namespace {
+		constexpr char MAGIC[5] = {'P', 'S', 'C', 'A', 'P'};
+		constexpr uint8_t VERSION = 1;
+		constexpr uint64_t MAX_FRAME = 5 + 268435455; // fixed header + largest remaining length (2.2.3)
+
+
+		void appendVarint(std::vector<char>& out, uint64_t value) {
+			do {
+				uint8_t byte = value & 127;
+				value >>= 7;
+				if (value > 0) {
+					byte |= 128;
+				}
+				out.push_back(static_cast<char>(byte));
+			} while (value > 0);
+		}
+	} // namespace
+
+
+
+	CaptureWriter::CaptureWriter(const std::string& path) : file(path, std::ios::binary | std::ios::trunc) {
+		if (!this->file) {
+			throw std::runtime_error("Failed to open capture file: " + path);
+		}
+
+		this->file.write(MAGIC, sizeof(MAGIC));
+		this->file.put(static_cast<char>(VERSION));
+		this->startNs = monotonicNs();
+		this->lastNs = this->startNs;
+	}
+
+
+	CaptureWriter::~CaptureWriter() { this->file.flush(); }
+
+
+	void CaptureWriter::record(CaptureDirection direction, const uint8_t* frame, size_t length) {
+		std::lock_guard lock(this->mutex);
+
+		uint64_t now = monotonicNs();
+		uint64_t delta = now > this->lastNs ? now - this->lastNs : 0;
+		this->lastNs += delta;
+
+		this->buffer.clear();
+		this->buffer.push_back(static_cast<char>(direction));
+		appendVarint(this->buffer, delta);
+		appendVarint(this->buffer, length);
+
+		this->file.write(this->buffer.data(), static_cast<std::streamsize>(this->buffer.size()));
+		this->file.write(reinterpret_cast<const char*>(frame), static_cast<std::streamsize>(length));
+		if (!this->file) {
+			throw std::runtime_error("Failed to write capture record");
+		}
+		this->count++;
+	}
+
+
+	void CaptureWriter::flush() {
+		std::lock_guard lock(this->mutex);
+		this->file.flush();
+	}
+
+
+
+
+
+	CaptureReader::CaptureReader(const std::string& path) : file(path, std::ios::binary) {
+		if (!this->file) {
+			throw std::runtime_error("Failed to open capture file: " + path);
+		}
+
+		char header[sizeof(MAGIC) + 1];
+		if (!this->file.read(header, sizeof(header)) || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+			throw std::runtime_error("Not a capture file: " + path);
+		}
+		if (static_cast<uint8_t>(header[sizeof(MAGIC)]) != VERSION) {
+			throw std::runtime_error("Unsupported capture version " + std::to_string(static_cast<uint8_t>(header[sizeof(MAGIC)])) + ": " + path);
+		}
+	}
+
+
+	bool CaptureReader::readVarint(uint64_t& value) {
+		value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			int byte = this->file.get();
+			if (byte == std::char_traits<char>::eof()) {
+				return false;
+			}
+			value |= static_cast<uint64_t>(byte & 127) << shift;
+			if ((byte & 128) == 0) {
+				return true;
+			}
+		}
+		throw std::runtime_error("Corrupt capture file: varint too long");
+	}
+
+
+	bool CaptureReader::next(CaptureRecord& record) {
+		int direction = this->file.get();
+		if (direction == std::char_traits<char>::eof()) {
+			return false;
+		}
+		if (direction > static_cast<int>(CaptureDirection::OUTBOUND)) {
+			throw std::runtime_error("Corrupt capture file: unknown direction " + std::to_string(direction));
+		}
+
+		uint64_t delta;
+		uint64_t length;
+		if (!this->readVarint(delta) || !this->readVarint(length)) {
+			return false;
+		}
+		if (length > MAX_FRAME) {
+			throw std::runtime_error("Corrupt capture file: frame of " + std::to_string(length) + " bytes");
+		}
+
+		record.direction = static_cast<CaptureDirection>(direction);
+		this->timeNs += delta;
+		record.timeNs = this->timeNs;
+		record.frame.resize(length);
+		return static_cast<bool>(this->file.read(reinterpret_cast<char*>(record.frame.data()), static_cast<std::streamsize>(length)));
+	}
+
+} // namespace pubsupp
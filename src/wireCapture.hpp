@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+
+namespace pubsupp {
+
+	enum class CaptureDirection : uint8_t {
+		INBOUND = 0, // received from the broker
+		OUTBOUND = 1 // sent to the broker
+	};
+
+
+	struct CaptureRecord {
+		CaptureDirection direction = CaptureDirection::INBOUND;
+		uint64_t timeNs = 0; // since the capture started
+		std::vector<uint8_t> frame; // one complete MQTT packet
+	};
+
+
+
+	/*
+	 * Appends raw MQTT frames to a capture file, as they went over the wire.
+	 *
+	 * file:   magic "PSCAP" | version (1) | records...
+	 * record: direction (1) | time delta in ns (varint) | frame length (varint) | frame
+	 *
+	 * Times are monotonic and stored as the distance to the previous record, so a record
+	 * usually costs 3-5 bytes on top of the frame. Writes go through the stream's buffer,
+	 * flush() (or destroying the writer) pushes them to the file.
+	 * Safe to use from several threads, records are appended in the order they arrive.
+	 */
+	class CaptureWriter {
+	  public:
+		explicit CaptureWriter(const std::string& path);
+		~CaptureWriter();
+
+		CaptureWriter(const CaptureWriter&) = delete;
+		CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+		void record(CaptureDirection direction, const uint8_t* frame, size_t length);
+		void flush();
+
+		uint64_t records() const { return this->count; }
+
+	  private:
+		std::mutex mutex;
+		std::ofstream file;
+		std::vector<char> buffer;
+		uint64_t startNs = 0;
+		uint64_t lastNs = 0;
+		uint64_t count = 0;
+	};
+
+
+
+	// reads a capture file written by CaptureWriter, front to back
+	class CaptureReader {
+	  public:
+		explicit CaptureReader(const std::string& path);
+
+		// false at the end of the file; a truncated last record (capture still being written, crash) ends it too
+		bool next(CaptureRecord& record);
+
+	  private:
+		bool readVarint(uint64_t& value);
+
+		std::ifstream file;
+		uint64_t timeNs = 0;
+	};
+
+} // namespace pubsupp